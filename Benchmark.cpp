@@ -0,0 +1,209 @@
+#include "Benchmark.h"
+#include "SmartControl.h"
+#include "Display.h"
+#include "HAOTMonitor.h"
+#include <HAMqtt.h>
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+
+void handleResponse(unsigned long response, OpenThermResponseStatus state);  // SmartControl.cpp, the OT callback
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+Benchmark *_benchmark = 0;
+Benchmark *Benchmark::instance() { return _benchmark; }
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+Benchmark::Benchmark()
+{
+  _benchmark = this;
+  _mqtt = NULL;
+  _requested = false;
+  _count = 0;
+  runs = 0;
+}
+
+bool Benchmark::begin(HAMqtt *mqtt)
+{
+  _mqtt = mqtt;
+  return true;
+}
+
+bool Benchmark::loop()
+{
+  if (!_requested)
+    return false;
+  _requested = false;
+  return run();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The fastest of the rounds, a round with an interrupt or a WiFi task in it is slower
+////////////////////////////////////////////////////////////////////////////////////////////
+template<class F>
+void Benchmark::_measure(const char *name, F op, uint32_t gap)
+{
+  if (_count >= BENCHMARK_CASES)
+    return;
+  uint32_t heap = ESP.getFreeHeap();
+#ifdef BENCHMARK_ALLOCS
+  uint32_t allocs = BENCHMARK_ALLOCS;
+#endif
+  uint32_t best = UINT32_MAX;
+  for (uint8_t r=0; r<BENCHMARK_ROUNDS; r++)
+  {
+    uint32_t cycles = 0;
+    if (gap)
+      for (uint16_t i=0; i<BENCHMARK_OPS; i++) {
+        delay(gap);                       // so what runs on the time since the last op sees some
+        uint32_t start = ESP.getCycleCount();
+        op(i);
+        cycles += ESP.getCycleCount() - start;
+      }
+    else {
+      uint32_t start = ESP.getCycleCount();
+      for (uint16_t i=0; i<BENCHMARK_OPS; i++)
+        op(i);
+      cycles = ESP.getCycleCount() - start;
+    }
+    if (cycles < best)
+      best = cycles;
+    yield();
+  }
+  Result &res = _results[_count++];
+  res.name = name;
+  res.cycles = best / BENCHMARK_OPS;
+  res.ns = (uint64_t) best * 1000 / ESP.getCpuFreqMHz() / BENCHMARK_OPS;
+  res.heap = (int32_t) heap - (int32_t) ESP.getFreeHeap();
+#ifdef BENCHMARK_ALLOCS
+  const uint32_t ops = BENCHMARK_ROUNDS * BENCHMARK_OPS;
+  res.allocs = (BENCHMARK_ALLOCS - allocs + ops - 1) / ops;
+#else
+  res.allocs = -1;
+#endif
+  INFO("Benchmark %s: %u cycles, %u ns, %d allocations per op, %d bytes kept", name, res.cycles, res.ns,
+    res.allocs, res.heap);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+void Benchmark::_cases()
+{
+#ifdef BENCHMARK
+  SmartControl *c = SmartControl::instance();
+
+  TemperatureT<InsidePolicy> valid(20.0f);   // 1 ms apart and rising 0.01 C/s, through the rate check
+  uint16_t step = 0;
+  _measure("temperature.set.valid", [&](uint16_t i) { valid.set(20.0f + step++ * 0.00001f); }, 1);
+
+  TemperatureT<InsidePolicy> spike(20.0f);   // every other sample is far outside the estimate
+  for (uint8_t i=0; i<20; i++)
+    spike.set(20.0f);
+  _measure("temperature.set.spike", [&](uint16_t i) { spike.set(i % 2 ? 25.0f : 20.0f); });
+
+  TemperatureT<InsidePolicy> rate(20.0f);    // a jump after some time, always above the rate
+  rate.set(20.0f);
+  delay(2);
+  _measure("temperature.set.rate", [&](uint16_t i) { rate.set(30.0f); });
+
+  volatile float sink;
+  _measure("temperature.trend", [&](uint16_t i) { sink = valid.trend(); });
+  _measure("temperature.average", [&](uint16_t i) { sink = valid.average(); });
+
+  HeatingCurve curve;
+  TemperatureT<InsidePolicy> inside(20.3f);
+  TemperatureT<TargetPolicy> target(20.5f);
+  TemperatureT<OutsidePolicy> outside(5.0f);
+  _measure("curve.calculate", [&](uint16_t i) { sink = curve.calculate(&inside, &target, &outside, 0.3f); });
+
+  ModeInput in = { 20.3f, 5.0f, 20.5f, 32.0f, 0.3f, 31.0f, 0.0f, true, true, true, true, true, false };
+  _measure("control.decide", [&](uint16_t i) { OperatingFlags f = {}; operating_mode(in, f); });
+
+#ifdef BENCHMARK_HOST
+  if (c) {
+    // an analysis after the anti pendel time, it switches as the temperatures ask for
+    _measure("control.operating_mode", [&](uint16_t i) { c->set_operating_mode(); }, ANTIPENDEL_TIMEFRAME);
+
+    // the callback of the library with a version response, it changes no settings
+    unsigned long response = OpenTherm::buildResponse(OpenThermMessageType::READ_ACK, OpenThermMessageID::SlaveVersion, 0x0102);
+    _measure("ot.dispatch", [&](uint16_t i) { handleResponse(response, OpenThermResponseStatus::SUCCESS); });
+  }
+
+  Display *d = Display::instance();
+  if (d) {
+    char cache[8] = "12.3C";
+    _measure("display.print.cached", [&](uint16_t i) { d->_print(0, 10, NULL, ST77XX_BLACK, "12.3C", cache); });
+    _measure("display.print.changed", [&](uint16_t i) { d->_print(0, 10, NULL, ST77XX_BLACK, i % 2 ? "12.3C" : "45.6C", cache); });
+  }
+
+  HAOTMonitor *ha = HAOTMonitor::instance();
+  if (ha)
+    _measure("ha.update", [&](uint16_t i) { ha->update(); });
+#endif
+
+  if (c)
+    c->benchmark();   // bytes per temperature policy
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// {"build":"..","mhz":80,"cases":{"temperature.set.valid":{"cycles":..,"ns":..,"heap":..,"allocs":..},..}}
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Benchmark::_publish()
+{
+#ifdef BENCHMARK
+  static char doc[BENCHMARK_DOC];
+  uint8_t mhz = ESP.getCpuFreqMHz();
+  int n = snprintf_P(doc, sizeof(doc), PSTR("{\"build\":\"%s %s\",\"mhz\":%u,\"cases\":{"), __DATE__, __TIME__, mhz);
+  for (uint8_t i=0; i<_count && n < (int) sizeof(doc); i++) {
+    const Result &r = _results[i];
+    n += snprintf_P(doc + n, sizeof(doc) - n, PSTR("%s\"%s\":{\"cycles\":%u,\"ns\":%u,\"heap\":%d,\"allocs\":%d}"),
+      i ? "," : "", r.name, r.cycles, r.ns, r.heap, r.allocs);
+  }
+  if (n + 3 > (int) sizeof(doc)) {
+    ERROR("Benchmark: results do not fit in %d bytes", sizeof(doc));
+    return false;
+  }
+  strcpy(doc + n, "}}");
+  return _mqtt && _mqtt->publish(BENCHMARK_TOPIC, doc, true);
+#else
+  return false;
+#endif
+}
+
+bool Benchmark::run()
+{
+#ifndef BENCHMARK
+  INFO("Benchmark: compiled without BENCHMARK (Benchmark.h)");
+  return false;
+#endif
+  _count = 0;
+  uint32_t start = millis();
+  _cases();
+  runs++;
+  INFO("Benchmark: %d cases in %u ms", _count, millis() - start);
+  return _publish();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Benchmark::subscribe(HAMqtt *mqtt)
+{
+  return mqtt->subscribe(BENCHMARK_TOPIC "/run");
+}
+
+bool Benchmark::onMessage(const char *topic, const uint8_t *payload, uint16_t length)
+{
+  if (strcmp(topic, BENCHMARK_TOPIC "/run") != 0)
+    return false;
+  _requested = true;      // not from within the MQTT callback
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
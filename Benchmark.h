@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Arduino.h>
+
+class HAMqtt;
+
+//#define BENCHMARK                         // compile the cases in, run them with BENCHMARK_TOPIC/run
+#define BENCHMARK_TOPIC     "SmartTherm/benchmark"
+#ifndef BENCHMARK_OPS
+#define BENCHMARK_OPS       100             // operations per round
+#endif
+#ifndef BENCHMARK_ROUNDS
+#define BENCHMARK_ROUNDS    5               // the fastest round counts
+#endif
+#define BENCHMARK_CASES     16
+#define BENCHMARK_DOC       1536            // the json document of the results
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Micro benchmarks of the hot paths. Each case runs BENCHMARK_ROUNDS rounds of BENCHMARK_OPS
+// operations, the fastest round gives the cycles per operation, which is stable over runs
+// (interrupts and WiFi only make a round slower). A case with a gap waits that many ms before
+// each operation and counts only the operation. The heap that was not returned after a case
+// is reported with it, the allocations per operation only where they are counted: the host
+// build defines BENCHMARK_ALLOCS as its counter, the device has no malloc hook.
+// The results are logged and published retained as json on BENCHMARK_TOPIC, save two of
+// them and compare with tools/bench_compare.py.
+// On the device the cases run on scratch objects: the temperatures, the curve and the mode
+// decision. The OT dispatch, the operating mode, the display and the HA update need a
+// controller, a display and a monitor of their own, they run in the host build only
+// (BENCHMARK_HOST, tools/bench_host.py) against a fake GFX and MQTT.
+////////////////////////////////////////////////////////////////////////////////////////////
+class Benchmark
+{
+public:
+  struct Result {
+    const char *name;
+    uint32_t    cycles;             // per operation, fastest round
+    uint32_t    ns;                 // per operation, fastest round
+    int32_t     heap;               // bytes not returned after the case
+    int32_t     allocs;             // per operation rounded up, -1 when not counted
+  };
+
+private:
+  HAMqtt   *_mqtt;
+  bool      _requested;
+  Result    _results[BENCHMARK_CASES];
+  uint8_t   _count;
+
+  template<class F> void _measure(const char *name, F op, uint32_t gap=0);
+  void _cases();
+  bool _publish();
+public:
+  Benchmark();
+  static Benchmark *instance();
+
+  uint32_t runs;
+
+  bool begin(HAMqtt *mqtt);
+  bool loop();                      // runs the cases when requested
+  bool run();
+  uint8_t count() const             { return _count; }
+  const Result &result(uint8_t i) const { return _results[i]; }
+  bool subscribe(HAMqtt *mqtt);
+  bool onMessage(const char *topic, const uint8_t *payload, uint16_t length);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
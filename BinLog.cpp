@@ -0,0 +1,120 @@
+#include "BinLog.h"
+#include <HAMqtt.h>
+#include <Clock.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Configuration
+#define BINLOG_TOPIC        "SmartTherm/binlog"
+#define BINLOG_VERSION      1
+#define BINLOG_HEADER_SIZE  12              // 'B' 'L' version count unixtime(4) millis(4)
+#define BINLOG_FLUSH_LEVEL  (BINLOG_BUFFER_SIZE *3/4)
+
+extern Clock rtc;
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+BinLog *_binlog = 0;
+BinLog *BinLog::instance() { return _binlog; }
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The formats are only needed on the device when they are printed here
+////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef LOG_BINARY
+#define BINLOG_STRING(id, fmt)  fmt,
+const char *_binlog_formats[] = { BINLOG_FORMATS(BINLOG_STRING) };
+
+const char *BinLog::format(Id id) {
+  return id < BL_COUNT ? _binlog_formats[id] : "Unknown log format";
+}
+#else
+const char *BinLog::format(Id id) {
+  return "";
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+BinLog::BinLog()
+: _flush_tmr(BINLOG_INTERVAL)
+{
+  _binlog = this;
+  _used = 0;
+  _mqtt = 0;
+  records = dropped = batches = bytes_sent = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool BinLog::begin(HAMqtt *mqtt)
+{
+  _mqtt = mqtt;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// record: id(1) level<<4|argc(1) millis(4) args(4*argc), all little endian like the esp
+////////////////////////////////////////////////////////////////////////////////////////////
+void BinLog::_append(uint8_t level, uint8_t id, const uint32_t *args, uint8_t argc)
+{
+  uint16_t size = 2 + sizeof(uint32_t) + argc * sizeof(uint32_t);
+  if (_used + size > sizeof(_buffer)) {
+    dropped++;
+    return;
+  }
+  uint8_t *rec = _buffer + _used;
+  uint32_t now = millis();
+  rec[0] = id;
+  rec[1] = (level << 4) | argc;
+  memcpy(rec +2, &now, sizeof(now));
+  memcpy(rec +6, args, argc * sizeof(uint32_t));
+  _used += size;
+  records++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool BinLog::loop()
+{
+  if (_flush_tmr || _used >= BINLOG_FLUSH_LEVEL)
+    return flush();
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The batch header holds the wall clock time and millis() of the moment of sending. The
+// host uses these to convert the millis() of each record into a timestamp.
+////////////////////////////////////////////////////////////////////////////////////////////
+bool BinLog::flush()
+{
+  if (_used == 0 || _mqtt == 0 || !_mqtt->isConnected())
+    return false;   // keep buffering until we are connected
+
+  uint8_t header[BINLOG_HEADER_SIZE];
+  uint32_t unixtime = rtc.now().unixtime();
+  uint32_t now = millis();
+  header[0] = 'B';
+  header[1] = 'L';
+  header[2] = BINLOG_VERSION;
+  header[3] = 0;    // reserved
+  memcpy(header +4, &unixtime, sizeof(unixtime));
+  memcpy(header +8, &now, sizeof(now));
+
+  uint16_t length = sizeof(header) + _used;
+  if (!_mqtt->beginPublish(BINLOG_TOPIC, length, false))
+    return false;
+  _mqtt->writePayload(header, sizeof(header));
+  _mqtt->writePayload(_buffer, _used);
+  if (!_mqtt->endPublish())
+    return false;
+
+  batches++;
+  bytes_sent += length;
+  _used = 0;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Timer.h>
+
+class HAMqtt;
+
+#define LOG_BINARY      // comment out to format the structured logging on the device
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Structured logging
+// With LOG_BINARY defined a record only holds the id of the format, a timestamp and the raw
+// 32 bit arguments. No formatting is done on the device, the records are send in batches
+// over MQTT and tools/binlog_decode.py turns them back into text using the table below.
+// Arguments are stored as 32 bits: %f as float, all others as (unsigned) int. No %s !
+// Without LOG_BINARY the same formats are printed through the normal INFO/DEBUG logging.
+//
+// NOTE: only append new formats at the end, the position in this list is the id
+////////////////////////////////////////////////////////////////////////////////////////////
+#define BINLOG_FORMATS(X) \
+  X(OT_MESSAGE,       "%3d = T:%u, data %04X -> B:%u, data %0.4f") \
+  X(OT_FLAGS,         "Flags F:%d CH:%d DHW:%d Flame:%d Cool:%d CH2:%d Diag:%d") \
+  X(OT_ANALYSIS,      "T/trend >>> TRoom= %0.1f/%0.1f, TOutside= %0.1f/%0.1f, TSet= %0.1f/%0.1f, Ta= %0.1f/%0.1f, Tret= %0.1f/%0.1f") \
+  X(COOLING_ON,       "Switch ON Cooling, as Tinside %0.2f and Toutside %0.2f are above 25 degrees") \
+  X(COOLING_OFF,      "Switch OFF Cooling, as Tinside %0.2f reached below 25 degrees") \
+  X(HEATING_ON,       "Switch ON Heating, Tinside error (%0.1f) < 2x trend-TSet (%0.1f)") \
+  X(HEATING_NOT,      "No need for heating: inside error (%0.1f) is above 2x trend-TSet (%0.1f)") \
+  X(HEATING_OFF,      "Switching off Heatpump, as Tset %0.2f reached below Tr %0.2f") \
+  X(CURVE_INPUT,      "roomcur:%.2f, roomset:%.2f, outside:%.2f, deltaT-out:%.2f, deltaT-in:%.2f") \
+  X(CURVE_SETPOINT,   "Set point using factor:%.5f, setpoint:%.2f") \
+  X(CURVE_FACTOR_A,   "Changed heatingcurve factorA from %0.2f to %0.2f") \
+  X(CURVE_FACTOR_B,   "Changed heatingcurve factorB from %0.2f to %0.2f") \
+  X(CURVE_FACTOR_C,   "Changed heatingcurve factorC from %0.2f to %0.2f") \
+  X(TEMP_THRESHOLD,   "Temp exceeding threshold of %.3f C/s (change is %.3f C/s)") \
+  X(TEMP_SPIKE,       "SPIKE detected!!! value %.2f") \
+  X(CURVE_SOLAR,      "Solar feed forward %.2f, setpoint lowered %.2f")
+
+#define BINLOG_ENUM(id, fmt)    BL_##id,
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Use these instead of INFO/DEBUG in the hot paths, the level check is done at compile time.
+// Records before the BinLog is constructed (or without one) are not logged.
+////////////////////////////////////////////////////////////////////////////////////////////
+#ifdef LOG_BINARY
+#define BLOG_LOG(level, id, ...)  do { BinLog *blog_ = BinLog::instance(); \
+                                       if (LOG_LEVEL >= level && blog_) blog_->log(level, BinLog::BL_##id, ##__VA_ARGS__); } while (0)
+#define BLOG_ERROR(id, ...)  BLOG_LOG(1, id, ##__VA_ARGS__)
+#define BLOG_INFO(id, ...)   BLOG_LOG(2, id, ##__VA_ARGS__)
+#define BLOG_DEBUG(id, ...)  BLOG_LOG(3, id, ##__VA_ARGS__)
+#else
+#define BLOG_ERROR(id, ...)  ERROR(BinLog::format(BinLog::BL_##id), ##__VA_ARGS__)
+#define BLOG_INFO(id, ...)   INFO(BinLog::format(BinLog::BL_##id), ##__VA_ARGS__)
+#define BLOG_DEBUG(id, ...)  DEBUG(BinLog::format(BinLog::BL_##id), ##__VA_ARGS__)
+#endif
+
+#define BINLOG_BUFFER_SIZE  1024        // bytes of records kept between two batches
+#define BINLOG_MAX_ARGS     10          // maximum number of arguments of a record
+#define BINLOG_INTERVAL     (10*1000)   // send a batch at least each 10 seconds
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+class BinLog
+{
+public:
+  enum Id : uint8_t { BINLOG_FORMATS(BINLOG_ENUM) BL_COUNT };
+
+private:
+  uint8_t   _buffer[BINLOG_BUFFER_SIZE];
+  uint16_t  _used;
+  HAMqtt   *_mqtt;
+  Periodic  _flush_tmr;
+
+  void _append(uint8_t level, uint8_t id, const uint32_t *args, uint8_t argc);
+  static uint32_t _raw(float v)   { uint32_t r; memcpy(&r, &v, sizeof(r)); return r; }
+  static uint32_t _raw(double v)  { return _raw((float) v); }
+  template<typename T>
+  static uint32_t _raw(T v)       { return (uint32_t) v; }   // integers, bools and enums
+public:
+  BinLog();
+  static BinLog *instance();
+  static const char *format(Id id); // only available without LOG_BINARY
+
+  uint32_t records;                 // number of records logged
+  uint32_t dropped;                 // number of records lost due to a full buffer
+  uint32_t batches;                 // number of batches send
+  uint32_t bytes_sent;              // payload bytes send
+
+  bool begin(HAMqtt *mqtt);
+  bool loop();                      // send a batch when due
+  bool flush();                     // send a batch now
+
+  template<typename... Args>
+  void log(uint8_t level, Id id, Args... args)
+  {
+    static_assert(sizeof...(Args) <= BINLOG_MAX_ARGS, "too many binlog arguments");
+    const uint32_t raw[] = { _raw(args)..., 0 };
+    _append(level, id, raw, sizeof...(Args));
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -1,44 +1,192 @@
 #include "SmartControl.h"
-#include <EEPROM.h>
+#include "ConfigStore.h"
+#include "NtpSync.h"
+#include "Energy.h"
+#include <Clock.h>
+#include <Timer.h>
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
 
-const uint32_t MAGIC_NUMBER = 0xDEADBEEF; // Example magic number
+#define CONFIG_VERSION    3             // increase when ConfigData changes
+#define SNAPSHOT_VERSION  1             // increase when TemperatureSnapshot changes
+#define SNAPSHOT_INTERVAL (10*60*1000)  // checkpoint each 10 minutes, 8 sectors last > 10 years
+#define SNAPSHOT_MAX_AGE  (30*60)       // seconds, an older snapshot is not restored
+
+extern Clock rtc;
+
+#define WORDS(type)   ((sizeof(type) + 3) / 4)
+
+uint32_t    config_data[WORDS(ConfigData)];
+EspFlash    config_flash(FLASH_CONFIG);
+ConfigStore config_store(config_flash, CONFIG_VERSION, sizeof(ConfigData), config_data);
+
+uint32_t    snapshot_data[WORDS(TemperatureSnapshot)];
+EspFlash    snapshot_flash(FLASH_SNAPSHOT);
+ConfigStore snapshot_store(snapshot_flash, SNAPSHOT_VERSION, sizeof(TemperatureSnapshot), snapshot_data);
+Periodic    snapshot_interval(SNAPSHOT_INTERVAL);
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
 ////////////////////////////////////////////////////////////////////////////////////////////
-/*void SmartControl::config_begin()
+void SmartControl::_config_get(ConfigData &data)
+{
+  memset(&data, 0, sizeof(data));   // no random padding, it is compared and stored
+  data.factorA = heating_curve.factorA();
+  data.factorB = heating_curve.factorB();
+  data.factorC = heating_curve.factorC();
+  data.target  = target.get();
+  data.flags   = operating_flags;
+  data.flow    = Energy::instance() ? Energy::instance()->flow : ENERGY_FLOW;
+  data.solar_gain = solar.gain;
+}
+
+void SmartControl::_config_set(const ConfigData &data)
+{
+  heating_curve.factorA(data.factorA);
+  heating_curve.factorB(data.factorB);
+  heating_curve.factorC(data.factorC);
+  target.set(data.target);
+  operating_flags = data.flags;
+  if (Energy::instance() && data.flow > 0.0f)
+    Energy::instance()->flow = data.flow;
+  solar.gain = data.solar_gain;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The current values are the defaults for what is not in flash (yet)
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SmartControl::config_begin()
 {
+  ConfigData data;
+  _config_get(data);
 
+  switch (config_store.load(&data))
+  {
+  case ConfigStore::Empty:
+    INFO("Config: nothing stored yet, using the defaults");
+    config_store.set(&data, millis());
+    return true;
+  case ConfigStore::TooLarge:
+    ERROR("Config: does not fit in a flash sector");
+    return false;
+  case ConfigStore::FlashError:
+    ERROR("Config: its sectors are not within the filesystem area, using the defaults");
+    return false;
+  case ConfigStore::Upgraded:
+    INFO("Config: upgraded to version %d", CONFIG_VERSION);
+    config_store.set(&data, millis(), true);    // the same data, but in the new version
+    if (config_store.commit() != ConfigStore::Ok)
+      ERROR("Config: could not write the upgraded record");
+    break;
+  default:
+    break;
+  }
+  _config_set(data);
+  INFO("Config: loaded record %u from sector %d, target %0.1f, factors %0.2f %0.2f %0.2f",
+    config_store.sequence(), config_store.sector(), data.target, data.factorA, data.factorB, data.factorC);
+  return true;
 }
 
-void SmartControl::config_write()
+////////////////////////////////////////////////////////////////////////////////////////////
+// Cheap enough to call each second, it only writes after the changes settled
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SmartControl::config_loop()
 {
-void setup() {
-  EEPROM.begin(sizeof(PersistentData));
-  PersistentData data;
+  if (!_restored)
+    restore();
+  else if (snapshot_interval)
+    snapshot();
 
-  // Load data from EEPROM
-  EEPROM.get(0, data);
+  ConfigData data;
+  _config_get(data);
+  config_store.set(&data, millis());
+  if (!config_store.due(millis()))
+    return false;
 
-  // Validate the magic number
-  if (data.magicNumber != MAGIC_NUMBER) {
-    Serial.println("Invalid data, initializing defaults.");
-    data = {MAGIC_NUMBER, 0.0, 0.0, 0.0, 0.0, false, false, false, false};
+  if (config_store.commit() != ConfigStore::Ok) {
+    ERROR("Config: could not write to flash (%u failures)", config_store.failures);
+    return false;
   }
+  INFO("Config: stored record %u in sector %d slot %d (%u changes merged)",
+    config_store.sequence(), config_store.sector(), config_store.slot() -1, config_store.coalesced);
+  return true;
+}
 
-  // Save the data back to EEPROM if it was invalid
-  EEPROM.put(0, data);
-  EEPROM.commit();
+////////////////////////////////////////////////////////////////////////////////////////////
+// The pending changes are not delayed when a reboot follows
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SmartControl::config_flush()
+{
+  ConfigData data;
+  _config_get(data);
+  config_store.set(&data, millis());
+  if (!config_store.dirty())
+    return false;
+  if (config_store.commit() != ConfigStore::Ok) {
+    ERROR("Config: could not write to flash (%u failures)", config_store.failures);
+    return false;
+  }
+  INFO("Config: stored record %u before the reboot", config_store.sequence());
+  return true;
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Only with a valid time, else the age of the snapshot is unknown. And not before the
+// store has been loaded, which finds the position in the journal.
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SmartControl::snapshot()
+{
+  if (!_restored)
+    return false;
+
+  TemperatureSnapshot s;
+  s.time = rtc.now().unixtime();
+  inside.snapshot(s.inside);
+  outside.snapshot(s.outside);
+  setpoint.snapshot(s.setpoint);
+  inlet.snapshot(s.inlet);
+  outlet.snapshot(s.outlet);
+
+  snapshot_store.set(&s, millis());
+  if (snapshot_store.commit() != ConfigStore::Ok) {
+    ERROR("Snapshot: could not write to flash (%u failures)", snapshot_store.failures);
+    return false;
+  }
+  DEBUG("Snapshot: stored record %u in sector %d", snapshot_store.sequence(), snapshot_store.sector());
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
-//
+// Waits for the clock, then restores the statistics when the snapshot is recent enough
 ////////////////////////////////////////////////////////////////////////////////////////////
-void SmartControl::config_read()
+bool SmartControl::restore()
 {
+  NtpSync *ntp = NtpSync::instance();
+  if (ntp == NULL || !ntp->synced())
+    return false;
+  _restored = true;
 
+  TemperatureSnapshot s;
+  memset(&s, 0, sizeof(s));
+  if (snapshot_store.load(&s) != ConfigStore::Ok) {
+    INFO("Snapshot: none available, cold start");
+    return false;
+  }
+  uint32_t now = rtc.now().unixtime();
+  uint32_t age = now - s.time;
+  if (s.time > now || age > SNAPSHOT_MAX_AGE) {
+    INFO("Snapshot: %u sec old, cold start", age);
+    return false;
+  }
+  inside.restore(s.inside, age * 1000);
+  outside.restore(s.outside, age * 1000);
+  setpoint.restore(s.setpoint, age * 1000);
+  inlet.restore(s.inlet, age * 1000);
+  outlet.restore(s.outlet, age * 1000);
+  INFO("Snapshot: restored the statistics of %u sec ago, inside %s trend %0.2f", age, inside.toString(2), inside.trend());
+  return true;
 }
-*/
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////
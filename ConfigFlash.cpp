@@ -0,0 +1,177 @@
+#include "ConfigFlash.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <flash_hal.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+EspFlash::EspFlash(uint16_t first, uint16_t count)
+{
+  _first = (FS_PHYS_ADDR) / FLASH_SECTOR_SIZE + first;
+  _count = count;
+  if ((uint32_t) (first + count) * FLASH_SECTOR_SIZE > (uint32_t) (FS_PHYS_SIZE))
+    _count = 0;     // not within the filesystem, every access is refused
+}
+
+uint32_t EspFlash::sector_size() const {
+  return FLASH_SECTOR_SIZE;
+}
+
+bool EspFlash::read(uint16_t sector, uint32_t offset, uint32_t *data, uint32_t size)
+{
+  if (sector >= _count || offset + size > FLASH_SECTOR_SIZE)
+    return false;
+  return ESP.flashRead((_first + sector) * FLASH_SECTOR_SIZE + offset, data, size);
+}
+
+bool EspFlash::write(uint16_t sector, uint32_t offset, const uint32_t *data, uint32_t size)
+{
+  if (sector >= _count || offset + size > FLASH_SECTOR_SIZE)
+    return false;
+  return ESP.flashWrite((_first + sector) * FLASH_SECTOR_SIZE + offset, data, size);
+}
+
+bool EspFlash::erase(uint16_t sector)
+{
+  if (sector >= _count)
+    return false;
+  return ESP.flashEraseSector(_first + sector);
+}
+
+#else
+#include <string.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// A new file starts erased
+////////////////////////////////////////////////////////////////////////////////////////////
+FileFlash::FileFlash(const char *path, uint16_t count, uint32_t sector_size)
+{
+  _count = count < FILE_FLASH_MAX_SECTORS ? count : FILE_FLASH_MAX_SECTORS;
+  _size = sector_size;
+  _power = -1;
+  writes = 0;
+  memset(erases, 0, sizeof(erases));
+
+  _file = fopen(path, "r+b");
+  if (_file == NULL) {
+    _file = fopen(path, "w+b");
+    for (uint16_t s=0; _file && s<_count; s++) {
+      erase(s);
+      erases[s] = 0;
+    }
+  }
+}
+
+FileFlash::~FileFlash()
+{
+  if (_file)
+    fclose(_file);
+}
+
+bool FileFlash::read(uint16_t sector, uint32_t offset, uint32_t *data, uint32_t size)
+{
+  if (_file == NULL || sector >= _count || offset + size > _size)
+    return false;
+  fseek(_file, (long) sector * _size + offset, SEEK_SET);
+  return fread(data, 1, size, _file) == size;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// word by word, so a power cut leaves a partly written record like the real flash would
+////////////////////////////////////////////////////////////////////////////////////////////
+bool FileFlash::write(uint16_t sector, uint32_t offset, const uint32_t *data, uint32_t size)
+{
+  if (_file == NULL || sector >= _count || offset + size > _size || (offset | size) & 3)
+    return false;
+  for (uint32_t i=0; i<size/4; i++)
+  {
+    if (_power == 0)
+      return false;
+    uint32_t word;
+    long pos = (long) sector * _size + offset + i*4;
+    fseek(_file, pos, SEEK_SET);
+    if (fread(&word, 1, 4, _file) != 4)
+      return false;
+    word &= data[i];          // only clears bits
+    fseek(_file, pos, SEEK_SET);
+    fwrite(&word, 1, 4, _file);
+    writes += 4;
+    if (_power > 0)
+      _power = _power > 4 ? _power - 4 : 0;
+  }
+  fflush(_file);
+  return true;
+}
+
+bool FileFlash::erase(uint16_t sector)
+{
+  if (_file == NULL || sector >= _count || _power == 0)
+    return false;
+  uint8_t ff[256];
+  memset(ff, 0xFF, sizeof(ff));
+  fseek(_file, (long) sector * _size, SEEK_SET);
+  for (uint32_t done=0; done<_size; done+=sizeof(ff))
+    fwrite(ff, 1, sizeof(ff), _file);
+  fflush(_file);
+  erases[sector]++;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// A new ram flash starts erased
+////////////////////////////////////////////////////////////////////////////////////////////
+RamFlash::RamFlash(uint16_t count, uint32_t sector_size)
+{
+  _count = count < FILE_FLASH_MAX_SECTORS ? count : FILE_FLASH_MAX_SECTORS;
+  _size = sector_size;
+  _power = -1;
+  writes = 0;
+  memset(erases, 0, sizeof(erases));
+  _mem = new uint8_t[(size_t) _count * _size];
+  memset(_mem, 0xFF, (size_t) _count * _size);
+}
+
+RamFlash::~RamFlash()
+{
+  delete[] _mem;
+}
+
+bool RamFlash::read(uint16_t sector, uint32_t offset, uint32_t *data, uint32_t size)
+{
+  if (sector >= _count || offset + size > _size)
+    return false;
+  memcpy(data, _mem + (size_t) sector * _size + offset, size);
+  return true;
+}
+
+bool RamFlash::write(uint16_t sector, uint32_t offset, const uint32_t *data, uint32_t size)
+{
+  if (sector >= _count || offset + size > _size || (offset | size) & 3)
+    return false;
+  uint32_t *words = (uint32_t *) (_mem + (size_t) sector * _size + offset);
+  for (uint32_t i=0; i<size/4; i++)
+  {
+    if (_power == 0)
+      return false;
+    words[i] &= data[i];      // only clears bits
+    writes += 4;
+    if (_power > 0)
+      _power = _power > 4 ? _power - 4 : 0;
+  }
+  return true;
+}
+
+bool RamFlash::erase(uint16_t sector)
+{
+  if (sector >= _count || _power == 0)
+    return false;
+  memset(_mem + (size_t) sector * _size, 0xFF, _size);
+  erases[sector]++;
+  return true;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Flash as seen by the ConfigStore: sectors that are erased to 0xFF as a whole and written
+// in 32 bit aligned words, where a write can only clear bits (NOR flash).
+////////////////////////////////////////////////////////////////////////////////////////////
+class ConfigFlash
+{
+public:
+  virtual uint16_t sectors() const = 0;
+  virtual uint32_t sector_size() const = 0;
+  virtual bool read(uint16_t sector, uint32_t offset, uint32_t *data, uint32_t size) = 0;
+  virtual bool write(uint16_t sector, uint32_t offset, const uint32_t *data, uint32_t size) = 0;
+  virtual bool erase(uint16_t sector) = 0;
+};
+
+#ifdef ARDUINO
+// Layout of the filesystem area: first sector and number of sectors of each store
+#define FLASH_CONFIG      0, 4      // settings (Config.cpp)
+#define FLASH_SNAPSHOT    4, 8      // temperature statistics (Config.cpp)
+#define FLASH_HISTORY     12, 16    // hourly history (History.cpp)
+#define FLASH_SENSORS     28, 2     // DS18B20 labels and calibration (SensorBus.cpp)
+#define FLASH_ZONES       30, 2     // rooms, their source, weight and target (Zones.cpp)
+#define FLASH_ENERGY      32, 2     // kWh totals, each hour (Energy.cpp)
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Sectors of the filesystem area, which this sketch does not use otherwise. Use a flash
+// layout with a filesystem large enough for all stores, a store which does not fit gets no
+// sectors at all and its ConfigStore returns FlashError.
+////////////////////////////////////////////////////////////////////////////////////////////
+class EspFlash : public ConfigFlash
+{
+private:
+  uint32_t _first;      // first sector number
+  uint16_t _count;
+public:
+  EspFlash(uint16_t first, uint16_t count);   // first sector within the filesystem area
+  uint16_t sectors() const override     { return _count; }
+  uint32_t sector_size() const override;
+  bool read(uint16_t sector, uint32_t offset, uint32_t *data, uint32_t size) override;
+  bool write(uint16_t sector, uint32_t offset, const uint32_t *data, uint32_t size) override;
+  bool erase(uint16_t sector) override;
+};
+
+#else
+////////////////////////////////////////////////////////////////////////////////////////////
+// Flash in a file, to run the ConfigStore on a linux host. Keeps the NOR semantics, counts
+// the erases per sector (wear) and can cut the power in the middle of a write.
+////////////////////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+
+#define FILE_FLASH_MAX_SECTORS  16
+
+class FileFlash : public ConfigFlash
+{
+private:
+  FILE     *_file;
+  uint16_t  _count;
+  uint32_t  _size;
+  int32_t   _power;           // bytes until the power is cut, -1 for never
+public:
+  FileFlash(const char *path, uint16_t count, uint32_t sector_size = 4096);
+  ~FileFlash();
+
+  uint32_t erases[FILE_FLASH_MAX_SECTORS];
+  uint32_t writes;            // bytes written
+
+  void power_cut(int32_t after) { _power = after; }   // bytes still written, -1 to restore
+  bool powered() const          { return _power != 0; }
+
+  uint16_t sectors() const override     { return _count; }
+  uint32_t sector_size() const override { return _size; }
+  bool read(uint16_t sector, uint32_t offset, uint32_t *data, uint32_t size) override;
+  bool write(uint16_t sector, uint32_t offset, const uint32_t *data, uint32_t size) override;
+  bool erase(uint16_t sector) override;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Flash in ram with the same semantics, for the host test (tools/config_store_test.cpp)
+////////////////////////////////////////////////////////////////////////////////////////////
+class RamFlash : public ConfigFlash
+{
+private:
+  uint8_t  *_mem;
+  uint16_t  _count;
+  uint32_t  _size;
+  int32_t   _power;           // bytes until the power is cut, -1 for never
+public:
+  RamFlash(uint16_t count, uint32_t sector_size = 4096);
+  ~RamFlash();
+
+  uint32_t erases[FILE_FLASH_MAX_SECTORS];
+  uint32_t writes;            // bytes written
+
+  void power_cut(int32_t after) { _power = after; }   // bytes still written, -1 to restore
+  bool powered() const          { return _power != 0; }
+
+  uint16_t sectors() const override     { return _count; }
+  uint32_t sector_size() const override { return _size; }
+  bool read(uint16_t sector, uint32_t offset, uint32_t *data, uint32_t size) override;
+  bool write(uint16_t sector, uint32_t offset, const uint32_t *data, uint32_t size) override;
+  bool erase(uint16_t sector) override;
+};
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
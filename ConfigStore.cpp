@@ -0,0 +1,293 @@
+#include "ConfigStore.h"
+#include <string.h>
+
+#define CONFIG_SECTOR_MAGIC   0x53544346UL  // "FCTS"
+#define CONFIG_RECORD_MAGIC   0xA5
+#define CONFIG_SECTOR_HEADER  16            // magic, generation, ~generation, reserved
+#define CONFIG_CHUNK          32            // bytes read at once
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// CRC-32 (IEEE) without a table, a few records at boot do not need the speed
+////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t ConfigStore::crc32(const void *data, uint32_t size, uint32_t crc)
+{
+  const uint8_t *p = (const uint8_t *) data;
+  crc = ~crc;
+  while (size--) {
+    crc ^= *p++;
+    for (uint8_t bit=0; bit<8; bit++)
+      crc = (crc >> 1) ^ (0xEDB88320UL & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static uint32_t header_crc(const ConfigStore::Record &r)
+{
+  uint32_t crc = ConfigStore::crc32(&r.sequence, sizeof(r.sequence));
+  crc = ConfigStore::crc32(&r.version, sizeof(r.version), crc);
+  return ConfigStore::crc32(&r.size, sizeof(r.size), crc);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+ConfigStore::ConfigStore(ConfigFlash &flash, uint8_t version, uint16_t size, uint32_t *buffer)
+: _flash(flash)
+{
+  _version = version;
+  _size = size;
+  _data = buffer;
+  _slot_size = (sizeof(Record) + size + 3) & ~3;
+  _slots = (flash.sector_size() - CONFIG_SECTOR_HEADER) / _slot_size;
+  _sector = 0;
+  _next = _slots;         // no active sector yet, the first commit starts one
+  _generation = 0;
+  _sequence = 0;
+  _dirty = false;
+  _first_change = _last_change = 0;
+  commits = coalesced = failures = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t ConfigStore::_offset(uint16_t slot) const
+{
+  return CONFIG_SECTOR_HEADER + (uint32_t) slot * _slot_size;
+}
+
+bool ConfigStore::_sectorHeader(uint16_t sector, uint32_t &generation)
+{
+  uint32_t header[CONFIG_SECTOR_HEADER / 4];
+  if (!_flash.read(sector, 0, header, sizeof(header)))
+    return false;
+  generation = header[1];
+  return header[0] == CONFIG_SECTOR_MAGIC && header[2] == ~header[1];
+}
+
+bool ConfigStore::_erased(uint16_t sector, uint16_t slot)
+{
+  uint32_t word;
+  if (!_flash.read(sector, _offset(slot), &word, sizeof(word)))
+    return false;
+  return word == 0xFFFFFFFFUL;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// CRC of the record in flash, chunk by chunk, optionally copying the data
+////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t ConfigStore::_crc(uint16_t sector, uint16_t slot, const Record &r, uint32_t *into)
+{
+  uint32_t chunk[CONFIG_CHUNK / 4];
+  uint32_t crc = header_crc(r);
+  uint32_t offset = _offset(slot) + sizeof(Record);
+  for (uint16_t done=0; done < r.size; done += CONFIG_CHUNK)
+  {
+    uint16_t n = r.size - done < CONFIG_CHUNK ? r.size - done : CONFIG_CHUNK;
+    if (!_flash.read(sector, offset + done, chunk, (n + 3) & ~3))
+      return ~r.crc;
+    crc = crc32(chunk, n, crc);
+    if (into && done < _size)
+      memcpy((uint8_t *) into + done, chunk, n < _size - done ? n : _size - done);
+  }
+  return crc;
+}
+
+bool ConfigStore::_readSlot(uint16_t sector, uint16_t slot, Record &r)
+{
+  if (!_flash.read(sector, _offset(slot), (uint32_t *) &r, sizeof(r)))
+    return false;
+  if (r.magic != CONFIG_RECORD_MAGIC || sizeof(Record) + r.size > _flash.sector_size() - CONFIG_SECTOR_HEADER)
+    return false;
+  return _crc(sector, slot, r, NULL) == r.crc;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Binary search for the first erased slot (next), then back to the last valid record.
+// Returns its slot, -1 when the sector has none.
+////////////////////////////////////////////////////////////////////////////////////////////
+int16_t ConfigStore::_last(uint16_t sector, uint16_t &next, Record &r)
+{
+  uint16_t lo = 0, hi = _slots;
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    if (_erased(sector, mid))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  next = lo;
+  for (int16_t slot = (int16_t) lo - 1; slot >= 0; slot--)
+    if (_readSlot(sector, slot, r))
+      return slot;
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The newest sector is the active one, when it holds no valid record (torn while starting
+// it) the sector before it is used
+////////////////////////////////////////////////////////////////////////////////////////////
+ConfigStore::Status ConfigStore::load(void *data)
+{
+  if (_slots == 0)
+    return TooLarge;
+  if (_flash.sectors() == 0)
+    return FlashError;
+
+  int32_t newest = -1, previous = -1;
+  uint32_t newest_gen = 0, previous_gen = 0;
+  for (uint16_t s=0; s<_flash.sectors(); s++)
+  {
+    uint32_t gen;
+    if (!_sectorHeader(s, gen))
+      continue;
+    if (newest < 0 || gen > newest_gen) {
+      previous = newest; previous_gen = newest_gen;
+      newest = s; newest_gen = gen;
+    }
+    else if (previous < 0 || gen > previous_gen) {
+      previous = s; previous_gen = gen;
+    }
+  }
+  memcpy(_data, data, _size);   // the defaults, also for fields an older version did not have
+  if (newest < 0)
+    return Empty;   // a new or erased flash
+
+  _sector = newest;
+  _generation = newest_gen;
+
+  Record r;
+  uint16_t next;
+  uint16_t sector = newest;
+  int16_t slot = _last(newest, _next, r);
+  if (slot < 0 && previous >= 0)
+    slot = _last(sector = previous, next, r);
+  if (slot < 0)
+    return Empty;
+
+  _sequence = r.sequence;
+  _crc(sector, slot, r, _data);   // older versions only appended fields
+  memcpy(data, _data, _size);
+  return r.version == _version ? Ok : Upgraded;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Changes within CONFIG_COMMIT_DELAY of each other are merged into one commit
+////////////////////////////////////////////////////////////////////////////////////////////
+bool ConfigStore::set(const void *data, uint32_t now, bool force)
+{
+  if (!force && memcmp(_data, data, _size) == 0)
+    return false;
+  memcpy(_data, data, _size);
+  if (_dirty)
+    coalesced++;
+  else
+    _first_change = now;
+  _last_change = now;
+  _dirty = true;
+  return true;
+}
+
+bool ConfigStore::due(uint32_t now) const
+{
+  if (!_dirty)
+    return false;
+  return now - _last_change >= CONFIG_COMMIT_DELAY || now - _first_change >= CONFIG_COMMIT_MAX;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Erase the next sector of the ring and make it the active one
+////////////////////////////////////////////////////////////////////////////////////////////
+bool ConfigStore::_start(uint16_t sector, uint32_t generation)
+{
+  uint32_t header[CONFIG_SECTOR_HEADER / 4] = { CONFIG_SECTOR_MAGIC, generation, ~generation, 0xFFFFFFFFUL };
+  if (!_flash.erase(sector) || !_flash.write(sector, 0, header, sizeof(header)))
+    return false;
+  _sector = sector;
+  _generation = generation;
+  _next = 0;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The data in flash must match the ram copy
+////////////////////////////////////////////////////////////////////////////////////////////
+bool ConfigStore::_verify(uint16_t sector, uint16_t slot, const Record &r)
+{
+  Record check;
+  if (!_readSlot(sector, slot, check) || check.sequence != r.sequence)
+    return false;
+
+  uint32_t chunk[CONFIG_CHUNK / 4];
+  uint32_t offset = _offset(slot) + sizeof(Record);
+  for (uint16_t done=0; done < _size; done += CONFIG_CHUNK)
+  {
+    uint16_t n = _size - done < CONFIG_CHUNK ? _size - done : CONFIG_CHUNK;
+    if (!_flash.read(sector, offset + done, chunk, (n + 3) & ~3) || memcmp(chunk, (uint8_t *) _data + done, n) != 0)
+      return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Append a record, the header first so a torn write fails the CRC. A slot that does not
+// verify is skipped.
+////////////////////////////////////////////////////////////////////////////////////////////
+ConfigStore::Status ConfigStore::commit()
+{
+  if (!_dirty)
+    return Unchanged;
+  if (_flash.sectors() == 0)
+    return FlashError;
+
+  Record r;
+  r.magic = CONFIG_RECORD_MAGIC;
+  r.version = _version;
+  r.size = _size;
+  r.sequence = _sequence + 1;
+  r.crc = crc32(_data, _size, header_crc(r));
+
+  for (uint8_t attempt=0; attempt<3; attempt++)
+  {
+    if (_next >= _slots && !_start((_sector + 1) % _flash.sectors(), _generation + 1))
+      return FlashError;
+
+    uint16_t slot = _next++;
+    if (_flash.write(_sector, _offset(slot), (const uint32_t *) &r, sizeof(r)) &&
+        _flash.write(_sector, _offset(slot) + sizeof(r), _data, (_size + 3) & ~3) &&
+        _verify(_sector, slot, r))
+    {
+      _sequence++;
+      _dirty = false;
+      commits++;
+      return Ok;
+    }
+    failures++;
+  }
+  return FlashError;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Older records, walking the ring of sectors backwards. The sequence number tells whether
+// the slot holds the expected record (a skipped slot or an erased sector does not).
+////////////////////////////////////////////////////////////////////////////////////////////
+bool ConfigStore::read(uint32_t back, void *data)
+{
+  uint16_t count = _flash.sectors();
+  if (_sequence == 0 || back >= _sequence || back >= (uint32_t) count * _slots)
+    return false;
+
+  int32_t slot = (int32_t) _next - 1 - back;
+  uint16_t sector = _sector;
+  while (slot < 0) {
+    sector = (sector + count - 1) % count;
+    slot += _slots;
+  }
+  Record r;
+  if (!_readSlot(sector, slot, r) || r.sequence != _sequence - back)
+    return false;
+  return _crc(sector, slot, r, (uint32_t *) data) == r.crc;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
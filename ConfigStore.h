@@ -0,0 +1,81 @@
+#pragma once
+
+#include "ConfigFlash.h"
+
+#define CONFIG_COMMIT_DELAY   (30*1000UL)   // commit 30 seconds after the last change ...
+#define CONFIG_COMMIT_MAX     (5*60*1000UL) // ... but no later than 5 minutes after the first
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Persistent configuration as a journal of fixed size records over a ring of flash sectors.
+// Each change is appended to the active sector, a sector is only erased when the journal
+// wraps around to it, spreading the wear over all sectors. Each record carries a sequence
+// number and a CRC, a record torn by a power loss fails its CRC and the one before it is
+// used. The records are written back to back, so the last one is found with a binary
+// search for the first erased slot instead of scanning the sector.
+//
+// The store does not know the time or log, it is given millis() and returns a status. This
+// keeps it free of Arduino, so it runs on a linux host with the FileFlash or RamFlash backend
+// (tools/config_store_test.cpp). The data is read and written in small chunks, nothing of
+// the record size is put on the stack.
+////////////////////////////////////////////////////////////////////////////////////////////
+class ConfigStore
+{
+public:
+  enum Status : uint8_t { Ok, Empty, Upgraded, Unchanged, FlashError, TooLarge };
+
+  struct Record {             // header in front of the data
+    uint8_t  magic;
+    uint8_t  version;
+    uint16_t size;
+    uint32_t sequence;
+    uint32_t crc;             // of sequence, version, size and data
+  };
+
+private:
+  ConfigFlash &_flash;
+  uint8_t   _version;
+  uint16_t  _size;            // bytes of the data
+  uint16_t  _slot_size;       // bytes of a record, header included
+  uint16_t  _slots;           // records per sector
+  uint16_t  _sector;          // active sector
+  uint16_t  _next;            // next free slot in the active sector
+  uint32_t  _generation;      // of the active sector
+  uint32_t  _sequence;        // of the last record
+  uint32_t *_data;           // ram copy of the data, owned by the caller
+  bool      _dirty;
+  uint32_t  _first_change;
+  uint32_t  _last_change;
+
+  bool _sectorHeader(uint16_t sector, uint32_t &generation);
+  bool _erased(uint16_t sector, uint16_t slot);
+  uint32_t _offset(uint16_t slot) const;
+  uint32_t _crc(uint16_t sector, uint16_t slot, const Record &r, uint32_t *into);
+  bool _readSlot(uint16_t sector, uint16_t slot, Record &r);
+  bool _verify(uint16_t sector, uint16_t slot, const Record &r);
+  int16_t _last(uint16_t sector, uint16_t &next, Record &r);
+  bool _start(uint16_t sector, uint32_t generation);
+public:
+  // buffer holds size bytes rounded up to whole words
+  ConfigStore(ConfigFlash &flash, uint8_t version, uint16_t size, uint32_t *buffer);
+
+  uint32_t commits;           // records written
+  uint32_t coalesced;         // changes merged into a later commit
+  uint32_t failures;          // records which did not verify
+
+  Status load(void *data);                  // data keeps its defaults when Empty
+  bool set(const void *data, uint32_t now, bool force=false); // true when changed (or forced)
+  bool due(uint32_t now) const;             // a delayed commit is due
+  bool dirty() const                        { return _dirty; }
+  Status commit();
+  bool read(uint32_t back, void *data);     // the record back records before the last one
+
+  uint16_t sector() const                   { return _sector; }
+  uint16_t slot() const                     { return _next; }
+  uint32_t generation() const               { return _generation; }
+  uint32_t sequence() const                 { return _sequence; }
+  uint32_t capacity() const                 { return (uint32_t) _flash.sectors() * _slots; }
+  static uint32_t crc32(const void *data, uint32_t size, uint32_t crc = 0);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,53 @@
+#include "Diagnostics.h"
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+
+// linker symbols of the esp8266 memory map
+extern "C" char _data_start, _data_end, _rodata_start, _rodata_end, _bss_start, _bss_end;
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+Diagnostics *_diagnostics = 0;
+Diagnostics *Diagnostics::instance() { return _diagnostics; }
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+Diagnostics::Diagnostics()
+: _sample(DIAG_INTERVAL), _report(DIAG_REPORT)
+{
+  _diagnostics = this;
+  stack_free = 0;
+  static_data = static_bss = 0;
+}
+
+bool Diagnostics::begin()
+{
+  static_data = (&_data_end - &_data_start) + (&_rodata_end - &_rodata_start);
+  static_bss  = &_bss_end - &_bss_start;
+  heap.sample();
+  stack_free = ESP.getFreeContStack();
+  INFO("Static ram %u bytes data, %u bytes bss, heap free %u", static_data, static_bss, heap.free);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Diagnostics::loop()
+{
+  if (!_sample)
+    return false;
+
+  heap.sample();
+  stack_free = ESP.getFreeContStack();
+
+  if (_report)
+    INFO("Heap free %u (min %u), max block %u (min %u), fragmentation %u%% (max %u%%), stack free %u",
+      heap.free, heap.min_free, heap.max_block, heap.min_block, heap.fragmentation, heap.max_fragmentation, stack_free);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
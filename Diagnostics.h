@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Timer.h>
+#include "Format.h"
+
+#define DIAG_INTERVAL     (60*1000)         // sample each minute
+#define DIAG_REPORT       (10*60*1000)      // and log each 10 minutes
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Runtime memory footprint: heap, largest block, fragmentation and the stack high water
+// mark, published as Home Assistant sensors (see HAOTMonitor.cpp). The static ram per module
+// is reported at build time by tools/ram_report.py, the total is logged at boot.
+////////////////////////////////////////////////////////////////////////////////////////////
+class Diagnostics
+{
+private:
+  Periodic  _sample;
+  Periodic  _report;
+public:
+  Diagnostics();
+  static Diagnostics *instance();
+
+  HeapStats heap;
+  uint32_t  stack_free;       // lowest free stack of the loop since boot
+  uint32_t  static_data;      // .data and .rodata, fixed at build time
+  uint32_t  static_bss;       // .bss
+
+  bool begin();
+  bool loop();
+  bool sampled() const        { return heap.samples > 0; }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
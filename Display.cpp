@@ -1,5 +1,6 @@
 #include "Display.h"
 #include "SmartControl.h"
+#include "Format.h"
 #define LOG_REMOTE
 #define LOG_LEVEL 2
 #include <Logging.h>
@@ -156,13 +157,12 @@ bool Display::update(bool wifi_connected, bool mqtt_connected, int OT_errors)
     case 1:
     {
       DateTime now = rtc.now();
+      char buf[16];
       // date
-      char date[32] = "DDD DD MMM YYYY";
-      _print(ALIGN_LEFT, ROW_DATETIME, NULL, COLOR_DATETIME, now.toString(date), cache_date);
+      _print(ALIGN_LEFT, ROW_DATETIME, NULL, COLOR_DATETIME, fmt_date(buf, sizeof(buf), now), cache_date);
 
       // time
-      char time[32] = "hh:mm";
-      _print(130, ROW_DATETIME, NULL, COLOR_DATETIME, now.toString(time), cache_time);
+      _print(130, ROW_DATETIME, NULL, COLOR_DATETIME, fmt_time(buf, sizeof(buf), now, false), cache_time);
     }
     break;
 // MAIN LINE
@@ -208,8 +208,9 @@ bool Display::update(bool wifi_connected, bool mqtt_connected, int OT_errors)
     {
       // Modulation level
       char tmp[8];
-      sprintf(tmp, "%.1f%%", SmartControl::instance()->ModLvl);
-      _print(ALIGN_LEFT, ROW_STATUS, &FreeSansBold12pt7b, COLOR_LINE3, tmp, cache_modlvl);
+      _print(ALIGN_LEFT, ROW_STATUS, &FreeSansBold12pt7b, COLOR_LINE3, 
+            fmt_percent(tmp, sizeof(tmp), SmartControl::instance()->ModLvl),
+            cache_modlvl);
     }
     break;
     case 9:
@@ -5,6 +5,7 @@
 
 class Display : public Adafruit_ST7735
 {
+friend class Benchmark;
 private:
   void _watchdog();
   bool _print(int16_t x, int y, const GFXfont *font, uint16_t color, const char *value, char *cache);
@@ -0,0 +1,183 @@
+#include "Energy.h"
+#include "SmartControl.h"
+#include "NtpSync.h"
+#include "Format.h"
+#include "ConfigStore.h"
+#include <HAMqtt.h>
+#include <Clock.h>
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+
+extern Clock rtc;
+
+#define ENERGY_VERSION  1
+
+uint32_t    energy_data[(sizeof(EnergyTotals) + 3) / 4];
+EspFlash    energy_flash(FLASH_ENERGY);
+ConfigStore energy_store(energy_flash, ENERGY_VERSION, sizeof(EnergyTotals), energy_data);
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+Energy *_energy = 0;
+Energy *Energy::instance() { return _energy; }
+
+Energy::Energy()
+{
+  _energy = this;
+  _hour.clear();
+  _day.clear();
+  last_hour.clear();
+  last_day.clear();
+  _last_frame = _last_start = _power_time = 0;
+  _running = _started = false;
+  _power = 0.0f;
+  _hour_of_day = _day_of_month = -1;
+  _mqtt = 0;
+  flow = ENERGY_FLOW;
+  heat_total = electric_total = 0.0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Each OpenTherm response, the last values are held since the previous frame
+////////////////////////////////////////////////////////////////////////////////////////////
+void Energy::frame(bool running, float modulation, float flow_temp, float return_temp, bool valid)
+{
+  uint32_t now = millis();
+  if (running && !_running)
+  {
+    if (_started && now - _last_start < ANTIPENDEL_TIMEFRAME) {
+      _hour.short_cycles++;
+      _day.short_cycles++;
+    }
+    _hour.starts++;
+    _day.starts++;
+    _last_start = now;
+    _started = true;
+  }
+  _running = running;
+
+  uint32_t dt = now - _last_frame;
+  bool integrate = _last_frame != 0 && dt < ENERGY_MAX_GAP;
+  _last_frame = now;
+  if (!integrate)
+    return;
+
+  float hours = dt / 3600000.0f;
+  if (running)
+  {
+    _hour.run_hours += hours;
+    _day.run_hours += hours;
+    float load = modulation / 100.0f * hours;
+    _hour.load_hours += load;
+    _day.load_hours += load;
+    if (valid) {      // kW = kg/s * kJ/kgK * K, heating and cooling alike
+      float kwh = flow / 60.0f * ENERGY_WATER_CAPACITY * std::abs(flow_temp - return_temp) * hours;
+      _hour.heat += kwh;
+      _day.heat += kwh;
+      heat_total += kwh;
+    }
+  }
+  if (_power_time != 0 && now - _power_time < ENERGY_POWER_TIMEOUT)
+  {
+    float kwh = _power / 1000.0f * hours;
+    _hour.electric += kwh;
+    _day.electric += kwh;
+    electric_total += kwh;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Energy::begin(HAMqtt *mqtt)
+{
+  _mqtt = mqtt;
+  EnergyTotals t = { 0.0, 0.0 };
+  if (energy_store.load(&t) == ConfigStore::Ok) {
+    heat_total = t.heat;
+    electric_total = t.electric;
+  }
+  INFO("Energy: %0.1f kWh heat, %0.1f kWh electric in total", heat_total, electric_total);
+  return true;
+}
+
+void Energy::_publish(const char *topic, const EnergyBucket &b, uint32_t time)
+{
+  char doc[192], heat[12], electric[12], cop[8], load[8], run[8];
+  snprintf(doc, sizeof(doc),
+    "{\"time\":%u,\"heat\":%s,\"electric\":%s,\"cop\":%s,\"load_hours\":%s,\"run_hours\":%s,\"starts\":%u,\"short_cycles\":%u}",
+    time, fmt_fixed(heat, sizeof(heat), b.heat, 3), fmt_fixed(electric, sizeof(electric), b.electric, 3),
+    fmt_fixed(cop, sizeof(cop), b.cop(), 2), fmt_fixed(load, sizeof(load), b.load_hours, 2),
+    fmt_fixed(run, sizeof(run), b.run_hours, 2), b.starts, b.short_cycles);
+  if (_mqtt == 0 || !_mqtt->publish(topic, doc, true))
+    ERROR("Energy: could not publish %s", topic);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The buckets follow the clock, so nothing rolls before it is synchronized
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Energy::loop()
+{
+  NtpSync *ntp = NtpSync::instance();
+  if (ntp == NULL || !ntp->synced())
+    return false;
+
+  DateTime now = rtc.now();
+  if (_hour_of_day < 0) {
+    _hour_of_day = now.hour();
+    _day_of_month = now.day();
+    return false;
+  }
+  if (now.hour() == _hour_of_day)
+    return false;
+
+  _hour_of_day = now.hour();
+  last_hour = _hour;
+  _hour.clear();
+  _publish(ENERGY_TOPIC "/hour", last_hour, now.unixtime());
+  EnergyTotals t = { heat_total, electric_total };
+  energy_store.set(&t, millis());
+  if (energy_store.commit() != ConfigStore::Ok)
+    ERROR("Energy: could not store the totals in flash");
+
+  if (now.day() != _day_of_month)
+  {
+    _day_of_month = now.day();
+    last_day = _day;
+    _day.clear();
+    _publish(ENERGY_TOPIC "/day", last_day, now.unixtime());
+    INFO("Energy: %0.1f kWh heat, %0.1f kWh electric, %u starts (%u short), %0.1f hours running yesterday",
+      last_day.heat, last_day.electric, last_day.starts, last_day.short_cycles, last_day.run_hours);
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Energy::subscribe(HAMqtt *mqtt)
+{
+  return mqtt->subscribe(ENERGY_TOPIC "/power");
+}
+
+bool Energy::onMessage(const char *topic, const uint8_t *payload, uint16_t length)
+{
+  if (strcmp(topic, ENERGY_TOPIC "/power") != 0)
+    return false;
+
+  char buf[16];
+  if (length >= sizeof(buf))
+    length = sizeof(buf) -1;
+  memcpy(buf, payload, length);
+  buf[length] = '\0';
+  float watt = strtod(buf, NULL);
+  if (watt >= 0.0f) {
+    _power = watt;
+    _power_time = millis();
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Arduino.h>
+
+class HAMqtt;
+
+#define ENERGY_WATER_CAPACITY 4.186f          // kJ per kg per K
+#define ENERGY_FLOW           12.0f           // l/min through the heat exchanger, the default
+#define ENERGY_MAX_GAP        (60*1000)       // ms between two frames, a longer gap is not integrated
+#define ENERGY_POWER_TIMEOUT  (5*60*1000)     // a power reading older than 5 minutes is not used
+#define ENERGY_TOPIC          "SmartTherm/energy"   // power (W, in), hour and day (json, out)
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The figures of an hour or a day
+////////////////////////////////////////////////////////////////////////////////////////////
+struct EnergyBucket
+{
+  float    heat;            // kWh into the water, from flow - return and the flow rate
+  float    electric;        // kWh from the power meter, 0 without one
+  float    load_hours;      // modulation integrated, hours at full load
+  float    run_hours;       // compressor running
+  uint16_t starts;
+  uint16_t short_cycles;    // a start within ANTIPENDEL_TIMEFRAME of the previous start
+
+  void clear()              { memset(this, 0, sizeof(*this)); }
+  float cop() const         { return electric > 0.0f ? heat / electric : 0.0f; }
+};
+
+// What is stored each hour, in flash (FLASH_ENERGY)
+struct EnergyTotals
+{
+  double   heat;
+  double   electric;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Integrates each OpenTherm response into the current hour and day, in constant time and
+// fixed memory. The electrical input comes from an external power meter publishing watts on
+// ENERGY_TOPIC/power, without it there is no COP. Each completed hour and day is published
+// as json on ENERGY_TOPIC/hour and ENERGY_TOPIC/day. The totals are stored with each hour,
+// after a reset they go on from there and lose at most the hour that was not stored.
+////////////////////////////////////////////////////////////////////////////////////////////
+class Energy
+{
+private:
+  EnergyBucket _hour, _day;
+  uint32_t  _last_frame;      // millis of the last integration, 0 for none
+  uint32_t  _last_start;      // millis of the last compressor start
+  bool      _running;
+  bool      _started;         // a start has been seen since boot
+  float     _power;           // W, last reading of the power meter
+  uint32_t  _power_time;
+  int8_t    _hour_of_day;     // -1 until the clock is synchronized
+  int8_t    _day_of_month;
+  HAMqtt   *_mqtt;
+
+  void _publish(const char *topic, const EnergyBucket &b, uint32_t time);
+public:
+  Energy();
+  static Energy *instance();
+
+  float         flow;         // l/min
+  double        heat_total;   // kWh, for the Home Assistant energy dashboard
+  double        electric_total;
+  EnergyBucket  last_hour;
+  EnergyBucket  last_day;
+
+  const EnergyBucket &hour() const      { return _hour; }
+  const EnergyBucket &today() const     { return _day; }
+
+  void frame(bool running, float modulation, float flow_temp, float return_temp, bool valid);
+  bool begin(HAMqtt *mqtt);
+  bool loop();              // rolls the hour and the day
+  bool subscribe(HAMqtt *mqtt);
+  bool onMessage(const char *topic, const uint8_t *payload, uint16_t length);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
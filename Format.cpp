@@ -0,0 +1,141 @@
+#include "Format.h"
+#include <Clock.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+static const char _days[]   = "SunMonTueWedThuFriSat";
+static const char _months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Small writer which never passes the end of the buffer
+////////////////////////////////////////////////////////////////////////////////////////////
+struct Writer
+{
+  char *p, *end;
+  Writer(char *buf, size_t size) : p(buf), end(buf + size - 1) {}
+  void put(char c)                    { if (p < end) *p++ = c; }
+  void put(const char *s, size_t n)   { while (n-- && *s) put(*s++); }
+  void put(const char *s)             { while (*s) put(*s++); }
+  void num(uint32_t v, uint8_t width=1)
+  {
+    char tmp[10];
+    uint8_t n = 0;
+    do { tmp[n++] = '0' + v % 10; v /= 10; } while (v && n < sizeof(tmp));
+    while (width > n) { put('0'); width--; }
+    while (n) put(tmp[--n]);
+  }
+  void close()                        { *p = '\0'; }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+char *fmt_time(char *buf, size_t size, const DateTime &dt, bool seconds)
+{
+  Writer w(buf, size);
+  w.num(dt.hour(), 2);   w.put(':');
+  w.num(dt.minute(), 2);
+  if (seconds) {
+    w.put(':'); w.num(dt.second(), 2);
+  }
+  w.close();
+  return buf;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+char *fmt_date(char *buf, size_t size, const DateTime &dt)
+{
+  Writer w(buf, size);
+  w.put(_days + 3 * (dt.dayOfTheWeek() % 7), 3);  w.put(' ');
+  w.num(dt.day(), 2);                             w.put(' ');
+  w.put(_months + 3 * ((dt.month() +11) % 12), 3); w.put(' ');
+  w.num(dt.year(), 4);
+  w.close();
+  return buf;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+char *fmt_timestamp(char *buf, size_t size, const DateTime &dt)
+{
+  Writer w(buf, size);
+  w.num(dt.year(), 4);    w.put('-');
+  w.num(dt.month(), 2);   w.put('-');
+  w.num(dt.day(), 2);     w.put('T');
+  w.num(dt.hour(), 2);    w.put(':');
+  w.num(dt.minute(), 2);  w.put(':');
+  w.num(dt.second(), 2);
+  w.close();
+  return buf;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// fixed point: the value is scaled and rounded to an integer, which is printed with a dot
+////////////////////////////////////////////////////////////////////////////////////////////
+char *fmt_fixed(char *buf, size_t size, float value, uint8_t precision, const char *unit)
+{
+  static const uint16_t scale[] = { 1, 10, 100, 1000 };
+  if (precision > 3)
+    precision = 3;
+
+  Writer w(buf, size);
+  int32_t scaled = lroundf(value * scale[precision]);
+  if (scaled < 0) {
+    w.put('-');
+    scaled = -scaled;
+  }
+  w.num(scaled / scale[precision]);
+  if (precision > 0) {
+    w.put('.');
+    w.num(scaled % scale[precision], precision);
+  }
+  w.put(unit);
+  w.close();
+  return buf;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+char *fmt_percent(char *buf, size_t size, float value, uint8_t precision)
+{
+  return fmt_fixed(buf, size, value, precision, "%");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+char *fmt_ip(char *buf, size_t size, const IPAddress &ip)
+{
+  Writer w(buf, size);
+  for (int i=0; i<4; i++) {
+    if (i > 0)
+      w.put('.');
+    w.num(ip[i]);
+  }
+  w.close();
+  return buf;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+HeapStats::HeapStats()
+{
+  free = max_block = fragmentation = 0;
+  min_free = min_block = UINT32_MAX;
+  max_fragmentation = 0;
+  samples = 0;
+}
+
+void HeapStats::sample()
+{
+  free          = ESP.getFreeHeap();
+  max_block     = ESP.getMaxFreeBlockSize();
+  fragmentation = ESP.getHeapFragmentation();
+
+  if (free < min_free)
+    min_free = free;
+  if (max_block < min_block)
+    min_block = max_block;
+  if (fragmentation > max_fragmentation)
+    max_fragmentation = fragmentation;
+  samples++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+class DateTime;
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Formatting without heap allocation (no String, no printf float formatting)
+// All functions write into the given buffer, always terminate it and return it, so they
+// can be used directly as a printf or _print argument.
+////////////////////////////////////////////////////////////////////////////////////////////
+char *fmt_time(char *buf, size_t size, const DateTime &dt, bool seconds=true); // hh:mm[:ss]
+char *fmt_date(char *buf, size_t size, const DateTime &dt);                    // DDD DD MMM YYYY
+char *fmt_timestamp(char *buf, size_t size, const DateTime &dt);               // YYYY-MM-DDThh:mm:ss
+char *fmt_fixed(char *buf, size_t size, float value, uint8_t precision, const char *unit=""); // -12.3C
+char *fmt_percent(char *buf, size_t size, float value, uint8_t precision=1);   // 12.3%
+char *fmt_ip(char *buf, size_t size, const IPAddress &ip);                     // 192.168.2.1
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Heap statistics, sampled from the loop to see if the heap stays steady over weeks
+////////////////////////////////////////////////////////////////////////////////////////////
+struct HeapStats
+{
+  uint32_t free;            // current free heap
+  uint32_t max_block;       // current largest free block
+  uint8_t  fragmentation;   // current fragmentation in %
+  uint32_t min_free;        // low water mark of the free heap
+  uint32_t min_block;       // low water mark of the largest free block
+  uint8_t  max_fragmentation;
+  uint32_t samples;
+
+  HeapStats();
+  void sample();
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
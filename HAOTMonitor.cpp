@@ -9,22 +9,203 @@ DATED_VERSION(0, 9)
 #define LOG_LEVEL 2
 #include <Logging.h>
 #include "SmartControl.h"
+#include "PublishPolicy.h"
+#include "Diagnostics.h"
+#include "Energy.h"
+#include <Timer.h>
 
 ////////////////////////////////////////////////////////////////////////////////////////////
-//
+// Entity table, one row per entity in Home Assistant. Columns:
+//  name, kind, label, device class, unit, icon, precision, min, max, step (numbers only),
+//  value, valid and command, as expressions on SmartControl *c (and float v for commands)
+////////////////////////////////////////////////////////////////////////////////////////////
+#define HA_ENTITIES(X) \
+  X(inside,          Sensor,       "inside",           "temperature",  "°C", "mdi:thermometer", 2, 0, 0, 0, \
+    c->inside.get(),                    c->inside.valid(),    false) \
+  X(inside_estimate, Sensor,       "inside estimate",  "temperature",  "°C", "mdi:thermometer", 2, 0, 0, 0, \
+    c->inside.estimate(),               c->inside.valid(),    false) \
+  X(inside_rate,     Sensor,       "inside rate",      "",             "°C/h", "mdi:thermometer-chevron-up", 2, 0, 0, 0, \
+    c->inside.rate(),                   c->inside.valid(),    false) \
+  X(inside_sigma,    Sensor,       "inside sigma",     "",             "°C", "mdi:sigma",       3, 0, 0, 0, \
+    c->inside.deviation(),              c->inside.valid(),    false) \
+  X(setpoint,        Sensor,       "setpoint",         "temperature",  "°C", "mdi:thermometer", 2, 0, 0, 0, \
+    c->setpoint.get(),                  c->setpoint.valid(),  false) \
+  X(outside,         Sensor,       "outside",          "temperature",  "°C", "mdi:thermometer", 2, 0, 0, 0, \
+    c->outside.get(),                   c->outside.valid(),   false) \
+  X(inlet,           Sensor,       "inlet",            "temperature",  "°C", "mdi:thermometer", 2, 0, 0, 0, \
+    c->inlet.get(),                     c->inlet.valid(),     false) \
+  X(outlet,          Sensor,       "outlet",           "temperature",  "°C", "mdi:thermometer", 2, 0, 0, 0, \
+    c->outlet.get(),                    c->outlet.valid(),    false) \
+  X(modlvl,          Sensor,       "Modulation Level", "power_factor", "%",  "",                2, 0, 0, 0, \
+    c->ModLvl,                          true,                 false) \
+  X(factor,          Sensor,       "factor",           "power",        "",   "",                2, 0, 0, 0, \
+    c->heating_curve.current_factor(),  true,                 false) \
+  X(fault,           BinarySensor, "Fault",            "",             "",   "",                0, 0, 0, 0, \
+    c->status_flags.fault,              true,                 false) \
+  X(CH_mode,         BinarySensor, "CH mode",          "",             "",   "",                0, 0, 0, 0, \
+    c->status_flags.CH_mode,            true,                 false) \
+  X(DHW_mode,        BinarySensor, "DWH mode",         "",             "",   "",                0, 0, 0, 0, \
+    c->status_flags.DHW_mode,           true,                 false) \
+  X(Flame,           BinarySensor, "Heating",          "",             "",   "",                0, 0, 0, 0, \
+    c->status_flags.Flame,              true,                 false) \
+  X(Cooling,         BinarySensor, "Cooling",          "",             "",   "",                0, 0, 0, 0, \
+    c->status_flags.Cooling,            true,                 false) \
+  X(target,          Number,       "target",           "",             "°C", "mdi:thermometer", 2, 18.0f, 25.0f, 0.1f, \
+    c->target.get(),                    true,                 c->target.set(v)) \
+  X(solar_offset,    Sensor,       "solar offset",     "",             "°C", "mdi:weather-sunny-down", 2, 0, 0, 0, \
+    c->heating_curve.solar_offset(),    true,                 false) \
+  X(solar_gain,      Number,       "solar_gain",       "",             "°C/kW/m²", "mdi:weather-sunny", 1, 0.0f, 5.0f, 0.1f, \
+    c->solar.gain,                      true,                 (c->solar.gain = v, true)) \
+  X(factor_outside,  Number,       "factor_outside",   "",             "",   "",                2, 0.0f, 1.0f, 0.05f, \
+    c->heating_curve.factorA(),         true,                 (c->heating_curve.factorA(v), true)) \
+  X(factor_inside,   Number,       "factor_inside",    "",             "",   "",                2, 0.0f, 1.0f, 0.05f, \
+    c->heating_curve.factorB(),         true,                 (c->heating_curve.factorB(v), true)) \
+  X(factor_curve,    Number,       "factor_curve",     "",             "",   "",                2, 0.0f, 1.0f, 0.05f, \
+    c->heating_curve.factorC(),         true,                 (c->heating_curve.factorC(v), true)) \
+  X(CH_enabled,      Switch,       "Enable CH",        "",             "",   "",                0, 0, 0, 0, \
+    c->operating_flags.enable_CH,       true,                 (c->operating_flags.enable_CH = v != 0.0f, true)) \
+  X(DHW_enabled,     Switch,       "Enable DWH",       "",             "",   "",                0, 0, 0, 0, \
+    c->operating_flags.enable_DHW,      true,                 (c->operating_flags.enable_DHW = v != 0.0f, true)) \
+  X(Cooling_enabled, Switch,       "Enable Cooling",   "",             "",   "",                0, 0, 0, 0, \
+    c->operating_flags.enable_Cooling,  true,                 (c->operating_flags.enable_Cooling = v != 0.0f, true)) \
+  X(OTC_enabled,     Switch,       "Enable OTC",       "",             "",   "",                0, 0, 0, 0, \
+    c->operating_flags.enable_OTC,      true,                 (c->operating_flags.enable_OTC = v != 0.0f, true))
+
 ////////////////////////////////////////////////////////////////////////////////////////////
-#define CONSTRUCT(var)          var(#var)
-#define CONSTRUCT_P1(var)       var(#var, HABaseDeviceType::PrecisionP1)
-#define CONSTRUCT_P2(var)       var(#var, HABaseDeviceType::PrecisionP2)
+// Memory footprint of the device itself
+#define HA_DIAG_ENTITIES(X) \
+  X(heap_free,       Sensor,       "Heap free",        "data_size",    "B",  "mdi:memory",      0, 0, 0, 0, \
+    Diagnostics::instance()->heap.free,            Diagnostics::instance()->sampled(), false) \
+  X(heap_block,      Sensor,       "Heap max block",   "data_size",    "B",  "mdi:memory",      0, 0, 0, 0, \
+    Diagnostics::instance()->heap.max_block,       Diagnostics::instance()->sampled(), false) \
+  X(heap_frag,       Sensor,       "Heap fragmentation", "",           "%",  "mdi:memory",      0, 0, 0, 0, \
+    Diagnostics::instance()->heap.fragmentation,   Diagnostics::instance()->sampled(), false) \
+  X(stack_free,      Sensor,       "Stack free",       "data_size",    "B",  "mdi:memory",      0, 0, 0, 0, \
+    Diagnostics::instance()->stack_free,           Diagnostics::instance()->sampled(), false) \
+  X(board_temp,      Sensor,       "Board temperature", "temperature", "°C", "mdi:thermometer", 1, 0, 0, 0, \
+    c->board.get(),                                c->board.valid(),                   false)
 
-#define CONFIGURE_TEMP(var)     var.setName(#var); var.setDeviceClass("temperature"); var.setStateClass("measurement"); var.setIcon("mdi:thermometer"); var.setUnitOfMeasurement("°C")
-#define CONFIGURE_INPUT(var)    var.setName(#var); var.setMin(0.0f);var.setMax(1.0f);var.setStep(0.05f); var.setMode(HANumber::ModeBox)
+////////////////////////////////////////////////////////////////////////////////////////////
+// Energy accounting, the totals feed the Home Assistant energy dashboard
+#define HA_ENERGY_ENTITIES(X) \
+  X(heat_total,      Sensor,       "Heat delivered",   "energy",       "kWh", "mdi:fire",       2, 0, 0, 0, \
+    Energy::instance()->heat_total,                 true,                               false) \
+  X(electric_total,  Sensor,       "Electricity used", "energy",       "kWh", "mdi:flash",      2, 0, 0, 0, \
+    Energy::instance()->electric_total,             Energy::instance()->electric_total > 0.0, false) \
+  X(heat_hour,       Sensor,       "Heat last hour",   "",             "kWh", "mdi:fire",       2, 0, 0, 0, \
+    Energy::instance()->last_hour.heat,             true,                               false) \
+  X(cop_today,       Sensor,       "COP today",        "",             "",    "mdi:heat-pump",  2, 0, 0, 0, \
+    Energy::instance()->today().cop(),              Energy::instance()->today().electric > 0.0f, false) \
+  X(run_hours_today, Sensor,       "Run hours today",  "duration",     "h",   "mdi:timer",      1, 0, 0, 0, \
+    Energy::instance()->today().run_hours,          true,                               false) \
+  X(starts_today,    Sensor,       "Starts today",     "",             "",    "mdi:counter",    0, 0, 0, 0, \
+    Energy::instance()->today().starts,             true,                               false) \
+  X(short_cycles_today, Sensor,    "Short cycles today", "",           "",    "mdi:counter",    0, 0, 0, 0, \
+    Energy::instance()->today().short_cycles,       true,                               false) \
+  X(flow_rate,       Number,       "Flow rate",        "",             "l/min", "mdi:pump",     1, 1.0f, 60.0f, 0.5f, \
+    Energy::instance()->flow,                       true,                               (Energy::instance()->flow = v, true))
+
+#ifdef HA_BATCHED_STATE
+#define HA_BATCH_ENTITIES(X) \
+  X(batch_interval,  Number,       "State interval",   "",             "s",  "",                0, 1.0f, 300.0f, 1.0f, \
+    _device->batch.interval() / 1000.0f, true,            (_device->batch.interval(v * 1000), true))
+#else
+#define HA_BATCH_ENTITIES(X)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The strings go to flash, the table refers to them
+////////////////////////////////////////////////////////////////////////////////////////////
+#define HA_STRINGS(name, kind, label, cls, unit, icon, ...) \
+  static const char _ha_##name##_label[] PROGMEM = label;  \
+  static const char _ha_##name##_class[] PROGMEM = cls;    \
+  static const char _ha_##name##_unit[]  PROGMEM = unit;   \
+  static const char _ha_##name##_icon[]  PROGMEM = icon;
+
+#define HA_ROW(name, kind, label, cls, unit, icon, prec, min, max, step, value, available, command) \
+  { #name, _ha_##name##_label, _ha_##name##_class, _ha_##name##_unit, _ha_##name##_icon,       \
+    HAEntity::kind, prec, min, max, step,                                                        \
+    [](SmartControl *c) -> float { return value; },                                             \
+    [](SmartControl *c) -> bool { return available; },                                          \
+    [](SmartControl *c, float v) -> bool { return command; } },
+
+extern HAOTMonitor *_device;
+
+HA_ENTITIES(HA_STRINGS)
+HA_DIAG_ENTITIES(HA_STRINGS)
+HA_ENERGY_ENTITIES(HA_STRINGS)
+HA_BATCH_ENTITIES(HA_STRINGS)
+
+static constexpr HAEntity _entities[] PROGMEM = {
+  HA_ENTITIES(HA_ROW)
+  HA_DIAG_ENTITIES(HA_ROW)
+  HA_ENERGY_ENTITIES(HA_ROW)
+  HA_BATCH_ENTITIES(HA_ROW)
+};
+#define ENTITY_COUNT  (sizeof(_entities) / sizeof(_entities[0]))
+static_assert(ENTITY_COUNT <= HA_MAX_ENTITIES, "increase HA_MAX_ENTITIES");
+
+// a pool that is too small would leave entities out without a word
+static constexpr uint8_t entity_count(HAEntity::Kind kind, uint8_t row=0) {
+  return row >= ENTITY_COUNT ? 0 : (_entities[row].kind == kind) + entity_count(kind, row + 1);
+}
+static_assert(entity_count(HAEntity::Number) <= HA_MAX_NUMBERS, "increase HA_MAX_NUMBERS");
+static_assert(entity_count(HAEntity::Switch) <= HA_MAX_SWITCHES, "increase HA_MAX_SWITCHES");
+#ifdef HA_BATCHED_STATE
+static_assert(entity_count(HAEntity::Sensor) + entity_count(HAEntity::BinarySensor) <= HA_BATCH_MAX_FIELDS, "increase HA_BATCH_MAX_FIELDS");
+#else
+static_assert(entity_count(HAEntity::Sensor) <= HA_MAX_SENSORS, "increase HA_MAX_SENSORS");
+static_assert(entity_count(HAEntity::BinarySensor) <= HA_MAX_BINARIES, "increase HA_MAX_BINARIES");
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Publish policy of the read-only sensors, to tune the growth of the Home Assistant
+// recorder against freshness. Sensors without a policy are published on each change.
+// Change at runtime with "<name> <abs> <rel> <min> <heartbeat>" on SmartTherm/policy/set
+////////////////////////////////////////////////////////////////////////////////////////////
+PublishPolicy policies[] = {
+  // name       abs     rel    min  heartbeat (seconds)
+  { "inside",   0.05f,  0.0f,  30,  900 },
+  { "inside_estimate", 0.05f, 0.0f, 30, 900 },
+  { "inside_rate",  0.1f,  0.0f,  60,  900 },
+  { "inside_sigma", 0.005f, 0.0f, 60,  3600 },
+  { "setpoint", 0.1f,   0.0f,  30,  900 },
+  { "outside",  0.1f,   0.0f,  60,  900 },
+  { "inlet",    0.2f,   0.0f,  10,  600 },
+  { "outlet",   0.2f,   0.0f,  10,  600 },
+  { "modlvl",   1.0f,   0.05f, 10,  600 },
+  { "factor",   0.01f,  0.0f,  60,  900 },
+  { "heap_free",  256.0f, 0.0f,  60,  3600 },
+  { "heap_block", 256.0f, 0.0f,  60,  3600 },
+  { "heap_frag",  2.0f,   0.0f,  60,  3600 },
+  { "stack_free", 64.0f,  0.0f,  60,  3600 },
+  { "board_temp", 0.5f,   0.0f,  60,  3600 },
+  { "heat_total", 0.01f,  0.0f,  60,  900 },
+  { "electric_total", 0.01f, 0.0f, 60, 900 },
+  { "run_hours_today", 0.1f, 0.0f, 60, 900 },
+};
+#define POLICY_COUNT      (sizeof(policies) / sizeof(policies[0]))
+#define POLICY_TOPIC      "SmartTherm/policy/set"
+#define POLICY_REPORT     (60*60*1000)    // log the counters each hour
+
+Periodic policy_report(POLICY_REPORT);
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 // singleton object
 HAOTMonitor *_device = NULL;
 HAOTMonitor *HAOTMonitor::instance() { return _device; };
 
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+uint8_t HAOTMonitor::entities() {
+  return ENTITY_COUNT;
+}
+
+void HAOTMonitor::entity(uint8_t row, HAEntity &e) {
+  memcpy_P(&e, &_entities[row], sizeof(e));
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -46,52 +227,112 @@ void switchChanged(bool state, HASwitch* sender)
 //
 ////////////////////////////////////////////////////////////////////////////////////////////
 HAOTMonitor::HAOTMonitor()
-: CONSTRUCT_P2(inside), CONSTRUCT_P2(target), CONSTRUCT_P2(setpoint)
-, CONSTRUCT_P2(outside), CONSTRUCT_P2(inlet), CONSTRUCT_P2(outlet), CONSTRUCT_P2(modlvl)
-, CONSTRUCT_P2(factor), CONSTRUCT_P2(factor_outside), CONSTRUCT_P2(factor_inside), CONSTRUCT_P2(factor_curve)
-, CONSTRUCT(CH_enabled), CONSTRUCT(DHW_enabled), CONSTRUCT(Cooling_enabled), CONSTRUCT(OTC_enabled)
-, CONSTRUCT(fault), CONSTRUCT(CH_mode), CONSTRUCT(DHW_mode), CONSTRUCT(Flame), CONSTRUCT(Cooling)
 {
   _device = this;
-  CONFIGURE_TEMP(inside);
-  CONFIGURE_TEMP(setpoint);
-  CONFIGURE_TEMP(outside);
-  CONFIGURE_TEMP(inlet);
-  CONFIGURE_TEMP(outlet);
-  modlvl.setName("Modulation Level"); modlvl.setUnitOfMeasurement("%"); modlvl.setDeviceClass("power_factor"); modlvl.setStateClass("measurement");
-
-  target.setName("target"); target.setIcon("mdi:thermometer"); target.setUnitOfMeasurement("°C");
-  target.setMin(18.0f); target.setMax(25.0f); target.setStep(0.1f); target.setMode(HANumber::ModeBox);
-  CONFIGURE_INPUT(factor_outside); 
-  CONFIGURE_INPUT(factor_inside); 
-  CONFIGURE_INPUT(factor_curve); 
-  factor.setName("factor"); factor.setDeviceClass("power"); factor.setStateClass("measurement");
-
-  target.onCommand(settingsChanged);
-  factor_outside.onCommand(settingsChanged);
-  factor_inside.onCommand(settingsChanged);
-  factor_curve.onCommand(settingsChanged);
-
-  CH_enabled.setName("Enable CH");
-  DHW_enabled.setName("Enable DWH");
-  Cooling_enabled.setName("Enable Cooling");
-  OTC_enabled.setName("Enable OTC");
-  CH_enabled.onCommand(switchChanged);
-  DHW_enabled.onCommand(switchChanged);
-  Cooling_enabled.onCommand(switchChanged);
-  OTC_enabled.onCommand(switchChanged);
-
-  fault.setName("Fault");
-  CH_mode.setName("CH mode");
-  DHW_mode.setName("DWH mode");
-  Flame.setName("Heating");
-  Cooling.setName("Cooling");
+  _strings_used = 0;
+  _connected = _frames = 0;
+  _resumed = true;
+  for (uint8_t i=0; i<HA_MAX_ENTITIES; i++) {
+    _state[i].object = NULL;
+    _state[i].batch  = -1;
+    _state[i].policy = -1;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The library keeps pointers to the strings it is given, and reads them as ram
+////////////////////////////////////////////////////////////////////////////////////////////
+const char *HAOTMonitor::_ram(PGM_P str)
+{
+  size_t len = strlen_P(str);
+  if (len == 0)
+    return NULL;
+  if (_strings_used + len + 1 > sizeof(_strings)) {
+    ERROR("HA MQTT: string pool exhausted");
+    return NULL;
+  }
+  char *s = _strings + _strings_used;
+  strcpy_P(s, str);
+  _strings_used += len + 1;
+  return s;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Create the library object for a row (or add it to the batch)
+////////////////////////////////////////////////////////////////////////////////////////////
+bool HAOTMonitor::_create(uint8_t row, const HAEntity &e)
+{
+  HABaseDeviceType::NumberPrecision precision = (HABaseDeviceType::NumberPrecision) e.precision;
+
+  switch (e.kind)
+  {
+#ifdef HA_BATCHED_STATE
+  case HAEntity::Sensor:
+  case HAEntity::BinarySensor:
+    _state[row].batch = batch.add(e.name, e.kind == HAEntity::Sensor ? HAStateBatch::Sensor : HAStateBatch::BinarySensor,
+                                  e.label, e.unit, e.device_class, e.icon, e.precision);
+    return _state[row].batch >= 0;
+#else
+  case HAEntity::Sensor:
+  {
+    HASensorNumber *s = _sensors.create(row, e.name, precision);
+    if (s == NULL)
+      break;
+    s->setName(_ram(e.label));
+    s->setDeviceClass(_ram(e.device_class));
+    s->setUnitOfMeasurement(_ram(e.unit));
+    s->setIcon(_ram(e.icon));
+    // total, not total_increasing: after a reset the totals go on from the last stored hour,
+    // which must count as a small step back and not as a new meter
+    s->setStateClass(strcmp_P("energy", e.device_class) == 0 ? "total" : "measurement");
+    _state[row].object = s;
+    return true;
+  }
+  case HAEntity::BinarySensor:
+  {
+    HABinarySensor *b = _binaries.create(row, e.name);
+    if (b == NULL)
+      break;
+    b->setName(_ram(e.label));
+    b->setDeviceClass(_ram(e.device_class));
+    b->setIcon(_ram(e.icon));
+    _state[row].object = b;
+    return true;
+  }
+#endif
+  case HAEntity::Number:
+  {
+    HANumber *n = _numbers.create(row, e.name, precision);
+    if (n == NULL)
+      break;
+    n->setName(_ram(e.label));
+    n->setUnitOfMeasurement(_ram(e.unit));
+    n->setIcon(_ram(e.icon));
+    n->setMin(e.min); n->setMax(e.max); n->setStep(e.step);
+    n->setMode(HANumber::ModeBox);
+    n->onCommand(settingsChanged);
+    _state[row].object = n;
+    return true;
+  }
+  case HAEntity::Switch:
+  {
+    HASwitch *s = _switches.create(row, e.name);
+    if (s == NULL)
+      break;
+    s->setName(_ram(e.label));
+    s->onCommand(switchChanged);
+    _state[row].object = s;
+    return true;
+  }
+  }
+  ERROR("HA MQTT: no room for entity %s", e.name);
+  return false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
 ////////////////////////////////////////////////////////////////////////////////////////////
-bool HAOTMonitor::begin(const byte mac[6], HAMqtt *mqtt) 
+bool HAOTMonitor::begin(const byte mac[6], HAMqtt *mqtt)
 {
   setUniqueId(mac, 6);
   setManufacturer("InnoVeer");
@@ -99,60 +340,47 @@ bool HAOTMonitor::begin(const byte mac[6], HAMqtt *mqtt)
   setSoftwareVersion(VERSION);
   setModel(DEVICE_MODEL);
 
-  mqtt->addDeviceType(&inside);  
-  mqtt->addDeviceType(&target);  
-  mqtt->addDeviceType(&setpoint);  
-
-  mqtt->addDeviceType(&outside);  
-  mqtt->addDeviceType(&inlet);  
-  mqtt->addDeviceType(&outlet);  
-  mqtt->addDeviceType(&modlvl);  
-
-  mqtt->addDeviceType(&factor);  
-  mqtt->addDeviceType(&factor_outside);  
-  mqtt->addDeviceType(&factor_inside);  
-  mqtt->addDeviceType(&factor_curve);  
-
-  mqtt->addDeviceType(&CH_enabled);
-  mqtt->addDeviceType(&DHW_enabled);
-  mqtt->addDeviceType(&Cooling_enabled);
-  mqtt->addDeviceType(&OTC_enabled);
-  mqtt->addDeviceType(&fault);
-  mqtt->addDeviceType(&CH_mode);
-  mqtt->addDeviceType(&DHW_mode);
-  mqtt->addDeviceType(&Flame);
-  mqtt->addDeviceType(&Cooling);
-    
-  // initialize with current values
-  inside.setAvailability(false);
-  setpoint.setAvailability(false);
-  outside.setAvailability(false);
-  inlet.setAvailability(false);
-  outlet.setAvailability(false);
-  factor.setCurrentValue(SmartControl::instance()->heating_curve.current_factor());
-
-  // slave status
-  CH_enabled.setCurrentState(SmartControl::instance()->operating_flags.enable_CH);
-  DHW_enabled.setCurrentState(SmartControl::instance()->operating_flags.enable_DHW);
-  Cooling_enabled.setCurrentState(SmartControl::instance()->operating_flags.enable_Cooling);
-  OTC_enabled.setCurrentState(SmartControl::instance()->operating_flags.enable_OTC);
-  fault.setCurrentState(SmartControl::instance()->status_flags.fault);
-  CH_mode.setCurrentState(SmartControl::instance()->status_flags.CH_mode);
-  DHW_mode.setCurrentState(SmartControl::instance()->status_flags.DHW_mode);
-  Flame.setCurrentState(SmartControl::instance()->status_flags.Flame);
-  Cooling.setCurrentState(SmartControl::instance()->status_flags.Cooling);
-
-  // inputs
-  target.setCurrentState(SmartControl::instance()->target.get());
-  factor_outside.setCurrentState(SmartControl::instance()->heating_curve.factorA());
-  factor_inside.setCurrentState(SmartControl::instance()->heating_curve.factorB());
-  factor_curve.setCurrentState(SmartControl::instance()->heating_curve.factorC());
+  SmartControl *c = SmartControl::instance();
+  HAEntity e;
+  for (uint8_t row=0; row<ENTITY_COUNT; row++)
+  {
+    entity(row, e);
+    if (!_create(row, e))
+      continue;
+
+    PublishPolicy *p = find_policy(policies, POLICY_COUNT, e.name);
+    if (p != NULL)
+      _state[row].policy = p - policies;
 
+    // initialize with current values
+    switch (e.kind)
+    {
+    case HAEntity::Sensor:
+      if (_state[row].object)
+        _state[row].object->setAvailability(false);
+      break;
+    case HAEntity::BinarySensor:
+      if (_state[row].object)
+        static_cast<HABinarySensor *>(_state[row].object)->setCurrentState(e.get(c) != 0.0f);
+      break;
+    case HAEntity::Number:
+      static_cast<HANumber *>(_state[row].object)->setCurrentState(e.get(c));
+      break;
+    case HAEntity::Switch:
+      static_cast<HASwitch *>(_state[row].object)->setCurrentState(e.get(c) != 0.0f);
+      break;
+    }
+    if (_state[row].object)
+      mqtt->addDeviceType(_state[row].object);
+  }
+#ifdef HA_BATCHED_STATE
+  mqtt->addDeviceType(&batch);
+#endif
   return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
-//
+// O(1): the position of the sender in its pool gives the row in the table
 ////////////////////////////////////////////////////////////////////////////////////////////
 void HAOTMonitor::_change_setting(HANumeric number, HANumber* sender)
 {
@@ -162,23 +390,17 @@ void HAOTMonitor::_change_setting(HANumeric number, HANumber* sender)
   }
   float newval = number.toFloat();
 
-  if (sender == &target) {
-    if (SmartControl::instance()->target.set(newval))
-      INFO("new target temp set to %0.2f", newval);
-    else
-      ERROR("Could not change target temp to %0.2f", newval);
+  int16_t row = _numbers.row(sender);
+  if (row < 0) {
+    ERROR("HA MQTT: Could not determine which setting to change");
+    return;
   }
-  else if (sender == &factor_outside)
-    SmartControl::instance()->heating_curve.factorA(newval);
-
-  else if (sender == &factor_inside)
-    SmartControl::instance()->heating_curve.factorB(newval);
-
-  else if (sender == &factor_curve)
-    SmartControl::instance()->heating_curve.factorC(newval);
-
+  HAEntity e;
+  entity(row, e);
+  if (e.set(SmartControl::instance(), newval))
+    INFO("%s set to %0.2f", e.name, newval);
   else
-    ERROR("HA MQTT: Could not determine which setting to change");
+    ERROR("Could not change %s to %0.2f", e.name, newval);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -186,65 +408,142 @@ void HAOTMonitor::_change_setting(HANumeric number, HANumber* sender)
 ////////////////////////////////////////////////////////////////////////////////////////////
 void HAOTMonitor::_change_switch(bool state, HASwitch* sender)
 {
-  if (sender == &CH_enabled) {
-    SmartControl::instance()->operating_flags.enable_CH = state;
-    INFO("CH changed to %s", state? "on" :"off");
+  int16_t row = _switches.row(sender);
+  if (row < 0) {
+    ERROR("HA MQTT: Could not determine which switch was turned");
+    return;
   }
-  else if (sender == &DHW_enabled) {
-    SmartControl::instance()->operating_flags.enable_DHW = state;
-    INFO("DWH changed to %s", state? "on" :"off");
+  HAEntity e;
+  entity(row, e);
+  e.set(SmartControl::instance(), state ? 1.0f : 0.0f);
+  INFO("%s changed to %s", e.name, state? "on" :"off");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Runtime change of a publish policy: "<name> <abs> <rel> <min_interval> <heartbeat>"
+////////////////////////////////////////////////////////////////////////////////////////////
+bool HAOTMonitor::set_policy(const char *name, float abs, float rel, uint16_t min_interval, uint16_t heartbeat)
+{
+  PublishPolicy *p = find_policy(policies, POLICY_COUNT, name);
+  if (p == NULL) {
+    ERROR("HA policy: unknown sensor %s", name);
+    return false;
   }
-  else if (sender == &Cooling_enabled) {
-    SmartControl::instance()->operating_flags.enable_Cooling = state;
-    INFO("Cooling changed to %s", state? "on" :"off");
+  if (!p->configure(abs, rel, min_interval, heartbeat)) {
+    ERROR("HA policy: invalid settings for %s", name);
+    return false;
   }
-  else if (sender == &OTC_enabled) {
-    SmartControl::instance()->operating_flags.enable_OTC = state;
-    INFO("OTC changed to %s", state? "on" :"off");
+  INFO("HA policy %s: deadband %0.3f / %0.1f%%, interval %u-%u sec", name, abs, rel*100.0f, min_interval, heartbeat);
+  return true;
+}
+
+bool HAOTMonitor::onMessage(const char *topic, const uint8_t *payload, uint16_t length)
+{
+  if (strcmp(topic, POLICY_TOPIC) != 0)
+    return false;
+
+  char buf[64], name[16];
+  float abs, rel;
+  unsigned int min_interval, heartbeat;
+  if (length >= sizeof(buf))
+    length = sizeof(buf) -1;
+  memcpy(buf, payload, length);
+  buf[length] = '\0';
+
+  if (sscanf(buf, "%15s %f %f %u %u", name, &abs, &rel, &min_interval, &heartbeat) != 5) {
+    ERROR("HA policy: expected '<name> <abs> <rel> <min> <heartbeat>'");
+    return false;
   }
-  else
-    ERROR("HA MQTT: Could not determine which switch was turned");
+  return set_policy(name, abs, rel, min_interval, heartbeat);
+}
+
+bool HAOTMonitor::subscribe(HAMqtt *mqtt)
+{
+  return mqtt->subscribe(POLICY_TOPIC);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
-//
+// Called after the library announced its entities, update() reports when the boiler is
+// served again
 ////////////////////////////////////////////////////////////////////////////////////////////
-#define UPDATE_TEMP_SENSOR(var)   var.setAvailability(c->var.valid());  if (var.isOnline()) var.setValue(c->var.get())
+void HAOTMonitor::connected()
+{
+  SmartControl *c = SmartControl::instance();
+  _connected = millis();
+  _frames = c ? c->frames : 0;
+  _resumed = false;
+}
 
+////////////////////////////////////////////////////////////////////////////////////////////
+// Walk the table, the library and the batch only publish when the state changed
+////////////////////////////////////////////////////////////////////////////////////////////
 bool HAOTMonitor::update()
 {
   SmartControl *c = SmartControl::instance();
   if (c == NULL)
     return false;
-  
-  // update values without force (only update when changed)
-  UPDATE_TEMP_SENSOR(inside);
-  UPDATE_TEMP_SENSOR(setpoint);
-  UPDATE_TEMP_SENSOR(outside);
-  UPDATE_TEMP_SENSOR(outlet);
-  UPDATE_TEMP_SENSOR(inlet);
-
-  modlvl.setValue(c->ModLvl);
-  factor.setValue(c->heating_curve.current_factor());
-  target.setState(c->target.get());
-  factor_outside.setState(c->heating_curve.factorA());
-  factor_inside.setState(c->heating_curve.factorB());
-  factor_curve.setState(c->heating_curve.factorC());
-
-  CH_enabled.setState(c->operating_flags.enable_CH);
-  DHW_enabled.setState(c->operating_flags.enable_DHW);
-  Cooling_enabled.setState(c->operating_flags.enable_Cooling);
-  OTC_enabled.setState(c->operating_flags.enable_OTC);
-  fault.setState(c->status_flags.fault);
-  CH_mode.setState(c->status_flags.CH_mode);
-  DHW_mode.setState(c->status_flags.DHW_mode);
-  Flame.setState(c->status_flags.Flame);
-  Cooling.setState(c->status_flags.Cooling);
-  
+
+  if (!_resumed && c->frames != _frames) {
+    _resumed = true;
+    INFO("HA MQTT: OpenTherm frames resumed %u ms after connect, heap %u", millis() - _connected, ESP.getFreeHeap());
+  }
+
+  HAEntity e;
+  for (uint8_t row=0; row<ENTITY_COUNT; row++)
+  {
+    const State &s = _state[row];
+    if (s.object == NULL && s.batch < 0)
+      continue;   // could not be created
+    entity(row, e);
+    float value = e.get(c);
+
+    switch (e.kind)
+    {
+    case HAEntity::Sensor:
+    {
+      bool valid = e.valid(c);
+      bool force = false;   // set by the policy on a heartbeat
+      if (s.policy >= 0 && !policies[s.policy].accept(valid, value, force))
+        break;
+#ifdef HA_BATCHED_STATE
+      if (valid)
+        batch.set(s.batch, value, force);
+      else
+        batch.invalidate(s.batch);
+#else
+      HASensorNumber *sensor = static_cast<HASensorNumber *>(s.object);
+      sensor->setAvailability(valid);
+      if (sensor->isOnline())
+        sensor->setValue(value, force);
+#endif
+      break;
+    }
+    case HAEntity::BinarySensor:
+#ifdef HA_BATCHED_STATE
+      batch.set(s.batch, value != 0.0f);
+#else
+      static_cast<HABinarySensor *>(s.object)->setState(value != 0.0f);
+#endif
+      break;
+    // settings and switches have their own command and state topics
+    case HAEntity::Number:
+      static_cast<HANumber *>(s.object)->setState(value);
+      break;
+    case HAEntity::Switch:
+      static_cast<HASwitch *>(s.object)->setState(value != 0.0f);
+      break;
+    }
+  }
+#ifdef HA_BATCHED_STATE
+  batch.loop();
+#endif
+
+  if (policy_report)
+    for (uint8_t i=0; i<POLICY_COUNT; i++)
+      INFO("HA policy %s: %u sent, %u suppressed", policies[i].name, policies[i].sent, policies[i].suppressed);
+
   return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////
-
-
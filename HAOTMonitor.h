@@ -2,60 +2,127 @@
 #define HOME_ASSIST_SMARTTHERM
 
 #include <HADevice.h>
-#include <device-types\HABinarySensor.h>
-#include <device-types\HASwitch.h>
-#include <device-types\HASensorNumber.h>
-#include <device-types\HANumber.h>
+#include <device-types/HABinarySensor.h>
+#include <device-types/HASwitch.h>
+#include <device-types/HASensorNumber.h>
+#include <device-types/HANumber.h>
+#include "HAStateBatch.h"
+#include <new>
 
-#define SENSOR_COUNT 25    // Total number of sensors, with some slack
+#define HA_BATCHED_STATE   // publish all read-only sensors as one json document
+
+#define HA_MAX_ENTITIES   48      // rows in the entity table
+#define HA_MAX_NUMBERS    8       // library objects created for the table, per type, checked
+#define HA_MAX_SWITCHES   6       // against the table by static_asserts in HAOTMonitor.cpp
+#define HA_MAX_SENSORS    26
+#define HA_MAX_BINARIES   8
+#define HA_STRING_POOL    640     // ram copies of the flash strings the library needs
+
+// Total number of library objects registered with HAMqtt
+#ifdef HA_BATCHED_STATE
+#define SENSOR_COUNT      (HA_MAX_NUMBERS + HA_MAX_SWITCHES + 1)   // and the batch
+#else
+#define SENSOR_COUNT      (HA_MAX_NUMBERS + HA_MAX_SWITCHES + HA_MAX_SENSORS + HA_MAX_BINARIES)
+#endif
+
+class SmartControl;
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// One row of the entity table (HAOTMonitor.cpp). The table and its strings live in flash.
+////////////////////////////////////////////////////////////////////////////////////////////
+struct HAEntity
+{
+  enum Kind : uint8_t { Sensor, BinarySensor, Number, Switch };
+
+  const char *name;             // unique id and json key (ram, the library needs it)
+  PGM_P       label;            // name shown in Home Assistant
+  PGM_P       device_class;     // "" when not applicable
+  PGM_P       unit;
+  PGM_P       icon;
+  Kind        kind;
+  uint8_t     precision;
+  float       min, max, step;   // numbers only
+  float     (*get)(SmartControl *c);            // current value, bools as 0/1
+  bool      (*valid)(SmartControl *c);          // availability of the value
+  bool      (*set)(SmartControl *c, float v);   // numbers and switches
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Library objects created from the table, stored in one block so the index of the object
+// that received a command is found in O(1)
+////////////////////////////////////////////////////////////////////////////////////////////
+template<class T, uint8_t N>
+class HAPool
+{
+private:
+  alignas(T) uint8_t _storage[N * sizeof(T)];
+  uint8_t _entity[N];           // table row of each object
+  uint8_t _count = 0;
+public:
+  T *at(uint8_t i)              { return reinterpret_cast<T *>(_storage) + i; }
+  template<typename... Args>
+  T *create(uint8_t row, Args... args) {
+    if (_count >= N)
+      return NULL;
+    _entity[_count] = row;
+    return new (at(_count++)) T(args...);
+  }
+  int16_t row(const T *obj) {   // table row of a library object, -1 if not ours
+    ptrdiff_t i = obj - at(0);
+    return (i >= 0 && i < _count) ? _entity[i] : -1;
+  }
+};
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
 ////////////////////////////////////////////////////////////////////////////////////////////
-class HAOTMonitor : public HADevice 
+class HAOTMonitor : public HADevice
 {
 friend void settingsChanged(HANumeric number, HANumber* sender);
 friend void switchChanged(bool state, HASwitch* sender);
 
 private:
+  struct State {
+    HABaseDeviceType *object;   // library object, NULL when published by the batch
+    int8_t            batch;    // index in the batch document
+    int8_t            policy;   // publish policy, -1 for none
+  };
+  State   _state[HA_MAX_ENTITIES];
+  HAPool<HANumber,        HA_MAX_NUMBERS>   _numbers;
+  HAPool<HASwitch,        HA_MAX_SWITCHES>  _switches;
+#ifndef HA_BATCHED_STATE
+  HAPool<HASensorNumber,  HA_MAX_SENSORS>   _sensors;
+  HAPool<HABinarySensor,  HA_MAX_BINARIES>  _binaries;
+#endif
+  char      _strings[HA_STRING_POOL];
+  uint16_t  _strings_used;
+  uint32_t  _connected;       // millis of the last (re)connect
+  uint32_t  _frames;          // OpenTherm frames received at that moment
+  bool      _resumed;         // a frame was received since
+
+  const char *_ram(PGM_P str);
+  bool _create(uint8_t row, const HAEntity &e);
   void _change_setting(HANumeric number, HANumber* sender);
   void _change_switch(bool state , HASwitch* sender);
 public:
   HAOTMonitor();
   static HAOTMonitor *instance();
+  static uint8_t entities();                       // number of rows in the table
+  static void entity(uint8_t row, HAEntity &e);    // copy of a row from flash
 
-  // Master to slave
-  HASensorNumber  inside;
-  HANumber  target;         // adjustable
-  HASensorNumber  setpoint;
-  // Slave to master
-  HASensorNumber  outside;
-  HASensorNumber  inlet;
-  HASensorNumber  outlet;
-  HASensorNumber  modlvl;  // modulation level (eg power)
-  
-  // Heating-curve parameters (adjustable)
-  HASensorNumber  factor;    // current applied factor
-  HANumber  factor_outside; // angle of curve based on outside
-  HANumber  factor_inside;  // angle adjustment based on inside
-  HANumber  factor_curve;   // curve
-
-  // flags
-  HASwitch       CH_enabled;
-  HASwitch       DHW_enabled;
-  HASwitch       Cooling_enabled;
-  HASwitch       OTC_enabled;
-  HABinarySensor fault;
-  HABinarySensor CH_mode;
-  HABinarySensor DHW_mode;
-  HABinarySensor Flame;
-  HABinarySensor Cooling;
+#ifdef HA_BATCHED_STATE
+  HAStateBatch   batch;           // the read-only entities in one document
+#endif
 
   bool begin(const byte mac[6], HAMqtt *mqqt);
-  bool update();                                   
+  bool update();
+  bool subscribe(HAMqtt *mqtt);                     // subscribe our own topics when connected
+  void connected();                                 // start measuring the reconnect
+  bool onMessage(const char *topic, const uint8_t *payload, uint16_t length);
+  bool set_policy(const char *name, float abs, float rel, uint16_t min_interval, uint16_t heartbeat);
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,246 @@
+#include "HAStateBatch.h"
+#include <HAMqtt.h>
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+#include "Format.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+HAStateBatch::HAStateBatch()
+: HABaseDeviceType(F("sensor"), "state")
+{
+  _count = 0;
+  _dirty = true;
+  _interval = HA_BATCH_INTERVAL;
+  _cadence.set(0);
+  messages = bytes = skipped = 0;
+  _discover = -1;
+  _pace.set(0);
+  memset(&discovery, 0, sizeof(discovery));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+int HAStateBatch::add(const char *name, Kind kind, PGM_P label, PGM_P unit, PGM_P device_class, PGM_P icon, uint8_t precision)
+{
+  if (_count >= HA_BATCH_MAX_FIELDS) {
+    ERROR("HA batch: no room for %s", name);
+    return -1;
+  }
+  Field &f = _fields[_count];
+  f.name = name;
+  f.label = label;
+  f.unit = unit;
+  f.device_class = device_class;
+  f.icon = icon;
+  f.kind = kind;
+  f.precision = precision;
+  f.valid = false;
+  f.value = 0.0f;
+  return _count++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// only flag the document as changed when the value changed at the published precision
+// or when forced (heartbeat)
+////////////////////////////////////////////////////////////////////////////////////////////
+void HAStateBatch::_set(uint8_t idx, bool valid, float value, bool force)
+{
+  static const float scale[] = { 1.0f, 10.0f, 100.0f, 1000.0f };
+  if (idx >= _count)
+    return;
+
+  Field &f = _fields[idx];
+  float s = scale[f.precision > 3 ? 3 : f.precision];
+  if (!force && f.valid == valid && lroundf(f.value * s) == lroundf(value * s))
+    return;
+
+  f.valid = valid;
+  f.value = value;
+  _dirty = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// {"inside":20.51,"flame":"ON"}, an invalid value is left out which makes it unavailable
+////////////////////////////////////////////////////////////////////////////////////////////
+uint16_t HAStateBatch::_build()
+{
+  char *p = _doc, *end = _doc + sizeof(_doc) - 16;  // keep room for the closing
+  *p++ = '{';
+  bool first = true;
+  for (uint8_t i=0; i<_count && p < end; i++)
+  {
+    const Field &f = _fields[i];
+    if (!f.valid)
+      continue;
+    if (!first)
+      *p++ = ',';
+    first = false;
+    p += snprintf(p, end - p, "\"%s\":", f.name);
+    if (p >= end)
+      break;
+    if (f.kind == BinarySensor)
+      p += snprintf(p, end - p, "\"%s\"", f.value != 0.0f ? "ON" : "OFF");
+    else
+      p = p + strlen(fmt_fixed(p, end - p, f.value, f.precision));
+  }
+  if (p > end)
+    p = end;
+  *p++ = '}';
+  *p = '\0';
+  return p - _doc;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool HAStateBatch::publish()
+{
+  if (!mqtt()->isConnected())
+    return false;
+
+  uint16_t length = _build();
+  if (!mqtt()->publish(HA_BATCH_STATE_TOPIC, _doc, false))
+    return false;
+
+  messages++;
+  bytes += length;
+  _dirty = false;
+  _cadence.set(_interval);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool HAStateBatch::loop()
+{
+  if (_discover >= 0)
+    return _announce();
+  if (!_cadence.passed())
+    return false;
+  if (!_dirty) {
+    skipped++;
+    _cadence.set(_interval);
+    return false;
+  }
+  return publish();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Writes the config piece by piece into the socket, or only counts the bytes when there is
+// no output. Nothing is assembled in ram.
+////////////////////////////////////////////////////////////////////////////////////////////
+struct ConfigWriter
+{
+  HAMqtt   *out;
+  uint16_t  length;
+
+  void ram(const char *s) {
+    size_t n = strlen(s);
+    if (out)
+      out->writePayload(s, n);
+    length += n;
+  }
+  void pgm(PGM_P s) {
+    if (out)
+      out->writePayload(FPSTR(s));
+    length += strlen_P(s);
+  }
+  void property(PGM_P key, PGM_P value) {   // ,"key":"value" with nothing for an empty value
+    if (value == NULL || pgm_read_byte(value) == '\0')
+      return;
+    pgm(key);
+    pgm(value);
+    pgm(PSTR("\""));
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The entities are announced by us and not by the library, each with a value_template
+////////////////////////////////////////////////////////////////////////////////////////////
+uint16_t HAStateBatch::_config(const Field &f, HAMqtt *out)
+{
+  const char *device = mqtt()->getDevice()->getUniqueId();
+  ConfigWriter w = { out, 0 };
+
+  w.pgm(PSTR("{\"name\":\""));  w.pgm(f.label);
+  w.pgm(PSTR("\",\"uniq_id\":\""));  w.ram(device);  w.pgm(PSTR("_"));  w.ram(f.name);
+  w.pgm(PSTR("\",\"stat_t\":\"" HA_BATCH_STATE_TOPIC "\",\"val_tpl\":\"{{ value_json."));  w.ram(f.name);
+  w.pgm(PSTR(" | default(none) }}\",\"avty_t\":\"" HA_BATCH_STATE_TOPIC "\",\"avty_tpl\":\"{{ 'online' if value_json."));
+  w.ram(f.name);
+  w.pgm(PSTR(" is defined else 'offline' }}\",\"dev\":{\"ids\":\""));  w.ram(device);  w.pgm(PSTR("\"}"));
+  w.property(PSTR(",\"dev_cla\":\""), f.device_class);
+  w.property(PSTR(",\"ic\":\""), f.icon);
+  if (f.kind == Sensor) {     // energy counters for the energy dashboard
+    if (strcmp_P("energy", f.device_class) == 0)
+      w.pgm(PSTR(",\"stat_cla\":\"total_increasing\""));
+    else
+      w.pgm(PSTR(",\"stat_cla\":\"measurement\""));
+    w.property(PSTR(",\"unit_of_meas\":\""), f.unit);
+  }
+  w.pgm(PSTR("}"));
+  return w.length;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// First pass for the length, second pass into the socket
+////////////////////////////////////////////////////////////////////////////////////////////
+bool HAStateBatch::_publishConfig(const Field &f)
+{
+  char topic[96];
+  snprintf(topic, sizeof(topic), "%s/%s/%s/%s/config", mqtt()->getDiscoveryPrefix(),
+           f.kind == BinarySensor ? "binary_sensor" : "sensor", mqtt()->getDevice()->getUniqueId(), f.name);
+
+  uint16_t length = _config(f, NULL);
+  if (!mqtt()->beginPublish(topic, length, true))
+    return false;
+  _config(f, mqtt());
+
+  uint32_t free = ESP.getFreeHeap();
+  if (free < discovery.low)
+    discovery.low = free;
+  return mqtt()->endPublish();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// One entity per call, so the OpenTherm loop keeps running during a reconnect
+////////////////////////////////////////////////////////////////////////////////////////////
+bool HAStateBatch::_announce()
+{
+  if (!_pace.passed() || !mqtt()->isConnected())
+    return false;
+
+  if (!_publishConfig(_fields[_discover]))
+    ERROR("HA batch: could not publish config of %s", _fields[_discover].name);
+
+  if (++_discover < _count) {
+    _pace.set(HA_DISCOVERY_PACE);
+    return true;
+  }
+  _discover = -1;
+  discovery.duration = millis() - discovery.start;
+  INFO("HA batch: %d entities announced in %u ms, heap %u (low %u)", _count, discovery.duration, discovery.heap, discovery.low);
+  _dirty = true;    // the broker may have lost the previous state
+  _cadence.set(0);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+void HAStateBatch::onMqttConnected()
+{
+  INFO("HA batch: %d entities on %s, %u documents, %u bytes published so far", _count, HA_BATCH_STATE_TOPIC, messages, bytes);
+  discovery.start = millis();
+  discovery.duration = 0;
+  discovery.heap = discovery.low = ESP.getFreeHeap();
+  _discover = _count > 0 ? 0 : -1;
+  _pace.set(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
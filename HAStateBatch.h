@@ -0,0 +1,84 @@
+#pragma once
+
+#include <HADevice.h>
+#include <device-types/HABaseDeviceType.h>
+#include <Timer.h>
+
+class HAMqtt;
+
+#define HA_BATCH_MAX_FIELDS   32          // maximum number of entities in the state document
+#define HA_BATCH_BUFFER       768         // size of the json state document
+#define HA_BATCH_INTERVAL     (5*1000)    // default minimum time between two state documents
+#define HA_BATCH_STATE_TOPIC  "SmartTherm/state"
+#define HA_DISCOVERY_PACE     50          // ms between two discovery configs, the loop runs in between
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// All read-only entities are published as one json document on a single topic. The
+// discovery config of each entity points to this topic with a value_template, so Home
+// Assistant picks its own value from the document. One MQTT message per tick instead of one
+// per entity. An invalid value is left out of the document, the availability template of
+// the entity then makes it unavailable rather than a null state.
+// The discovery configs are streamed from flash into the socket, one entity per loop.
+////////////////////////////////////////////////////////////////////////////////////////////
+class HAStateBatch : public HABaseDeviceType
+{
+public:
+  enum Kind : uint8_t { Sensor, BinarySensor };
+
+private:
+  struct Field {
+    const char *name;         // json key and unique id
+    PGM_P       label;        // entity name in flash
+    PGM_P       unit;         // unit of measurement in flash, "" for none
+    PGM_P       device_class; // device class in flash, "" for none
+    PGM_P       icon;         // icon in flash, "" for none
+    Kind        kind;
+    uint8_t     precision;
+    bool        valid;
+    float       value;
+  };
+  Field     _fields[HA_BATCH_MAX_FIELDS];
+  uint8_t   _count;
+  bool      _dirty;
+  uint32_t  _interval;
+  Timer     _cadence;
+  char      _doc[HA_BATCH_BUFFER];
+  int8_t    _discover;    // next entity to announce, -1 when done
+  Timer     _pace;
+
+  void _set(uint8_t idx, bool valid, float value, bool force);
+  uint16_t _config(const Field &field, HAMqtt *out);
+  bool _publishConfig(const Field &field);
+  bool _announce();
+  uint16_t _build();
+protected:
+  virtual void onMqttConnected() override;
+public:
+  HAStateBatch();
+
+  uint32_t messages;    // number of state documents published
+  uint32_t bytes;       // payload bytes published
+  uint32_t skipped;     // ticks without a change
+
+  struct Discovery {
+    uint32_t start;       // millis of the last (re)connect
+    uint32_t duration;    // ms to announce all entities, 0 while busy
+    uint32_t heap;        // free heap at the (re)connect
+    uint32_t low;         // lowest free heap while announcing
+  } discovery;
+
+  // register an entity, returns its index to be used with set(). The strings are in flash
+  int add(const char *name, Kind kind, PGM_P label, PGM_P unit, PGM_P device_class, PGM_P icon, uint8_t precision=2);
+  void set(uint8_t idx, float value, bool force=false)  { _set(idx, true, value, force); }
+  void set(uint8_t idx, bool state)                     { _set(idx, true, state ? 1.0f : 0.0f, false); }
+  void invalidate(uint8_t idx)                          { _set(idx, false, 0.0f, false); }
+
+  uint32_t interval() const             { return _interval; }
+  void interval(uint32_t ms)            { _interval = ms; }
+  bool discovering() const              { return _discover >= 0; }
+  bool loop();                          // announce the entities, or publish the document when changed and due
+  bool publish();                       // publish the document now
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
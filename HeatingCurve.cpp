@@ -1,8 +1,10 @@
-#include "SmartControl.h"
+#include "HeatingCurve.h"
 #define LOG_REMOTE
 #define LOG_LEVEL 3
 #include <Logging.h>
 #include <Timer.h>
+#include "BinLog.h"
+#include "Zones.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
@@ -21,6 +23,7 @@ HeatingCurve::HeatingCurve() {
   _factorB = INSIDE_FACTOR;         // inside
   _factorC = CURVE_FACTOR;          // curve
   _factor  = _factorA;              // inital factor is set to baseline 
+  _solar   = 0.0f;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -29,7 +32,7 @@ float HeatingCurve::factorA(float newval) {
   float oldval = _factorA;
   if (newval >= 0.0f && newval <= 1.5f) {
     _factorA = newval;
-    INFO("Changed heatingcurve factorA from %0.2f to %0.2f", oldval, newval);
+    BLOG_INFO(CURVE_FACTOR_A, oldval, newval);
   }
   return oldval;
 }
@@ -37,7 +40,7 @@ float HeatingCurve::factorB(float newval) {
   float oldval = _factorB;
   if (newval >= 0.0f && newval <= 1.5f) {
     _factorB = newval;
-    INFO("Changed heatingcurve factorB from %0.2f to %0.2f", oldval, newval);
+    BLOG_INFO(CURVE_FACTOR_B, oldval, newval);
   }
   return oldval;
 }
@@ -45,7 +48,7 @@ float HeatingCurve::factorC(float newval) {
   float oldval = _factorC;
   if (newval >= 0.0f && newval <= 1.5f) {
     _factorC = newval;
-    INFO("Changed heatingcurve factorC from %0.2f to %0.2f", oldval, newval);
+    BLOG_INFO(CURVE_FACTOR_C, oldval, newval);
   }
   return oldval;
 }
@@ -53,15 +56,18 @@ float HeatingCurve::factorC(float newval) {
 ////////////////////////////////////////////////////////////////////////////////////////////
 // returns setpoint
 // TODO: add cooling when outside is higher than inside
-float HeatingCurve::calculate(Temperature *Tcurrent, Temperature *Ttarget, Temperature *Toutside)
+float HeatingCurve::calculate(Temperature *Tcurrent, Temperature *Ttarget, Temperature *Toutside, float solar)
 {
-  float current = Tcurrent->average();    // Diff
-  float outside = Toutside->average();    // Diff
+  float current = Tcurrent->estimate();   // low lag, the average without an estimator
+  float outside = Toutside->estimate();
   float target  = Ttarget->average();     // to apply a smooth change 
+  float error;
+  if (Zones::instance() && Zones::instance()->error(error))
+    current = target + error;             // the rooms, each against its own target
 
   double delta_outside  = target - outside; // in summer this can be negative
   double delta_inside   = target - current; // this can be negative due to cooking, fireplace, people, and sunshine !
-  INFO("roomcur:%.2f, roomset:%.2f, outside:%.2f, deltaT-out:%.2f, deltaT-in:%.2f", current, target, outside, delta_outside, delta_inside);
+  BLOG_INFO(CURVE_INPUT, current, target, outside, delta_outside, delta_inside);
 
   // first we calculate the factor (we use a double for precision)
   double factor =  _factorB *delta_inside;  // use factor B for the delta inside
@@ -84,7 +90,17 @@ float HeatingCurve::calculate(Temperature *Tcurrent, Temperature *Ttarget, Tempe
   // the requested water temperature is the target roomtemp + the resulting factor * the total deltaT (target room - outside + target room - current room)
   float setpoint = target + factor * curve;
   _factor = factor;
-  INFO("Set point using factor:%.5f, setpoint:%.2f", _factor, setpoint);
+
+  // the sun will heat the house, only lower the heating and never below the target
+  _solar = 0.0f;
+  if (solar > 0.0f && delta_outside > 0) {
+    _solar = setpoint - target < solar ? setpoint - target : solar;
+    if (_solar < 0.0f)
+      _solar = 0.0f;
+    setpoint -= _solar;
+    BLOG_INFO(CURVE_SOLAR, solar, _solar);
+  }
+  BLOG_INFO(CURVE_SETPOINT, _factor, setpoint);
 
   return setpoint;
 }
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Temperature.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The water temperature for the inside, target and outside temperature. Apart from
+// SmartControl.h, so the tools build it on the host without OpenTherm.
+////////////////////////////////////////////////////////////////////////////////////////////
+class HeatingCurve
+{
+private:
+  float _factorA, _factorB, _factorC, _factor;
+  float _solar;     // the setpoint was lowered by
+public:
+  HeatingCurve();
+  inline float current_factor() const { return _factor; }; 
+  inline float solar_offset() const { return _solar; };
+  //returns current value, or if a valid (0<-->1.5) newval is given it will change the value and return the previous one
+  float factorA(float newval=-1.0f);  // value used to keep the house warm, based on Ttarget - Toutside
+  float factorB(float newval=-1.0f);  // value used to heat/cool the house, based on Ttarget - Tcurrent
+  float factorC(float newval=-1.0f);  // the factor used for the curve, the leniar factor will be set to 1-curve by which the 20 and 0 degrees are aligned
+
+  float calculate(Temperature *current, Temperature *target, Temperature *outside, float solar=0.0f); // returns setpoint, solar lowers it
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
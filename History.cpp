@@ -0,0 +1,334 @@
+#include "History.h"
+#include "SmartControl.h"
+#include "ConfigStore.h"
+#include "Format.h"
+#include <HAMqtt.h>
+#include <Clock.h>
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+
+#define HISTORY_VERSION   1
+#define HISTORY_NO_DATA   INT16_MIN
+
+extern Clock rtc;
+
+#define HISTORY_NAME(name, scale, valid, value)     #name,
+#define HISTORY_SCALE(name, scale, valid, value)    scale,
+#define HISTORY_VALUE(name, scale, valid, value) \
+  if (valid) _minute[ch].add((int16_t) lroundf((value) * scale)); \
+  ch++;
+
+static const char   *_history_names[] = { HISTORY_CHANNELS(HISTORY_NAME) };
+static const uint8_t _history_scales[] = { HISTORY_CHANNELS(HISTORY_SCALE) };
+static const char   *_history_tiers[] = { "1m", "15m", "1h" };
+
+// the hourly tier, 78 records per sector so 16 sectors hold about 52 days
+uint32_t    history_data[(sizeof(History::Hour) + 3) / 4];
+EspFlash    history_flash(FLASH_HISTORY);
+ConfigStore history_store(history_flash, HISTORY_VERSION, sizeof(History::Hour), history_data);
+
+static_assert(sizeof(History) <= HISTORY_RAM_BUDGET, "History exceeds its ram budget");
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+History *_history = 0;
+History *History::instance() { return _history; }
+
+const char *History::name(uint8_t channel) {
+  return channel < HISTORY_CHANNEL_COUNT ? _history_names[channel] : "unknown";
+}
+
+int8_t History::channel(const char *name)
+{
+  for (uint8_t i=0; i<HISTORY_CHANNEL_COUNT; i++)
+    if (strcmp(name, _history_names[i]) == 0)
+      return i;
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+void HistoryAggregate::add(const HistoryAggregate &a)
+{
+  if (a.count == 0)
+    return;
+  if (a.min < min) min = a.min;
+  if (a.max > max) max = a.max;
+  sum += a.sum;
+  count += a.count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+HistoryTier::HistoryTier(Entry *entries, uint16_t size, uint32_t interval)
+{
+  _entries = entries;
+  _size = size;
+  _interval = interval;
+  _head = _count = 0;
+  _newest_time = 0;
+  memset(_base, 0, sizeof(_base));
+  memset(_newest, 0, sizeof(_newest));
+}
+
+uint8_t HistoryTier::spread(int32_t distance)
+{
+  if (distance <= 0)
+    return 0;
+  if (distance <= 127)
+    return distance;
+  int32_t code = 127 + (distance - 127 + 7) / 8;
+  return code < 254 ? code : 254;
+}
+
+int16_t HistoryTier::distance(uint8_t spread)
+{
+  return spread <= 127 ? spread : 127 + (spread - 127) * 8;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// When full the oldest entry is dropped into the base. A channel without data yet has its
+// mean at 0, its first delta is then its full value.
+////////////////////////////////////////////////////////////////////////////////////////////
+void HistoryTier::push(const HistoryAggregate *channels, uint32_t time)
+{
+  uint16_t pos;
+  if (_count == _size)
+  {
+    for (uint8_t ch=0; ch<HISTORY_CHANNEL_COUNT; ch++)
+      _base[ch] += _entries[_head * HISTORY_CHANNEL_COUNT + ch].delta;
+    pos = _head;
+    _head = (_head + 1) % _size;
+  }
+  else
+    pos = (_head + _count++) % _size;
+
+  for (uint8_t ch=0; ch<HISTORY_CHANNEL_COUNT; ch++)
+  {
+    Entry &e = _entries[pos * HISTORY_CHANNEL_COUNT + ch];
+    const HistoryAggregate &a = channels[ch];
+    if (a.count == 0) {
+      e.delta = 0;              // the mean carries over
+      e.below = e.above = 0xFF;
+      continue;
+    }
+    int16_t mean = a.mean();
+    e.delta = mean - _newest[ch];
+    _newest[ch] = mean;
+    e.below = spread((int32_t) mean - a.min);
+    e.above = spread((int32_t) a.max - mean);
+  }
+  _newest_time = time;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+History::History()
+: _minutes(_minute_entries, HISTORY_MINUTES, 60)
+, _quarters(_quarter_entries, HISTORY_QUARTERS, 15*60)
+, _sample(HISTORY_SAMPLE)
+{
+  _history = this;
+  for (uint8_t ch=0; ch<HISTORY_CHANNEL_COUNT; ch++) {
+    _minute[ch].clear();
+    _quarter[ch].clear();
+    _hour[ch].clear();
+  }
+  _samples = _minutes_done = _quarters_done = 0;
+  _mqtt = 0;
+  hours = queries = 0;
+}
+
+bool History::begin(HAMqtt *mqtt)
+{
+  _mqtt = mqtt;
+  Hour h;
+  ConfigStore::Status status = history_store.load(&h);   // finds the end of the journal
+  INFO("History: %s, last hour record %u", status == ConfigStore::Ok ? "loaded" : "empty", history_store.sequence());
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+void History::_sampleAll(SmartControl *c)
+{
+  uint8_t ch = 0;
+  HISTORY_CHANNELS(HISTORY_VALUE)
+}
+
+void History::_storeHour(uint32_t time)
+{
+  Hour h;
+  memset(&h, 0, sizeof(h));
+  h.time = time;
+  for (uint8_t ch=0; ch<HISTORY_CHANNEL_COUNT; ch++) {
+    bool data = _hour[ch].count > 0;
+    h.min[ch]  = data ? _hour[ch].min : HISTORY_NO_DATA;
+    h.mean[ch] = data ? _hour[ch].mean() : HISTORY_NO_DATA;
+    h.max[ch]  = data ? _hour[ch].max : HISTORY_NO_DATA;
+    _hour[ch].clear();
+  }
+  history_store.set(&h, millis());
+  if (history_store.commit() != ConfigStore::Ok)
+    ERROR("History: could not store the hour in flash");
+  else
+    hours++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Each tier is fed by the aggregate of the tier below, so the mean is exact
+////////////////////////////////////////////////////////////////////////////////////////////
+bool History::loop()
+{
+  if (!_sample)
+    return false;
+  SmartControl *c = SmartControl::instance();
+  if (c == NULL)
+    return false;
+
+  _sampleAll(c);
+  if (++_samples < 60000 / HISTORY_SAMPLE)
+    return true;
+  _samples = 0;
+
+  uint32_t now = rtc.now().unixtime();
+  _minutes.push(_minute, now);
+  for (uint8_t ch=0; ch<HISTORY_CHANNEL_COUNT; ch++) {
+    _quarter[ch].add(_minute[ch]);
+    _minute[ch].clear();
+  }
+  if (++_minutes_done < 15)
+    return true;
+  _minutes_done = 0;
+
+  _quarters.push(_quarter, now);
+  for (uint8_t ch=0; ch<HISTORY_CHANNEL_COUNT; ch++) {
+    _hour[ch].add(_quarter[ch]);
+    _quarter[ch].clear();
+  }
+  if (++_quarters_done < 4)
+    return true;
+  _quarters_done = 0;
+
+  _storeHour(now);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// "<time> <min> <mean> <max>\n", written to the socket or only counted
+////////////////////////////////////////////////////////////////////////////////////////////
+static uint16_t history_line(HAMqtt *out, uint32_t time, uint8_t scale, int16_t min, int16_t mean, int16_t max)
+{
+  char line[48];
+  int n = snprintf(line, sizeof(line), "%u", time);
+  const int16_t values[] = { min, mean, max };
+  for (uint8_t i=0; i<3; i++) {
+    line[n++] = ' ';
+    n += strlen(fmt_fixed(line + n, sizeof(line) - n - 1, (float) values[i] / scale, 2));
+  }
+  line[n++] = '\n';
+  if (out)
+    out->writePayload(line, n);
+  return n;
+}
+
+uint16_t History::_answer(HAMqtt *out, uint8_t channel, uint8_t tier, uint32_t from, uint32_t to)
+{
+  uint8_t scale = _history_scales[channel];
+  uint16_t length = 0, rows = 0;
+  auto in_range = [&](uint32_t time) { return time >= from && (to == 0 || time <= to) && rows < HISTORY_MAX_ROWS; };
+
+  if (tier < 2)
+  {
+    const HistoryTier &t = tier == 0 ? _minutes : _quarters;
+    t.walk(channel, [&](uint16_t i, int16_t min, int16_t mean, int16_t max) {
+      if (!in_range(t.time(i)))
+        return;
+      length += history_line(out, t.time(i), scale, min, mean, max);
+      rows++;
+    });
+    return length;
+  }
+
+  // newest first to where the HISTORY_MAX_ROWS newest rows in range begin, so a long
+  // query is cut at its old end
+  auto wanted = [&](uint32_t back, Hour &h) {
+    return history_store.read(back, &h) && h.mean[channel] != HISTORY_NO_DATA && h.time >= from && (to == 0 || h.time <= to);
+  };
+  uint32_t stored = min(history_store.sequence(), history_store.capacity());
+  uint32_t back = 0;
+  Hour h;
+  for (uint16_t found = 0; back < stored && found < HISTORY_MAX_ROWS; back++)
+    if (wanted(back, h))
+      found++;
+  while (back-- > 0)    // oldest first
+  {
+    if (!wanted(back, h))
+      continue;
+    length += history_line(out, h.time, scale, h.min[channel], h.mean[channel], h.max[channel]);
+    rows++;
+  }
+  return length;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// First pass for the length, second pass into the socket
+////////////////////////////////////////////////////////////////////////////////////////////
+bool History::query(uint8_t channel, uint8_t tier, uint32_t from, uint32_t to)
+{
+  if (_mqtt == 0 || !_mqtt->isConnected() || channel >= HISTORY_CHANNEL_COUNT || tier > 2)
+    return false;
+
+  char topic[48];
+  snprintf(topic, sizeof(topic), HISTORY_TOPIC "/%s/%s", _history_names[channel], _history_tiers[tier]);
+  uint16_t length = _answer(NULL, channel, tier, from, to);
+  if (!_mqtt->beginPublish(topic, length, false))
+    return false;
+  _answer(_mqtt, channel, tier, from, to);
+  queries++;
+  return _mqtt->endPublish();
+}
+
+bool History::subscribe(HAMqtt *mqtt)
+{
+  return mqtt->subscribe(HISTORY_GET_TOPIC);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// "<channel> <1m|15m|1h> [from] [to]"
+////////////////////////////////////////////////////////////////////////////////////////////
+bool History::onMessage(const char *topic, const uint8_t *payload, uint16_t length)
+{
+  if (strcmp(topic, HISTORY_GET_TOPIC) != 0)
+    return false;
+
+  char buf[64], name[16], tier_name[8];
+  unsigned long from = 0, to = 0;
+  if (length >= sizeof(buf))
+    length = sizeof(buf) -1;
+  memcpy(buf, payload, length);
+  buf[length] = '\0';
+
+  if (sscanf(buf, "%15s %7s %lu %lu", name, tier_name, &from, &to) < 2) {
+    ERROR("History: expected '<channel> <1m|15m|1h> [from] [to]'");
+    return true;
+  }
+  int8_t ch = channel(name);
+  int8_t tier = -1;
+  for (uint8_t i=0; i<3; i++)
+    if (strcmp(tier_name, _history_tiers[i]) == 0)
+      tier = i;
+  if (ch < 0 || tier < 0) {
+    ERROR("History: unknown channel %s or tier %s", name, tier_name);
+    return true;
+  }
+  if (!query(ch, tier, from, to))
+    ERROR("History: could not publish %s %s", name, tier_name);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
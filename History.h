@@ -0,0 +1,150 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Timer.h>
+
+class HAMqtt;
+class SmartControl;
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// On-device history in three tiers of min / mean / max: 1 minute and 15 minutes in ram,
+// 1 hour in a flash journal. Values are int16 in units of 1/scale (0.05 C, 0.5 %).
+// A ram tier stores per entry the mean as an int16 delta on the previous mean and the min
+// and max as distance below and above the mean in a byte each, 4 bytes instead of 6. The
+// distance is exact up to 127 and in steps of 8 above, rounded outwards, so a defrost still
+// fits. Only the mean before the oldest entry and of the newest entry are kept in full.
+//
+// Query with "<channel> <1m|15m|1h> [from] [to]" (unixtime) on SmartTherm/history/get, the
+// answer is published on SmartTherm/history/<channel>/<tier> as lines "<time> <min> <mean> <max>"
+////////////////////////////////////////////////////////////////////////////////////////////
+#define HISTORY_CHANNELS(X) \
+  X(inside,   20, c->inside.valid(),    c->inside.get())    \
+  X(outside,  20, c->outside.valid(),   c->outside.get())   \
+  X(setpoint, 20, c->setpoint.valid(),  c->setpoint.get())  \
+  X(inlet,    20, c->inlet.valid(),     c->inlet.get())     \
+  X(outlet,   20, c->outlet.valid(),    c->outlet.get())    \
+  X(modlvl,   2,  true,                 c->ModLvl)
+
+#define HISTORY_COUNT(name, scale, valid, value)  +1
+#define HISTORY_CHANNEL_COUNT  (0 HISTORY_CHANNELS(HISTORY_COUNT))
+
+#define HISTORY_SAMPLE      (10*1000)       // sample each 10 seconds
+#define HISTORY_MINUTES     60              // 1 hour of 1 minute entries
+#define HISTORY_QUARTERS    96              // 1 day of 15 minute entries
+#define HISTORY_MAX_ROWS    200             // per answer
+#define HISTORY_RAM_BUDGET  4300            // bytes, see the static_assert in History.cpp
+#define HISTORY_TOPIC       "SmartTherm/history"
+#define HISTORY_GET_TOPIC   "SmartTherm/history/get"
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Samples combined into min / mean / max
+////////////////////////////////////////////////////////////////////////////////////////////
+struct HistoryAggregate
+{
+  int16_t  min, max;
+  int32_t  sum;
+  uint16_t count;
+
+  void clear()                              { min = INT16_MAX; max = INT16_MIN; sum = 0; count = 0; }
+  void add(int16_t v)                       { if (v < min) min = v; if (v > max) max = v; sum += v; count++; }
+  void add(const HistoryAggregate &a);
+  int16_t mean() const                      { return count ? (int16_t) (sum / count) : 0; }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Ring of delta encoded entries for all channels
+////////////////////////////////////////////////////////////////////////////////////////////
+class HistoryTier
+{
+public:
+  struct Entry {
+    int16_t delta;          // mean minus the previous mean
+    uint8_t below, above;   // min and max relative to the mean (spread()), 0xFF for no data
+  };
+  static uint8_t spread(int32_t distance);    // exact up to 127, rounded up above
+  static int16_t distance(uint8_t spread);
+private:
+  Entry    *_entries;       // [size][channels]
+  uint16_t  _size;
+  uint16_t  _head;          // oldest entry
+  uint16_t  _count;
+  uint32_t  _interval;      // seconds
+  uint32_t  _newest_time;
+  int16_t   _base[HISTORY_CHANNEL_COUNT];     // mean before the oldest entry
+  int16_t   _newest[HISTORY_CHANNEL_COUNT];
+public:
+  HistoryTier(Entry *entries, uint16_t size, uint32_t interval);
+
+  void push(const HistoryAggregate *channels, uint32_t time);
+  // walks from the oldest to the newest entry, returns the number of entries
+  template<typename F> uint16_t walk(uint8_t channel, F visit) const;
+  uint16_t count() const                    { return _count; }
+  uint32_t interval() const                 { return _interval; }
+  uint32_t time(uint16_t i) const           { return _newest_time - (uint32_t) (_count - 1 - i) * _interval; }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// visit(i, min, mean, max) for each entry with data, the mean is rebuilt from the deltas
+////////////////////////////////////////////////////////////////////////////////////////////
+template<typename F>
+uint16_t HistoryTier::walk(uint8_t channel, F visit) const
+{
+  int16_t mean = _base[channel];
+  for (uint16_t i=0; i<_count; i++)
+  {
+    const Entry &e = _entries[((_head + i) % _size) * HISTORY_CHANNEL_COUNT + channel];
+    mean += e.delta;
+    if (e.below != 0xFF || e.above != 0xFF)
+      visit(i, (int16_t) (mean - distance(e.below)), mean, (int16_t) (mean + distance(e.above)));
+  }
+  return _count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+class History
+{
+public:
+  struct Hour {             // a record in the flash journal
+    uint32_t time;
+    int16_t  min[HISTORY_CHANNEL_COUNT];
+    int16_t  mean[HISTORY_CHANNEL_COUNT];
+    int16_t  max[HISTORY_CHANNEL_COUNT];
+  };
+
+private:
+  HistoryTier::Entry _minute_entries[HISTORY_MINUTES * HISTORY_CHANNEL_COUNT];
+  HistoryTier::Entry _quarter_entries[HISTORY_QUARTERS * HISTORY_CHANNEL_COUNT];
+  HistoryTier       _minutes;
+  HistoryTier       _quarters;
+  HistoryAggregate  _minute[HISTORY_CHANNEL_COUNT];
+  HistoryAggregate  _quarter[HISTORY_CHANNEL_COUNT];
+  HistoryAggregate  _hour[HISTORY_CHANNEL_COUNT];
+  Periodic  _sample;
+  uint8_t   _samples;       // in the current minute
+  uint8_t   _minutes_done;  // in the current quarter
+  uint8_t   _quarters_done; // in the current hour
+  HAMqtt   *_mqtt;
+
+  void _sampleAll(SmartControl *c);
+  void _storeHour(uint32_t time);
+  uint16_t _answer(HAMqtt *out, uint8_t channel, uint8_t tier, uint32_t from, uint32_t to);
+public:
+  History();
+  static History *instance();
+  static int8_t channel(const char *name);
+  static const char *name(uint8_t channel);
+
+  uint32_t hours;           // hours stored in flash since boot
+  uint32_t queries;
+
+  bool begin(HAMqtt *mqtt);
+  bool loop();
+  bool query(uint8_t channel, uint8_t tier, uint32_t from, uint32_t to);   // tier 0, 1 or 2
+  bool subscribe(HAMqtt *mqtt);
+  bool onMessage(const char *topic, const uint8_t *payload, uint16_t length);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
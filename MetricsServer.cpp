@@ -0,0 +1,275 @@
+#include "MetricsServer.h"
+#include "SmartControl.h"
+#include "Scheduler.h"
+#include "Diagnostics.h"
+#include "Format.h"
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+
+#define METRICS_NAME    28
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The families in flash
+struct MetricsFamily {
+  char    name[METRICS_NAME];
+  char    type[8];
+  uint8_t source;
+};
+#define METRICS_ROW(id, name, type, source)  { name, type, MetricsServer::source },
+
+static const MetricsFamily _families[] PROGMEM = { METRICS_FAMILIES(METRICS_ROW) };
+
+static const char _found_header[] PROGMEM =
+  "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n";
+static const char _missing_header[] PROGMEM =
+  "HTTP/1.0 404 Not Found\r\nConnection: close\r\n\r\n";
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+MetricsServer *_metrics = 0;
+MetricsServer *MetricsServer::instance() { return _metrics; }
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+MetricsServer::MetricsServer(uint16_t port)
+: _server(port)
+{
+  _metrics = this;
+  _state = Idle;
+  memset(_probes, 0, sizeof(_probes));
+  _request[0] = '\0';
+  _request_len = _newlines = 0;
+  _len = _sent = 0;
+  _family = _item = 0;
+  _found = false;
+  scrapes = errors = worst_us = 0;
+}
+
+bool MetricsServer::begin()
+{
+  SmartControl *c = SmartControl::instance();
+  if (c == NULL)
+    return false;
+  Probe probes[METRICS_TEMPERATURES] = {
+    { "inside",   &c->inside },
+    { "target",   &c->target },
+    { "setpoint", &c->setpoint },
+    { "inlet",    &c->inlet },
+    { "outlet",   &c->outlet },
+    { "outside",  &c->outside },
+    { "board",    &c->board },
+  };
+  memcpy(_probes, probes, sizeof(_probes));
+  _server.begin();
+  _server.setNoDelay(true);
+  INFO("Metrics: serving on port %d", METRICS_PORT);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Only the request line is kept, the rest of the header is skipped up to the empty line
+////////////////////////////////////////////////////////////////////////////////////////////
+bool MetricsServer::_read()
+{
+  while (_client.available())
+  {
+    int ch = _client.read();
+    if (ch < 0)
+      return false;
+    if (ch == '\r')
+      continue;
+    if (ch == '\n') {
+      _request_len = sizeof(_request);    // the request line is complete
+      if (++_newlines == 2)
+        return true;
+      continue;
+    }
+    _newlines = 0;
+    if (_request_len < sizeof(_request) -1) {
+      _request[_request_len++] = ch;
+      _request[_request_len] = '\0';
+    }
+  }
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+uint8_t MetricsServer::_items(uint8_t family) const
+{
+  SmartControl *c = SmartControl::instance();
+  Scheduler *s = Scheduler::instance();
+  switch (pgm_read_byte(&_families[family].source))
+  {
+  case Temperatures:  return METRICS_TEMPERATURES;
+  case DataIds:       return c ? c->ot_ids() : 0;
+  case Tasks:         return s ? s->count() : 0;
+  default:            return 1;
+  }
+}
+
+uint16_t MetricsServer::_label(char *buf, uint16_t size, uint8_t family, uint8_t item) const
+{
+  SmartControl *c = SmartControl::instance();
+  uint8_t id = 0;
+  switch (pgm_read_byte(&_families[family].source))
+  {
+  case Temperatures:
+    return snprintf_P(buf, size, PSTR("{sensor=\"%s\"}"), _probes[item].name);
+  case DataIds:
+    c->ot_counters(item, id);
+    return snprintf_P(buf, size, PSTR("{id=\"%u\"}"), id);
+  case Tasks:
+    return snprintf_P(buf, size, PSTR("{task=\"%s\"}"), Scheduler::instance()->task(item).name);
+  default:
+    buf[0] = '\0';
+    return 0;
+  }
+}
+
+uint16_t MetricsServer::_value(char *buf, uint16_t size, uint8_t family, uint8_t item) const
+{
+  SmartControl *c = SmartControl::instance();
+  Scheduler *s = Scheduler::instance();
+  Diagnostics *d = Diagnostics::instance();
+  const Temperature *t = family <= MF_TEMP_AGE ? _probes[item].temperature : NULL;
+  uint8_t id;
+  const OTCounters *ot = (family >= MF_OT_REQUESTS && family <= MF_OT_TIMEOUTS) ? c->ot_counters(item, id) : NULL;
+  const Scheduler::Task *task = (family >= MF_TASK_RUNS && family <= MF_TASK_WORST) ? &s->task(item) : NULL;
+  uint32_t v = 0;
+  switch (family)
+  {
+  case MF_TEMP_VALUE:   return strlen(fmt_fixed(buf, size, t->get(), 2));
+  case MF_TEMP_TREND:   return strlen(fmt_fixed(buf, size, t->trend(), 3));
+  case MF_TEMP_VALID:   v = t->valid() ? 1 : 0;       break;
+  case MF_TEMP_AGE:     v = t->age() / 1000;          break;
+  case MF_OT_REQUESTS:  v = ot->requests;             break;
+  case MF_OT_RESPONSES: v = ot->responses;            break;
+  case MF_OT_INVALID:   v = ot->invalid;              break;
+  case MF_OT_TIMEOUTS:  v = ot->timeouts;             break;
+  case MF_OT_ERRORS:    v = c->communication_errors;  break;
+  case MF_OT_FRAMES:    v = c->frames;                break;
+  case MF_TASK_RUNS:    v = task->runs;               break;
+  case MF_TASK_OVERRUNS: v = task->overruns;          break;
+  case MF_TASK_WORST:   v = task->worst;              break;
+  case MF_LOOP_PASSES:  v = s ? s->passes() : 0;      break;
+  case MF_HEAP_FREE:    v = d ? d->heap.free : 0;     break;
+  case MF_HEAP_BLOCK:   v = d ? d->heap.max_block : 0; break;
+  case MF_HEAP_FRAG:    v = d ? d->heap.fragmentation : 0; break;
+  case MF_HEAP_MIN:     v = d ? d->heap.min_free : 0; break;
+  case MF_STACK_FREE:   v = d ? d->stack_free : 0;    break;
+  case MF_UPTIME:       v = millis() / 1000;          break;
+  case MF_SCRAPES:      v = scrapes;                  break;
+  case MF_SCRAPE_WORST: v = worst_us;                 break;
+  }
+  return snprintf_P(buf, size, PSTR("%u"), v);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The type line goes with the first metric of its family
+////////////////////////////////////////////////////////////////////////////////////////////
+bool MetricsServer::_render()
+{
+  if (!_found)
+    return false;
+  while (_family < MF_COUNT && _item >= _items(_family)) {
+    _family++;
+    _item = 0;
+  }
+  if (_family >= MF_COUNT)
+    return false;
+
+  MetricsFamily f;
+  memcpy_P(&f, &_families[_family], sizeof(f));
+  char label[24], value[16];
+  _label(label, sizeof(label), _family, _item);
+  _value(value, sizeof(value), _family, _item);
+
+  int n = 0;
+  if (_item == 0)
+    n = snprintf_P(_line, sizeof(_line), PSTR("# TYPE smarttherm_%s %s\n"), f.name, f.type);
+  n += snprintf_P(_line + n, sizeof(_line) - n, PSTR("smarttherm_%s%s %s\n"), f.name, label, value);
+  _len = n < (int) sizeof(_line) ? n : sizeof(_line) -1;
+  _sent = 0;
+  _item++;
+  return true;
+}
+
+void MetricsServer::_close(bool complete)
+{
+  if (complete)
+    _client.stop(METRICS_FLUSH);  // acked, so a FIN without waiting
+  else
+    _client.abort();              // nothing left worth waiting for
+  _state = Idle;
+  if (complete)
+    scrapes += _found ? 1 : 0;    // a 404 is neither
+  else {
+    errors++;
+    DEBUG("Metrics: scrape aborted (%s)", _request);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Bounded by METRICS_BUDGET_US and by the room in the socket, the rest in the next loop
+////////////////////////////////////////////////////////////////////////////////////////////
+bool MetricsServer::loop()
+{
+  uint32_t start = micros();
+  if (_state == Idle)
+  {
+    _client = _server.accept();
+    if (!_client)
+      return false;
+    _state = Request;
+    _timeout.set(METRICS_TIMEOUT);
+    _request[0] = '\0';
+    _request_len = _newlines = 0;
+  }
+  if (_state == Closing) {        // all written, close once the client has it
+    if (_client.flush(METRICS_FLUSH) || !_client.connected())
+      _close(true);
+    else if (_timeout.passed())
+      _close(false);
+    return _state != Idle;
+  }
+  if (_timeout.passed() || !_client.connected()) {
+    _close(false);
+    return false;
+  }
+  if (_state == Request)
+  {
+    if (!_read())
+      return true;
+    _found = strncmp(_request, "GET /metrics", 12) == 0 || strncmp(_request, "GET / ", 6) == 0;
+    strncpy_P(_line, _found ? _found_header : _missing_header, sizeof(_line));
+    _line[sizeof(_line) -1] = '\0';
+    _len = strlen(_line);
+    _sent = 0;
+    _family = _item = 0;
+    _state = Respond;
+  }
+  while (micros() - start < METRICS_BUDGET_US)
+  {
+    if (_sent >= _len && !_render()) {
+      _state = Closing;
+      break;
+    }
+    size_t room = _client.availableForWrite();
+    if (room == 0)
+      break;
+    if (room > (size_t) (_len - _sent))
+      room = _len - _sent;
+    _sent += _client.write((const uint8_t *) _line + _sent, room);
+  }
+  uint32_t spent = micros() - start;
+  if (spent > worst_us)
+    worst_us = spent;
+  return _state != Idle;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <Timer.h>
+
+class Temperature;
+
+#define METRICS_PORT          9100
+#define METRICS_BUDGET_US     2000        // per loop, then the other tasks get their turn
+#define METRICS_TIMEOUT       (5*1000)    // ms for a scrape to complete
+#define METRICS_FLUSH         1           // ms per loop waiting for the acks before the close
+#define METRICS_LINE          160         // one metric (and its type) at a time
+#define METRICS_REQUEST       32          // characters kept of the request line
+#define METRICS_TEMPERATURES  7
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Families in the order of the response, prefixed with "smarttherm_". The source tells what
+// the family iterates: the temperatures, the DataIds of the OT script or the tasks.
+////////////////////////////////////////////////////////////////////////////////////////////
+#define METRICS_FAMILIES(X) \
+  X(TEMP_VALUE,     "temperature_celsius",        "gauge",    Temperatures) \
+  X(TEMP_VALID,     "temperature_valid",          "gauge",    Temperatures) \
+  X(TEMP_TREND,     "temperature_trend",          "gauge",    Temperatures) \
+  X(TEMP_AGE,       "temperature_age_seconds",    "gauge",    Temperatures) \
+  X(OT_REQUESTS,    "ot_requests_total",          "counter",  DataIds)      \
+  X(OT_RESPONSES,   "ot_responses_total",         "counter",  DataIds)      \
+  X(OT_INVALID,     "ot_invalid_total",           "counter",  DataIds)      \
+  X(OT_TIMEOUTS,    "ot_timeouts_total",          "counter",  DataIds)      \
+  X(OT_ERRORS,      "ot_communication_errors",    "gauge",    Single)       \
+  X(OT_FRAMES,      "ot_frames_total",            "counter",  Single)       \
+  X(TASK_RUNS,      "task_runs_total",            "counter",  Tasks)        \
+  X(TASK_OVERRUNS,  "task_overruns_total",        "counter",  Tasks)        \
+  X(TASK_WORST,     "task_worst_microseconds",    "gauge",    Tasks)        \
+  X(LOOP_PASSES,    "loop_passes_total",          "counter",  Single)       \
+  X(HEAP_FREE,      "heap_free_bytes",            "gauge",    Single)       \
+  X(HEAP_BLOCK,     "heap_max_block_bytes",       "gauge",    Single)       \
+  X(HEAP_FRAG,      "heap_fragmentation_percent", "gauge",    Single)       \
+  X(HEAP_MIN,       "heap_min_free_bytes",        "gauge",    Single)       \
+  X(STACK_FREE,     "stack_free_bytes",           "gauge",    Single)       \
+  X(UPTIME,         "uptime_seconds",             "counter",  Single)       \
+  X(SCRAPES,        "metrics_scrapes_total",      "counter",  Single)       \
+  X(SCRAPE_WORST,   "metrics_worst_microseconds", "gauge",    Single)
+
+#define METRICS_ENUM(id, name, type, source)    MF_##id,
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Prometheus text endpoint on the LAN, for when the MQTT broker is down. One client at a
+// time: the request is read and the response is written by the loop, one metric at a time
+// from a static line buffer, no more than fits the socket and no longer than the budget.
+// So a scrape takes several loops but never delays the OT task by more than the budget.
+// The close waits for the acks in the loops too, stop() would block up to 300 ms for them.
+////////////////////////////////////////////////////////////////////////////////////////////
+class MetricsServer
+{
+public:
+  enum State : uint8_t { Idle, Request, Respond, Closing };
+  enum Family : uint8_t { METRICS_FAMILIES(METRICS_ENUM) MF_COUNT };
+  enum Source : uint8_t { Temperatures, DataIds, Tasks, Single };
+
+private:
+  struct Probe {
+    const char        *name;
+    const Temperature *temperature;
+  };
+  WiFiServer  _server;
+  WiFiClient  _client;
+  State       _state;
+  Timer       _timeout;
+  Probe       _probes[METRICS_TEMPERATURES];
+  char        _request[METRICS_REQUEST];
+  uint8_t     _request_len;
+  uint8_t     _newlines;            // successive, the empty line ends the header
+  char        _line[METRICS_LINE];
+  uint16_t    _len, _sent;          // of the line
+  uint8_t     _family, _item;       // next metric
+  bool        _found;               // the request was for the metrics
+
+  bool _read();
+  bool _render();                   // the next metric into the line, false when done
+  uint8_t _items(uint8_t family) const;
+  uint16_t _label(char *buf, uint16_t size, uint8_t family, uint8_t item) const;
+  uint16_t _value(char *buf, uint16_t size, uint8_t family, uint8_t item) const;
+  void _close(bool complete);
+public:
+  MetricsServer(uint16_t port=METRICS_PORT);
+  static MetricsServer *instance();
+
+  uint32_t scrapes;
+  uint32_t errors;                  // timed out or lost
+  uint32_t worst_us;                // longest loop while serving
+
+  bool begin();
+  bool loop();                      // returns true while serving
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,206 @@
+#include "NtpSync.h"
+#include <ESP8266WiFi.h>
+#include <Clock.h>
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+#include "Format.h"
+
+extern Clock rtc;
+
+#define NTP_PACKET_SIZE   48
+#define NTP_UNIX_EPOCH    2208988800UL      // seconds from 1900 to 1970
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+NtpSync *_ntpsync = 0;
+NtpSync *NtpSync::instance() { return _ntpsync; }
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+NtpSync::NtpSync()
+: _correct(NTP_CORRECT)
+{
+  _ntpsync = this;
+  _host = NTP_SERVER;
+  _resolved = false;
+  _state = Idle;
+  _sent = 0;
+  _synced = false;
+  _ref_utc = 0;
+  _ref_millis = 0;
+  syncs = timeouts = corrections = latency = 0;
+  offset = 0;
+  drift = 0.0f;
+}
+
+bool NtpSync::begin(const char *host)
+{
+  _host = host;
+  _next.set(0);
+  return _udp.begin(NTP_LOCAL_PORT) != 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Server time since the last sync, corrected for the drift
+////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t NtpSync::utc() const
+{
+  uint32_t elapsed = millis() - _ref_millis;
+  return _ref_utc + elapsed - (int64_t) (elapsed * drift / 1.0e6f);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// EU summer time from the last sunday of march until the last sunday of october, 01:00 UTC
+////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t NtpSync::local(uint32_t utc)
+{
+  uint16_t year = DateTime(utc).year();
+  DateTime march(year, 3, 31), october(year, 10, 31);
+  uint32_t start = DateTime(year, 3, 31 - march.dayOfTheWeek(), 1).unixtime();
+  uint32_t end = DateTime(year, 10, 31 - october.dayOfTheWeek(), 1).unixtime();
+
+  utc += NTP_TIMEZONE * 3600UL;
+  if (utc >= start + NTP_TIMEZONE * 3600UL && utc < end + NTP_TIMEZONE * 3600UL)
+    utc += 3600UL;
+  return utc;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The transmit timestamp holds our millis(), the server echoes it as originate timestamp
+////////////////////////////////////////////////////////////////////////////////////////////
+bool NtpSync::_request()
+{
+  if (!_resolved) {
+    // the only blocking call, once (and after repeated timeouts) instead of each request
+    if (!WiFi.hostByName(_host, _server)) {
+      ERROR("NTP: could not resolve %s", _host);
+      _next.set(NTP_RETRY);
+      return false;
+    }
+    _resolved = true;
+  }
+
+  uint8_t packet[NTP_PACKET_SIZE];
+  memset(packet, 0, sizeof(packet));
+  packet[0] = 0x1B;   // LI 0, version 3, client
+  _sent = millis();
+  memcpy(packet + 40, &_sent, sizeof(_sent));
+
+  while (_udp.parsePacket() > 0)    // stale replies
+    _udp.flush();
+  if (!_udp.beginPacket(_server, NTP_PORT) || _udp.write(packet, sizeof(packet)) != sizeof(packet) || !_udp.endPacket()) {
+    ERROR("NTP: could not send the request");
+    _next.set(NTP_RETRY);
+    return false;
+  }
+  _timeout.set(NTP_TIMEOUT);
+  _state = Waiting;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+static uint64_t ntp_ms(const uint8_t *ts)   // 32.32 fixed point since 1900 to ms since 1970
+{
+  uint32_t secs = (uint32_t) ts[0] << 24 | (uint32_t) ts[1] << 16 | (uint32_t) ts[2] << 8 | ts[3];
+  uint32_t frac = (uint32_t) ts[4] << 24 | (uint32_t) ts[5] << 16 | (uint32_t) ts[6] << 8 | ts[7];
+  return (uint64_t) (secs - NTP_UNIX_EPOCH) * 1000 + (((uint64_t) frac * 1000) >> 32);
+}
+
+bool NtpSync::_reply()
+{
+  if (_udp.parsePacket() < NTP_PACKET_SIZE)
+    return false;
+
+  uint32_t received = millis();
+  uint8_t packet[NTP_PACKET_SIZE];
+  _udp.read(packet, sizeof(packet));
+  if (memcmp(packet + 24, &_sent, sizeof(_sent)) != 0 || (packet[1] == 0)) {
+    DEBUG("NTP: ignored reply (stale or kiss of death)");
+    return false;
+  }
+
+  uint64_t t2 = ntp_ms(packet + 32);    // server receive
+  uint64_t t3 = ntp_ms(packet + 40);    // server transmit
+  uint32_t roundtrip = received - _sent;
+  uint32_t server = (uint32_t) (t3 - t2);
+  latency = roundtrip > server ? roundtrip - server : 0;
+  uint64_t now = t3 + latency / 2;
+
+  if (_synced)
+  {
+    offset = (int32_t) (int64_t) (now - utc());
+    uint32_t span = received - _ref_millis;
+    if (span >= NTP_MIN_SPAN)
+    {
+      int64_t error = (int64_t) span - (int64_t) (now - _ref_utc);    // ms the millis() gained
+      float ppm = error * 1.0e6f / span;
+      if (fabsf(ppm) < NTP_MAX_DRIFT)
+        drift = syncs > 1 ? 0.75f * drift + 0.25f * ppm : ppm;
+      else
+        ERROR("NTP: drift of %0.1f ppm ignored", ppm);
+    }
+  }
+  _ref_utc = now;
+  _ref_millis = received;
+  _synced = true;
+  syncs++;
+  _adjust(now);
+
+  char ts[20];
+  INFO("NTP: clock synchronized to %s, latency %u ms, offset %d ms, drift %0.1f ppm",
+    fmt_timestamp(ts, sizeof(ts), rtc.now()), latency, offset, drift);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The Clock has a resolution of seconds, only adjust it when a second is crossed
+////////////////////////////////////////////////////////////////////////////////////////////
+bool NtpSync::_adjust(uint64_t utc_ms)
+{
+  uint32_t now = local((uint32_t) ((utc_ms + 500) / 1000));
+  if (rtc.now().unixtime() == now)
+    return false;
+  rtc.adjust(DateTime(now));
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Never waits for the network
+////////////////////////////////////////////////////////////////////////////////////////////
+bool NtpSync::loop()
+{
+  if (_synced && _correct && _adjust(utc()))
+    corrections++;
+
+  switch (_state)
+  {
+  case Idle:
+    if (_next.passed() && WiFi.isConnected())
+      _request();
+    return false;
+
+  case Waiting:
+    if (_reply()) {
+      _state = Idle;
+      _next.set(NTP_INTERVAL);
+      return true;
+    }
+    if (_timeout.passed()) {
+      timeouts++;
+      ERROR("NTP: no reply from %s within %u ms", _host, NTP_TIMEOUT);
+      if (timeouts % 3 == 0)
+        _resolved = false;   // the pool may have moved
+      _state = Idle;
+      _next.set(NTP_RETRY);
+    }
+    return false;
+  }
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
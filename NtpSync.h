@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include <Timer.h>
+
+#define NTP_SERVER        "pool.ntp.org"
+#define NTP_PORT          123
+#define NTP_LOCAL_PORT    2390
+#define NTP_INTERVAL      (4*60*60*1000UL)  // resync each 4 hours
+#define NTP_RETRY         (60*1000UL)       // after a timeout
+#define NTP_TIMEOUT       2000              // ms to wait for the reply
+#define NTP_CORRECT       (60*1000UL)       // apply the drift to the clock each minute
+#define NTP_MIN_SPAN      (10*60*1000UL)    // minimum time between two syncs to measure drift
+#define NTP_MAX_DRIFT     500.0f            // ppm, larger is a measurement error
+#define NTP_TIMEZONE      1                 // hours east of UTC, EU summer time is added
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// SNTP without blocking: the request is send and the reply is picked up by a later loop().
+// The difference between the millis() and the server time over two syncs gives the drift
+// of the oscillator, which is used to correct the Clock between the syncs. The Clock keeps
+// the local time (CET/CEST), as it did with ntp_sync().
+////////////////////////////////////////////////////////////////////////////////////////////
+class NtpSync
+{
+public:
+  enum State : uint8_t { Idle, Waiting };
+
+private:
+  WiFiUDP     _udp;
+  const char *_host;
+  IPAddress   _server;
+  bool        _resolved;
+  State       _state;
+  Timer       _next;          // next request
+  Timer       _timeout;
+  Periodic    _correct;
+  uint32_t    _sent;          // millis of the request
+  bool        _synced;
+  uint64_t    _ref_utc;       // server time in ms since 1970 ...
+  uint32_t    _ref_millis;    // ... at this millis()
+
+  bool _request();
+  bool _reply();
+  bool _adjust(uint64_t utc_ms);
+public:
+  NtpSync();
+  static NtpSync *instance();
+  static uint32_t local(uint32_t utc);   // unix time in CET/CEST
+
+  uint32_t syncs;             // successful exchanges
+  uint32_t timeouts;
+  uint32_t corrections;       // drift corrections of the clock between syncs
+  uint32_t latency;           // ms round trip of the last exchange, without the server time
+  int32_t  offset;            // ms the corrected clock was off at the last sync
+  float    drift;             // ppm the millis() run fast (positive) or slow
+
+  bool begin(const char *host = NTP_SERVER);
+  bool loop();                // returns true when a sync completed
+  bool synced() const         { return _synced; }
+  uint64_t utc() const;       // estimated server time in ms since 1970
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,66 @@
+#include "OperatingMode.h"
+#include <math.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// use 1 decimal precision
+static float round1(float value) {
+  return roundf(10.0f * value) / 10.0f;  // rounding to 1 decimal
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The table in SmartControl.cpp shows when the heating goes on
+////////////////////////////////////////////////////////////////////////////////////////////
+ModeDecision operating_mode(const ModeInput &in, OperatingFlags &flags)
+{
+  ModeDecision d = { ModeKeep, 0.0f, 0.0f };
+
+  // detetmine if COOLING should be turned ON
+  if (flags.enable_Cooling == false                // when cooling is off
+    && in.inside_valid  && in.inside  > COOLING_THRESHOLD   // and inside is above 25 degrees
+    && in.outside_valid && in.outside > COOLING_THRESHOLD   // and outside is above 25 degrees
+  ) {
+    flags.enable_Cooling = true;  // enable cooling
+    d.change = ModeCoolingOn;
+    return d;
+  }
+  // detetmine if COOLING should be turned OFF
+  if (flags.enable_Cooling == true                 // when cooling enabled
+      && in.inside_valid && in.inside < COOLING_THRESHOLD   // and inside is below 25 degrees
+  ) {
+    flags.enable_Cooling = false;  // disable cooling
+    d.change = ModeCoolingOff;
+    return d;
+  }
+  // detetmine if HEATING should be turned ON
+  if (flags.enable_CH == false                     // when heating is off
+      && (in.zone_valid || in.inside_valid)        // with an error of the zones or the inside
+      && !(in.inside_valid && in.inside >= COOLING_THRESHOLD)  // and inside is below 25 degrees
+      && in.target_valid && in.setpoint_valid
+  ) {
+    // error: positive when inside above target, the rooms each against their own target
+    d.error = round1(in.zone_valid ? in.zone_error : in.inside - in.target);
+    // trend: positive when setpoint is rising, which is when either inside or outside are declining (degrees/30 minutes)
+    d.trend = round1(in.setpoint_trend);
+    // meaning: when trend is high-incline we start heating early, even when error is still large positive
+    if (MODE_TREND_FACTOR*d.trend > d.error)
+    {
+      flags.enable_CH = true;  // enable heating
+      d.change = ModeHeatingOn;
+      return d;
+    }
+    d.change = ModeHeatingNot;
+  }
+  // detetmine if HEATING should be turned OFF
+  if (flags.enable_CH == true                      // heating enabled
+    && in.setpoint_valid && in.inlet_valid
+    && round1(in.inlet - in.setpoint) > MODE_OFF_MARGIN   // when Tr = 0.2 above Tset
+  )
+  {
+    flags.enable_CH = false;  // disable heating
+    d.change = ModeHeatingOff;
+  }
+  return d;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
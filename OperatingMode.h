@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifndef COOLING_THRESHOLD
+#define COOLING_THRESHOLD   25.0f           // inside and outside above which we cool
+#endif
+#ifndef MODE_TREND_FACTOR
+#define MODE_TREND_FACTOR   2.0f            // heating on when factor * trend > error
+#endif
+#ifndef MODE_OFF_MARGIN
+#define MODE_OFF_MARGIN     0.1f            // heating off when inlet - setpoint above it
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The switching rules of SmartControl, without Arduino or side effects, so the same code is
+// built on the host by tools/replay.py to run recorded traces through it. The defines above
+// can be given on the command line to try a change of a rule.
+////////////////////////////////////////////////////////////////////////////////////////////
+struct OperatingFlags 
+{
+  bool enable_CH;         // CH enabled
+  bool enable_DHW;        // DHW enabled
+  bool enable_Cooling;    // Cooling enabled
+  bool enable_OTC;        // Outside Temperature Control enabled
+};
+
+// What the switching rules see, and what they decided
+struct ModeInput
+{
+  float inside, outside, target, setpoint, setpoint_trend, inlet;
+  float zone_error;       // of the rooms against their own targets, instead of inside - target
+  bool  inside_valid, outside_valid, target_valid, setpoint_valid, inlet_valid, zone_valid;
+};
+
+enum ModeChange : uint8_t { ModeKeep, ModeCoolingOn, ModeCoolingOff, ModeHeatingOn, ModeHeatingNot, ModeHeatingOff };
+
+struct ModeDecision
+{
+  ModeChange change;
+  float      error;       // inside - target or the zone error, when heating was considered
+  float      trend;       // of the setpoint
+};
+
+// changes the flags and returns what changed
+ModeDecision operating_mode(const ModeInput &in, OperatingFlags &flags);
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
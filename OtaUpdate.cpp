@@ -0,0 +1,136 @@
+#include "OtaUpdate.h"
+#include "SmartControl.h"
+#include <ArduinoOTA.h>
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+OtaUpdate *_ota = 0;
+OtaUpdate *OtaUpdate::instance() { return _ota; }
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+OtaUpdate::OtaUpdate()
+{
+  _ota = this;
+  _active = false;
+  _start = _frames = _last_frame = _last_sector = 0;
+  updates = failures = frames = max_gap = held_ms = 0;
+}
+
+bool OtaUpdate::begin(const char *hostname, const char *password, uint16_t port)
+{
+  ArduinoOTA.setPort(port);
+  ArduinoOTA.setHostname(hostname);
+  ArduinoOTA.setPassword(password);
+  ArduinoOTA.onStart([]() { _ota->_onStart(); });
+  ArduinoOTA.onEnd([]() { _ota->_onEnd(); });
+  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) { _ota->_onProgress(progress, total); });
+  ArduinoOTA.onError([](ota_error_t error) { _ota->_onError(error); });
+  ArduinoOTA.begin();
+  return true;
+}
+
+bool OtaUpdate::loop()
+{
+  ArduinoOTA.handle();    // does not return while an update is received
+  return _active;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The OT schedule as the scheduler would run it, the gap is measured between valid responses.
+// process() on every pass ends the DELAY after a response, so a hold does not wait for due().
+////////////////////////////////////////////////////////////////////////////////////////////
+void OtaUpdate::_service()
+{
+  SmartControl *c = SmartControl::instance();
+  if (c == NULL)
+    return;
+  if (c->due())
+    c->loop();
+  else
+    c->process();
+  if (c->frames != _frames) {
+    _gap();
+    frames += c->frames - _frames;
+    _frames = c->frames;
+    _last_frame = millis();
+  }
+}
+
+uint32_t OtaUpdate::_gap()
+{
+  uint32_t gap = millis() - _last_frame;
+  if (gap > max_gap)
+    max_gap = gap;
+  return gap;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Erasing and writing a sector stalls the cpu, not during a frame and not back to back
+////////////////////////////////////////////////////////////////////////////////////////////
+void OtaUpdate::_hold()
+{
+  SmartControl *c = SmartControl::instance();
+  uint32_t start = millis();
+  while (millis() - start < OTA_HOLD_MAX)
+  {
+    bool in_flight = c && c->in_flight();
+    if (!in_flight && millis() - _last_sector >= OTA_SECTOR_GAP)
+      break;
+    _service();
+    yield();
+  }
+  held_ms += millis() - start;
+  _last_sector = millis();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+void OtaUpdate::_onStart()
+{
+  SmartControl *c = SmartControl::instance();
+  _active = true;
+  _start = _last_frame = _last_sector = millis();
+  _frames = c ? c->frames : 0;
+  frames = max_gap = held_ms = 0;
+  if (c)
+    c->snapshot();        // warm start, also when the update fails halfway
+  INFO("OTA: starting remote software update");
+}
+
+void OtaUpdate::_onProgress(unsigned int progress, unsigned int total)
+{
+  _service();
+  if ((progress + OTA_CHUNK) / OTA_SECTOR != progress / OTA_SECTOR)
+    _hold();              // the next chunk fills a sector
+}
+
+void OtaUpdate::_onEnd()
+{
+  SmartControl *c = SmartControl::instance();
+  _gap();
+  if (c) {                // the reboot follows
+    c->config_flush();
+    c->snapshot();
+  }
+  _active = false;
+  updates++;
+  INFO("OTA: update finished in %u sec, %u OT frames, longest gap %u ms, held back %u ms",
+    (millis() - _start) / 1000, frames, max_gap, held_ms);
+}
+
+void OtaUpdate::_onError(int error)
+{
+  _gap();
+  _active = false;
+  failures++;
+  ERROR("OTA: remote software update failed (%d), %u OT frames, longest gap %u ms", error, frames, max_gap);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define OTA_PORT          8266
+#define OTA_CHUNK         1460            // bytes per received chunk, the TCP segment
+#define OTA_SECTOR        4096            // the updater writes the flash per sector
+#define OTA_SECTOR_GAP    50              // ms at least between two sector writes
+#define OTA_HOLD_MAX      250             // ms a chunk may be held back for the OT timing
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Firmware updates without losing the boiler. Once ArduinoOTA receives it does not return
+// to the loop until the image is complete, only the progress callback runs between the
+// chunks. That callback now services the OT schedule, and holds back a chunk that will fill
+// a flash sector while an OT frame is in flight or the last sector write was too recent.
+// The control state is stored just before the reboot, the longest time without an OT frame
+// is reported when the update ends.
+////////////////////////////////////////////////////////////////////////////////////////////
+class OtaUpdate
+{
+private:
+  bool      _active;
+  uint32_t  _start;                       // millis of the start of the update
+  uint32_t  _frames;                      // OT frames at the last check
+  uint32_t  _last_frame;                  // millis of the last OT frame
+  uint32_t  _last_sector;                 // millis a chunk filling a sector was released
+
+  void _service();
+  void _hold();
+  void _onStart();
+  void _onProgress(unsigned int progress, unsigned int total);
+  void _onEnd();
+  void _onError(int error);
+  uint32_t _gap();
+public:
+  OtaUpdate();
+  static OtaUpdate *instance();
+
+  uint32_t  updates;
+  uint32_t  failures;
+  uint32_t  frames;                       // OT frames during the last update
+  uint32_t  max_gap;                      // ms longest without an OT frame during the last update
+  uint32_t  held_ms;                      // chunks held back for the OT timing, last update
+
+  bool begin(const char *hostname, const char *password, uint16_t port=OTA_PORT);
+  bool loop();
+  bool active() const                     { return _active; }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,188 @@
+#include "Profiler.h"
+#include <HAMqtt.h>
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+
+#define PROFILE_STRING(id, name)  name,
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+Profiler *_profiler = 0;
+Profiler *Profiler::instance() { return _profiler; }
+
+Profiler::Histogram Profiler::_histograms[PS_COUNT];
+uint32_t            Profiler::_raw[PROFILE_RAW];
+volatile uint8_t    Profiler::_raw_used = 0;
+int8_t              Profiler::_raw_section = -1;
+
+const char *_profile_names[] = { PROFILE_SECTIONS(PROFILE_STRING) };
+
+const char *Profiler::name(uint8_t section) {
+  return section < PS_COUNT ? _profile_names[section] : "unknown";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+Profiler::Profiler()
+: _publish(PROFILE_INTERVAL)
+{
+  _profiler = this;
+  _mqtt = 0;
+  memset(_histograms, 0, sizeof(_histograms));
+}
+
+bool Profiler::begin(HAMqtt *mqtt)
+{
+  _mqtt = mqtt;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Also called from the OT interrupt, so in iram and without anything slow
+////////////////////////////////////////////////////////////////////////////////////////////
+void IRAM_ATTR Profiler::record(Section section, uint32_t cycles)
+{
+  uint32_t us = cycles / ESP.getCpuFreqMHz();
+  Histogram &h = _histograms[section];
+  uint8_t bucket = us ? 32 - __builtin_clz(us) : 0;
+  if (bucket >= PROFILE_BUCKETS)
+    bucket = PROFILE_BUCKETS -1;
+
+  h.count++;
+  h.total += us;
+  h.buckets[bucket]++;
+  if (us > h.max)
+    h.max = us;
+
+  if (_raw_section == section && _raw_used < PROFILE_RAW)
+    _raw[_raw_used++] = us;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// upper bound of the bucket in which the percentile falls
+////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t Profiler::percentile(const Histogram &h, uint8_t percent)
+{
+  uint32_t target = ((uint64_t) h.count * percent + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t b=0; b<PROFILE_BUCKETS; b++) {
+    seen += h.buckets[b];
+    if (seen >= target && seen > 0)
+      return (1UL << b) -1;
+  }
+  return h.max;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Profiler::debug(const char *section)
+{
+  _raw_section = -1;
+  _raw_used = 0;
+  if (section == NULL || strcmp(section, "off") == 0) {
+    INFO("Profiler: debug mode off");
+    return true;
+  }
+  for (uint8_t i=0; i<PS_COUNT; i++)
+    if (strcmp(section, _profile_names[i]) == 0) {
+      _raw_section = i;
+      INFO("Profiler: dumping raw samples of %s", section);
+      return true;
+    }
+  ERROR("Profiler: unknown section %s", section);
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// {"n":1234,"avg":45,"max":900,"p50":63,"p99":511,"h":[0,12,30,...]} trailing zeros dropped
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Profiler::_publishSection(uint8_t section, const Histogram &h)
+{
+  char topic[48];
+  char doc[256];
+  snprintf(topic, sizeof(topic), PROFILE_TOPIC "/%s", _profile_names[section]);
+
+  uint8_t last = PROFILE_BUCKETS;
+  while (last > 0 && h.buckets[last-1] == 0)
+    last--;
+
+  int n = snprintf(doc, sizeof(doc), "{\"n\":%u,\"avg\":%u,\"max\":%u,\"p50\":%u,\"p99\":%u,\"h\":[",
+    h.count, h.count ? (uint32_t) (h.total / h.count) : 0, h.max, percentile(h, 50), percentile(h, 99));
+  for (uint8_t b=0; b<last && n < (int) sizeof(doc) - 12; b++)
+    n += snprintf(doc + n, sizeof(doc) - n, b ? ",%u" : "%u", h.buckets[b]);
+  snprintf(doc + n, sizeof(doc) - n, "]}");
+
+  return _mqtt->publish(topic, doc, false);
+}
+
+bool Profiler::publish()
+{
+  if (_mqtt == 0 || !_mqtt->isConnected())
+    return false;
+
+  for (uint8_t i=0; i<PS_COUNT; i++)
+  {
+    Histogram h;
+    noInterrupts();       // the OT sections are updated by the interrupt
+    h = _histograms[i];
+    memset(&_histograms[i], 0, sizeof(Histogram));
+    interrupts();
+
+    if (h.count > 0 && !_publishSection(i, h))
+      return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// raw samples as little endian uint32 us, once the buffer is full
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Profiler::_dump()
+{
+  if (_raw_section < 0 || _raw_used < PROFILE_RAW || _mqtt == 0 || !_mqtt->isConnected())
+    return false;
+
+  char topic[48];
+  snprintf(topic, sizeof(topic), PROFILE_TOPIC "/%s/raw", _profile_names[_raw_section]);
+  if (!_mqtt->beginPublish(topic, sizeof(_raw), false))
+    return false;
+  _mqtt->writePayload((const uint8_t *) _raw, sizeof(_raw));
+  _mqtt->endPublish();
+  _raw_used = 0;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Profiler::loop()
+{
+  _dump();
+  if (_publish)
+    return publish();
+  return false;
+}
+
+bool Profiler::subscribe(HAMqtt *mqtt)
+{
+  return mqtt->subscribe(PROFILE_SET_TOPIC);
+}
+
+bool Profiler::onMessage(const char *topic, const uint8_t *payload, uint16_t length)
+{
+  if (strcmp(topic, PROFILE_SET_TOPIC) != 0)
+    return false;
+
+  char section[16];
+  if (length >= sizeof(section))
+    length = sizeof(section) -1;
+  memcpy(section, payload, length);
+  section[length] = '\0';
+  return debug(section);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
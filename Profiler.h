@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Timer.h>
+
+class HAMqtt;
+
+#define PROFILE           // comment out to compile the instrumentation away
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Latency profiler based on the cpu cycle counter. Each section keeps a histogram with
+// log2 buckets of microseconds (bucket n holds 2^(n-1) .. 2^n-1 us). A summary of each
+// section is published each 5 minutes, after which the histograms start over. In debug
+// mode the raw samples of one section are dumped as well.
+//
+// The OT sections are measured in the interrupt: the service time of an edge, the time
+// between two edges within a frame (500 or 1000 us when on time) and the round trip from
+// request to the edge that completes the response, a timeout is not a frame.
+////////////////////////////////////////////////////////////////////////////////////////////
+#define PROFILE_SECTIONS(X) \
+  X(OT_LOOP,    "ot_loop")    \
+  X(DISPLAY,    "display")    \
+  X(HA_UPDATE,  "ha_update")  \
+  X(MQTT_LOOP,  "mqtt_loop")  \
+  X(OT_ISR,     "ot_isr")     \
+  X(OT_EDGE,    "ot_edge")    \
+  X(OT_FRAME,   "ot_frame")
+
+#define PROFILE_ENUM(id, name)    PS_##id,
+
+#define PROFILE_BUCKETS   21                // up to 1 second
+#define PROFILE_RAW       64                // raw samples per dump
+#define PROFILE_INTERVAL  (5*60*1000)       // publish the summary each 5 minutes
+#define PROFILE_TOPIC     "SmartTherm/profile"
+#define PROFILE_SET_TOPIC "SmartTherm/profile/set"   // "<section>" for raw samples, "off" to stop
+
+#ifdef PROFILE
+#define PROFILE_SCOPE(id)           Profiler::Scope _profile_scope(Profiler::PS_##id)
+#define PROFILE_RECORD(id, cycles)  Profiler::record(Profiler::PS_##id, cycles)
+#else
+#define PROFILE_SCOPE(id)
+#define PROFILE_RECORD(id, cycles)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+class Profiler
+{
+public:
+  enum Section : uint8_t { PROFILE_SECTIONS(PROFILE_ENUM) PS_COUNT };
+
+  struct Histogram {
+    uint32_t count;
+    uint32_t max;                           // us
+    uint64_t total;                         // us
+    uint32_t buckets[PROFILE_BUCKETS];
+  };
+
+  struct Scope {                            // measures the lifetime of the object
+    Section  section;
+    uint32_t start;
+    Scope(Section s) : section(s), start(cycles()) {}
+    ~Scope() { record(section, cycles() - start); }
+  };
+
+private:
+  static Histogram  _histograms[PS_COUNT];
+  static uint32_t   _raw[PROFILE_RAW];
+  static volatile uint8_t _raw_used;
+  static int8_t     _raw_section;           // -1 when not in debug mode
+  HAMqtt   *_mqtt;
+  Periodic  _publish;
+
+  bool _publishSection(uint8_t section, const Histogram &h);
+  bool _dump();
+public:
+  Profiler();
+  static Profiler *instance();
+  static const char *name(uint8_t section);
+
+  static inline uint32_t cycles()           { return ESP.getCycleCount(); }
+  static void record(Section section, uint32_t cycles);
+  static uint32_t percentile(const Histogram &h, uint8_t percent);  // upper bound in us
+  static bool debug(const char *section);  // raw samples of a section, NULL or "off" to stop
+
+  bool begin(HAMqtt *mqtt);
+  bool loop();
+  bool publish();                           // the summary now
+  bool subscribe(HAMqtt *mqtt);
+  bool onMessage(const char *topic, const uint8_t *payload, uint16_t length);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,69 @@
+#include "PublishPolicy.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool PublishPolicy::accept(bool valid, float value, bool &force)
+{
+  uint32_t since = millis() - last_publish;
+  force = false;
+
+  bool changed = valid != last_valid || (valid && value != last_value);
+  bool publish = false;
+
+  if (sent == 0 || valid != last_valid)                   // first value, or (in)validated
+    publish = true;
+  else if (min_interval != 0 && since < min_interval * 1000UL)
+    publish = false;                                      // too soon
+  else if (heartbeat != 0 && since >= heartbeat * 1000UL)
+    publish = force = true;                               // alive
+  else if (changed)
+  {
+    float threshold = max(abs_deadband, rel_deadband * std::abs(last_value));
+    publish = std::abs(value - last_value) > threshold;
+  }
+
+  if (!publish) {
+    if (changed && (!pending || valid != pending_valid || value != pending_value))
+      suppressed++;
+    pending = changed;
+    pending_valid = valid;
+    pending_value = value;
+    return false;
+  }
+  pending = false;
+  last_valid = valid;
+  last_value = value;
+  last_publish = millis();
+  sent++;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool PublishPolicy::configure(float abs, float rel, uint16_t min, uint16_t alive)
+{
+  if (abs < 0.0f || rel < 0.0f || rel > 1.0f)
+    return false;
+  if (alive != 0 && alive < min)
+    return false;   // heartbeat would never be reached
+
+  abs_deadband = abs;
+  rel_deadband = rel;
+  min_interval = min;
+  heartbeat    = alive;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+PublishPolicy *find_policy(PublishPolicy *table, uint8_t count, const char *name)
+{
+  for (uint8_t i=0; i<count; i++)
+    if (strcmp(table[i].name, name) == 0)
+      return &table[i];
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
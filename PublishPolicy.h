@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Arduino.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Decides per entity whether a new value is worth publishing to Home Assistant.
+// A value is published when it moved more than the deadband (absolute or relative to the
+// last published value), but never more often than min_interval. After heartbeat seconds
+// the value is published anyway so Home Assistant knows we are alive.
+// Use 0 to disable any of the limits.
+////////////////////////////////////////////////////////////////////////////////////////////
+struct PublishPolicy
+{
+  const char *name;
+  float     abs_deadband;       // minimum absolute change
+  float     rel_deadband;       // minimum change as fraction of the last published value
+  uint16_t  min_interval;       // seconds between two publishes
+  uint16_t  heartbeat;          // seconds after which we publish anyway
+
+  bool      last_valid    = false;
+  float     last_value    = 0.0f;
+  uint32_t  last_publish  = 0;  // millis of the last publish
+  uint32_t  sent          = 0;  // number of updates published
+  uint32_t  suppressed    = 0;  // number of distinct changes not published
+  bool      pending       = false;  // a suppressed change waits ...
+  bool      pending_valid = false;
+  float     pending_value = 0.0f;   // ... this one, counted once however often it is polled
+
+  // returns true when the value should be published, force is set for a heartbeat
+  bool accept(bool valid, float value, bool &force);
+  bool configure(float abs, float rel, uint16_t min_interval, uint16_t heartbeat);
+};
+
+PublishPolicy *find_policy(PublishPolicy *table, uint8_t count, const char *name);
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,107 @@
+#include "Scheduler.h"
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+Scheduler *_scheduler = 0;
+Scheduler *Scheduler::instance() { return _scheduler; }
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+Scheduler::Scheduler()
+: _report(SCHED_REPORT)
+{
+  _scheduler = this;
+  _count = 0;
+  _passes = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// insert sorted on priority, equal priorities keep the order in which they are added
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Scheduler::add(const char *name, void (*run)(), uint32_t period, uint8_t priority, uint32_t budget, bool (*due)())
+{
+  if (_count >= SCHED_MAX_TASKS) {     // SCHED_TASKS in SmartTherm.ino is checked at compile time
+    ERROR("Scheduler: no room for task %s", name);
+    return false;
+  }
+  uint8_t i = _count++;
+  for (; i > 0 && _tasks[i-1].priority > priority; i--)
+    _tasks[i] = _tasks[i-1];
+
+  Task &t = _tasks[i];
+  memset(&t, 0, sizeof(t));
+  t.name = name;
+  t.run = run;
+  t.due = due;
+  t.period = period;
+  t.budget = budget;
+  t.priority = priority;
+  t.last = millis() - period;   // run at the first pass
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+void Scheduler::_run(Task &t)
+{
+  uint32_t start = micros();
+  t.run();
+  uint32_t took = micros() - start;
+
+  t.last = millis();
+  t.runs++;
+  t.total += took;
+  if (took > t.worst)
+    t.worst = took;
+  if (t.budget != 0 && took > t.budget) {
+    t.overruns++;
+    DEBUG("Scheduler: %s took %u us, budget %u us", t.name, took, t.budget);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Run the urgent tasks which are due now
+////////////////////////////////////////////////////////////////////////////////////////////
+void Scheduler::_urgent()
+{
+  for (uint8_t i=0; i<_count; i++)
+    if (_tasks[i].due != NULL && _tasks[i].due())
+      _run(_tasks[i]);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+void Scheduler::loop()
+{
+  for (uint8_t i=0; i<_count; i++)
+  {
+    _urgent();
+    Task &t = _tasks[i];
+    if (millis() - t.last >= t.period)
+      _run(t);
+  }
+  _passes++;
+
+  if (_report)
+    report();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+void Scheduler::report()
+{
+  for (uint8_t i=0; i<_count; i++) {
+    const Task &t = _tasks[i];
+    INFO("Task %s: %u runs, %u overruns, worst %u us, avg %u us", t.name, t.runs, t.overruns, t.worst, t.runs ? t.total / t.runs : 0);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
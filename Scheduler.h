@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Timer.h>
+
+#define SCHED_MAX_TASKS   20
+#define SCHED_REPORT      (10*60*1000)    // log the task statistics each 10 minutes
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Cooperative scheduler for the main loop. Each task has a period, a priority (0 runs first)
+// and a time budget. Tasks with a due() check are urgent: they are checked before each
+// other task and run as soon as they are due, so a slow task cannot delay them by more than
+// its own duration. The statistics show which task used more than its budget.
+////////////////////////////////////////////////////////////////////////////////////////////
+class Scheduler
+{
+public:
+  struct Task {
+    const char *name;
+    void      (*run)();
+    bool      (*due)();         // urgent when not NULL
+    uint32_t    period;         // ms, 0 for each pass
+    uint32_t    budget;         // us, 0 for no budget
+    uint8_t     priority;
+    uint32_t    last;           // millis of the last run
+    uint32_t    runs;
+    uint32_t    overruns;       // runs that took longer than the budget
+    uint32_t    worst;          // us
+    uint32_t    total;          // us, wraps after an hour of cpu time
+  };
+
+private:
+  Task      _tasks[SCHED_MAX_TASKS];
+  uint8_t   _count;
+  uint32_t  _passes;
+  Periodic  _report;
+
+  void _run(Task &t);
+  void _urgent();
+public:
+  Scheduler();
+  static Scheduler *instance();
+
+  // returns false when there is no room, the tasks are kept sorted on priority
+  bool add(const char *name, void (*run)(), uint32_t period, uint8_t priority, uint32_t budget, bool (*due)()=NULL);
+  void loop();                    // one pass over all tasks
+  void report();                  // log the statistics
+
+  uint8_t count() const           { return _count; }
+  const Task &task(uint8_t i) const { return _tasks[i]; }
+  uint32_t passes() const         { return _passes; }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,346 @@
+#include "SensorBus.h"
+#include "ConfigStore.h"
+#include <HAMqtt.h>
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+
+#define SENSOR_BUS_VERSION    1
+#define SENSOR_BUS_MAX_BITS   12
+#define SENSOR_BUS_MIN_BITS   9
+#define DS18B20_WRITE_SCRATCH 0x4E
+#define NOISE_WEIGHT          0.05f       // of a new difference in the running variance
+#define CALIBRATE_TROOM       (-130)      // centi degrees, the calibration of the first room sensor
+
+SensorConfig sensor_table[SENSOR_BUS_MAX];   // loaded, changed and stored as a whole
+uint32_t     sensor_data[(sizeof(sensor_table) + 3) / 4];
+EspFlash     sensor_flash(FLASH_SENSORS);
+ConfigStore  sensor_store(sensor_flash, SENSOR_BUS_VERSION, sizeof(sensor_table), sensor_data);
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+SensorBus *_sensor_bus = 0;
+SensorBus *SensorBus::instance() { return _sensor_bus; }
+
+char *SensorBus::rom_hex(char *buf, const uint8_t *rom)
+{
+  for (uint8_t i=0; i<8; i++)
+    sprintf(buf + 2*i, "%02X", rom[i]);
+  return buf;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+SensorBus::SensorBus(uint8_t pin)
+: _wire(pin), _dallas(&_wire)
+, _period(SENSOR_BUS_PERIOD)
+, _report(SENSOR_BUS_REPORT)
+{
+  _sensor_bus = this;
+  memset(_sensors, 0, sizeof(_sensors));
+  for (uint8_t i=0; i<SENSOR_BUS_MAX; i++)
+    _sensors[i].binding = -1;
+  _bound = 0;
+  _listener = NULL;
+  _converting = false;
+  conversions = 0;
+  present = 0;
+  busy_ms = saved_ms = changes = 0;
+}
+
+const SensorConfig *SensorBus::config(uint8_t idx) const {
+  return idx < SENSOR_BUS_MAX ? &_sensors[idx].config : NULL;
+}
+
+float SensorBus::noise(uint8_t idx) const {
+  return _sensors[idx].readings > 1 ? sqrtf(_sensors[idx].noise) : 0.0f;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// By the 16 hex digits of the rom id, or by label
+////////////////////////////////////////////////////////////////////////////////////////////
+int8_t SensorBus::_find(const char *id)
+{
+  char hex[17];
+  for (uint8_t i=0; i<SENSOR_BUS_MAX; i++)
+  {
+    const SensorConfig &c = _sensors[i].config;
+    if (c.rom[0] == 0)
+      continue;
+    if (strcasecmp(id, rom_hex(hex, c.rom)) == 0 || strcmp(id, c.label) == 0)
+      return i;
+  }
+  return -1;
+}
+
+void SensorBus::_bind(Sensor &s)
+{
+  s.binding = -1;
+  for (uint8_t b=0; b<_bound; b++)
+    if (strcmp(_bindings[b].label, s.config.label) == 0)
+      s.binding = b;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// A new sensor gets the role of the first two sensors of the original shield, if still free
+////////////////////////////////////////////////////////////////////////////////////////////
+void SensorBus::_default(uint8_t idx, const uint8_t *rom)
+{
+  SensorConfig &c = _sensors[idx].config;
+  memset(&c, 0, sizeof(c));
+  memcpy(c.rom, rom, sizeof(c.rom));
+  if (_find("room") < 0) {
+    strcpy(c.label, "room");
+    c.offset = CALIBRATE_TROOM;
+  }
+  else if (_find("board") < 0)
+    strcpy(c.label, "board");
+  else
+    snprintf(c.label, sizeof(c.label), "ds%d", idx);
+}
+
+bool SensorBus::_store()
+{
+  for (uint8_t i=0; i<SENSOR_BUS_MAX; i++)
+    sensor_table[i] = _sensors[i].config;
+  sensor_store.set(sensor_table, millis());
+  if (sensor_store.commit() == ConfigStore::Ok)
+    return true;
+  ERROR("Sensors: could not write to flash");
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The only bus search, the known sensors keep their label and calibration
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SensorBus::begin()
+{
+  memset(sensor_table, 0, sizeof(sensor_table));
+  bool changed = sensor_store.load(sensor_table) != ConfigStore::Ok;
+  for (uint8_t i=0; i<SENSOR_BUS_MAX; i++)
+    _sensors[i].config = sensor_table[i];
+
+  _dallas.begin();
+  _dallas.setWaitForConversion(false);    // the loop polls for the result
+
+  uint8_t rom[8];
+  char hex[17];
+  _wire.reset_search();
+  while (_wire.search(rom))
+  {
+    if (OneWire::crc8(rom, 7) != rom[7])
+      continue;
+    int8_t idx = _find(rom_hex(hex, rom));
+    for (uint8_t i=0; idx < 0 && i<SENSOR_BUS_MAX; i++)
+      if (_sensors[i].config.rom[0] == 0) {
+        _default(i, rom);
+        idx = i;
+        changed = true;
+      }
+    if (idx < 0) {
+      ERROR("Sensors: no room for %s", hex);
+      continue;
+    }
+    Sensor &s = _sensors[idx];
+    uint8_t scratch[9];
+    s.bits = SENSOR_BUS_MAX_BITS;
+    s.alarm[0] = s.alarm[1] = 0;
+    if (_dallas.readScratchPad(s.config.rom, scratch)) {
+      s.alarm[0] = scratch[2];
+      s.alarm[1] = scratch[3];
+      s.bits = ((scratch[4] >> 5) & 0x03) + SENSOR_BUS_MIN_BITS;
+    }
+    s.present = true;
+    present++;
+  }
+
+  for (uint8_t i=0; i<SENSOR_BUS_MAX; i++)
+  {
+    Sensor &s = _sensors[i];
+    if (s.config.rom[0] == 0)
+      continue;
+    _bind(s);
+    INFO("Sensors: %s %s, offset %d, %s %d bits", rom_hex(hex, s.config.rom), s.config.label, s.config.offset,
+      s.present ? "present" : "missing", s.bits);
+  }
+  if (changed)
+    _store();
+  if (present == 0) {
+    ERROR("Unable to find a DS sensor");
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SensorBus::bind(const char *label, Sink sink, Resolution resolution)
+{
+  if (_bound >= SENSOR_BUS_MAX)
+    return false;
+  _bindings[_bound].label = label;
+  _bindings[_bound].sink = sink;
+  _bindings[_bound].resolution = resolution;
+  _bound++;
+  for (uint8_t i=0; i<SENSOR_BUS_MAX; i++)
+    _bind(_sensors[i]);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Only the scratchpad is written, the resolution at power up stays in the EEPROM of the
+// sensor, which is not worn by the changes
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SensorBus::_resolution(Sensor &s, uint8_t bits)
+{
+  if (!_wire.reset())
+    return false;
+  _wire.select(s.config.rom);
+  _wire.write(DS18B20_WRITE_SCRATCH);
+  _wire.write(s.alarm[0]);
+  _wire.write(s.alarm[1]);
+  _wire.write(((bits - SENSOR_BUS_MIN_BITS) << 5) | 0x1F);
+  s.bits = bits;
+  changes++;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// One conversion for all sensors, collected when the slowest is done
+////////////////////////////////////////////////////////////////////////////////////////////
+void SensorBus::_start()
+{
+  uint8_t slowest = SENSOR_BUS_MIN_BITS;
+  for (uint8_t i=0; i<SENSOR_BUS_MAX; i++)
+  {
+    Sensor &s = _sensors[i];
+    if (!s.present)
+      continue;
+    Resolution need = s.binding >= 0 ? _bindings[s.binding].resolution : NULL;
+    uint8_t bits = (need && s.readings > 0) ? need(s.value) : SENSOR_BUS_BITS;
+    bits = constrain(bits, SENSOR_BUS_MIN_BITS, SENSOR_BUS_MAX_BITS);
+    if (bits != s.bits)
+      _resolution(s, bits);
+    if (s.bits > slowest)
+      slowest = s.bits;
+  }
+  uint16_t wait = _dallas.millisToWaitForConversion(slowest);
+  busy_ms += wait;
+  saved_ms += _dallas.millisToWaitForConversion(SENSOR_BUS_MAX_BITS) - wait;
+
+  _dallas.requestTemperatures();
+  _ready.set(wait);
+  _converting = true;
+}
+
+void SensorBus::_read()
+{
+  for (uint8_t i=0; i<SENSOR_BUS_MAX; i++)
+  {
+    Sensor &s = _sensors[i];
+    if (!s.present)
+      continue;
+    float t = _dallas.getTempC(s.config.rom);
+    if (t == DEVICE_DISCONNECTED_C) {
+      s.errors++;
+      continue;
+    }
+    t += s.config.offset / 100.0f;
+    if (s.readings > 0) {       // a slow signal, the difference is mostly noise
+      float d = t - s.value;
+      s.noise += NOISE_WEIGHT * (d * d / 2.0f - s.noise);
+    }
+    if (s.readings < 255)
+      s.readings++;
+    s.value = t;
+    if (s.binding >= 0)
+      _bindings[s.binding].sink(s.value);
+    if (_listener)
+      _listener(s.config.label, s.value);
+  }
+  conversions++;
+  _converting = false;
+}
+
+void SensorBus::_log()
+{
+  for (uint8_t i=0; i<SENSOR_BUS_MAX; i++)
+  {
+    const Sensor &s = _sensors[i];
+    if (s.present)
+      INFO("Sensors: %s %d bits, noise %0.3f, %u errors", s.config.label, s.bits, noise(i), s.errors);
+  }
+  uint32_t total = busy_ms + saved_ms;
+  INFO("Sensors: %u conversions, %u ms saved of %u ms (%u%%), %u resolution changes",
+    conversions, saved_ms, total, total ? saved_ms * 100 / total : 0, changes);
+}
+
+bool SensorBus::loop()
+{
+  if (_report)
+    _log();
+  if (_converting) {
+    if (!_ready.passed())
+      return false;
+    _read();
+    return true;
+  }
+  if (present == 0 || !_period)
+    return false;
+  _start();
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SensorBus::subscribe(HAMqtt *mqtt)
+{
+  return mqtt->subscribe(SENSOR_BUS_TOPIC);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// "<rom|label> <label> [offset in °C]"
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SensorBus::onMessage(const char *topic, const uint8_t *payload, uint16_t length)
+{
+  if (strcmp(topic, SENSOR_BUS_TOPIC) != 0)
+    return false;
+
+  char buf[48], id[17], label[SENSOR_BUS_LABEL];
+  if (length >= sizeof(buf))
+    length = sizeof(buf) -1;
+  memcpy(buf, payload, length);
+  buf[length] = '\0';
+
+  #define SENSOR_BUS_STR_(x) #x
+  #define SENSOR_BUS_STR(x)  SENSOR_BUS_STR_(x)
+  int n = 0;
+  if (sscanf(buf, "%16s %" SENSOR_BUS_STR(SENSOR_BUS_LABEL_LEN) "s %n", id, label, &n) < 2) {
+    ERROR("Sensors: expected '<rom|label> <label> [offset]'");
+    return true;
+  }
+  int8_t idx = _find(id);
+  if (idx < 0) {
+    ERROR("Sensors: unknown sensor %s", id);
+    return true;
+  }
+  int8_t other = _find(label);
+  if (other >= 0 && other != idx) {
+    ERROR("Sensors: %s is already taken", label);   // the second would never be found
+    return true;
+  }
+  SensorConfig &c = _sensors[idx].config;
+  strcpy(c.label, label);
+  if (n > 0 && buf[n] != '\0')
+    c.offset = (int16_t) lroundf(strtod(buf + n, NULL) * 100.0f);
+  _bind(_sensors[idx]);
+  INFO("Sensors: %s is now %s, offset %d", id, c.label, c.offset);
+  _store();
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
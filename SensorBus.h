@@ -0,0 +1,104 @@
+#pragma once
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include <Timer.h>
+
+class HAMqtt;
+
+#define SENSOR_BUS_MAX      6             // sensors on the bus
+#define SENSOR_BUS_LABEL_LEN 11           // characters of a label
+#define SENSOR_BUS_LABEL    (SENSOR_BUS_LABEL_LEN + 1)  // and its terminator
+#define SENSOR_BUS_PERIOD   (10*1000)     // ms between the start of two conversions
+#define SENSOR_BUS_TOPIC    "SmartTherm/sensors/set"
+#define SENSOR_BUS_BITS     10            // resolution of a sensor without a requirement
+#define SENSOR_BUS_REPORT   (10*60*1000)  // log the resolution and noise each 10 minutes
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// What is stored per sensor, in flash (FLASH_SENSORS)
+////////////////////////////////////////////////////////////////////////////////////////////
+struct SensorConfig
+{
+  uint8_t  rom[8];                        // all zero for an unused entry
+  char     label[SENSOR_BUS_LABEL];       // "room", "board", ...
+  int16_t  offset;                        // calibration in centi degrees
+  uint8_t  spare[2];
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// All DS18B20s on the OneWire bus. The bus is searched once at boot, the ROM ids are kept
+// with a label and a calibration. One broadcast conversion serves all sensors, the loop
+// does not wait for it. Each result goes to the sink bound to the label of the sensor.
+// Relabel or calibrate with "<rom|label> <label> <offset>" on SENSOR_BUS_TOPIC.
+// The resolution (9..12 bits, 94..750 ms) is chosen per sensor before each conversion, by
+// the binding from the last value. The conversion waits for the highest resolution only.
+////////////////////////////////////////////////////////////////////////////////////////////
+class SensorBus
+{
+public:
+  typedef void (*Sink)(float celcius);
+  typedef uint8_t (*Resolution)(float celcius);   // bits needed for the next conversion
+  typedef void (*Listener)(const char *label, float celcius);   // each reading of each sensor
+
+private:
+  struct Sensor {
+    SensorConfig config;
+    bool     present;                     // found on the bus at boot
+    int8_t   binding;                     // index in _bindings, -1 when unbound
+    float    value;                       // last calibrated reading
+    uint32_t errors;
+    uint8_t  bits;                        // current resolution
+    uint8_t  alarm[2];                    // TH and TL, written back with the resolution
+    uint8_t  readings;                    // valid readings, saturates
+    float    noise;                       // variance of the reading to reading difference
+  };
+  struct Binding {
+    const char *label;
+    Sink        sink;
+    Resolution  resolution;               // NULL for SENSOR_BUS_BITS
+  };
+  OneWire           _wire;
+  DallasTemperature _dallas;
+  Sensor    _sensors[SENSOR_BUS_MAX];
+  Binding   _bindings[SENSOR_BUS_MAX];
+  uint8_t   _bound;
+  Listener  _listener;
+  bool      _converting;
+  Timer     _ready;                       // conversion done
+  Periodic  _period;
+  Periodic  _report;
+
+  int8_t _find(const char *rom_or_label);
+  void _bind(Sensor &s);
+  void _default(uint8_t idx, const uint8_t *rom);
+  bool _store();
+  bool _resolution(Sensor &s, uint8_t bits);
+  void _start();
+  void _read();
+  void _log();
+public:
+  SensorBus(uint8_t pin);
+  static SensorBus *instance();
+  static char *rom_hex(char *buf, const uint8_t *rom);  // 17 bytes
+
+  uint32_t conversions;
+  uint8_t  present;                       // sensors found on the bus
+  uint32_t busy_ms;                       // waited for conversions
+  uint32_t saved_ms;                      // compared to 12 bits for all
+  uint32_t changes;                       // resolution changes
+
+  bool begin();
+  bool bind(const char *label, Sink sink, Resolution resolution=NULL);
+  void listen(Listener listener)          { _listener = listener; }
+  bool loop();
+  bool subscribe(HAMqtt *mqtt);
+  bool onMessage(const char *topic, const uint8_t *payload, uint16_t length);
+  const SensorConfig *config(uint8_t idx) const;
+  float value(uint8_t idx) const          { return _sensors[idx].value; }
+  float noise(uint8_t idx) const;         // stddev of a reading
+  uint8_t bits(uint8_t idx) const         { return _sensors[idx].bits; }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -4,33 +4,48 @@
 #define LOG_LEVEL 3
 #include <Logging.h>
 #include <Timer.h>
+#include "BinLog.h"
+#include "Format.h"
+#include "Profiler.h"
+#include "SensorBus.h"
+#include "Energy.h"
+#include "NtpSync.h"
+#include "Zones.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 // Configuration
 const int mInPin = D1; //D6; 
 const int mOutPin = D2; //D5;
-const int tempSensorPin = D4; //D7;         // D7 contains the DS18b20 one-wire temp sensor
 // Amsterdam's latitude and longitude
 float latitude = 52.3676;
 float longitude = 4.9041;
 
 extern Clock rtc;
 
-#define CALIBRATE_TROOM     (-1.3f)         // DS sensor calibration
 #define ERROR_RESETTER      (15*60*1000)    // 15 minutes to retry a DataId and to reset the comm-err counter
 #define ANALYSE_TIME        (10*1000)       // once every 10 seconds we analyse the heating state
-#define ANTIPENDEL_TIMEFRAME (30*60*1000)   // no turning on/off within a 30 minutes timeframe
-#define DS_SENSOR_EXTERNAL  0               // "\x28\xB4\x51\x0C\x00\x00\x00\x8F"
-#define DS_SENSOR_BOARD     1               // "\x28\xBF\x7A\x28\xA1\x22\x06\x51"
+#define OT_RESPONSE_TIMEOUT 1000            // ms, that of the OpenTherm library
+#define RESOLUTION_MARGIN   0.5f            // °C from a switching threshold for the full resolution
+#define RESOLUTION_STEADY   0.2f            // °C per hour below which the room is steady
 ////////////////////////////////////////////////////////////////////////////////////////////
 // 
-#define LOG_MESSAGE(req, resp)    DEBUG("[%s] - % 3.3d = T:%s, data %04.4X -> B:%s, data %0.4f", \
-                                  rtc.now().timestamp(DateTime::TIMESTAMP_TIME).c_str(),  \
+#ifdef LOG_BINARY
+#define LOG_MESSAGE(req, resp)    BLOG_DEBUG(OT_MESSAGE, \
+                                  OpenTherm::getDataID(req), \
+                                  OpenTherm::getMessageType(req), \
+                                  OpenTherm::getUInt(req), \
+                                  OpenTherm::getMessageType(resp), \
+                                  OpenTherm::getFloat(resp))
+#else
+#define LOG_MESSAGE(req, resp)    do { char ts[10]; \
+                                  DEBUG("[%s] - % 3.3d = T:%s, data %04.4X -> B:%s, data %0.4f", \
+                                  fmt_time(ts, sizeof(ts), rtc.now()),  \
                                   OpenTherm::getDataID(req), \
                                   OpenTherm::messageTypeToString(OpenTherm::getMessageType(req)), \
                                   OpenTherm::getUInt(req), \
                                   OpenTherm::messageTypeToString(OpenTherm::getMessageType(resp)), \
-                                  OpenTherm::getFloat(resp));
+                                  OpenTherm::getFloat(resp)); } while (0)
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 // singleton object
@@ -39,23 +54,17 @@ SmartControl *SmartControl::instance() { return _controller; }
 
 SmartControl::SmartControl()
 : OpenTherm(mInPin, mOutPin, false)               // opentherm shield
-, _wire(tempSensorPin), _dallas(&_wire)           // dalles inside temperature and print temperature
 , _auto_resetter(ERROR_RESETTER)                  // auto reset
 , _analyse_time(ANALYSE_TIME)
-, inside(  20.0f, 5,  10.0f, 40.0f, 0.02f, 3.0f)  // inside can only change slow
-, outside( 10.0f, 5, -15.0f, 40.0f, 0.02f, 3.0f)  // outside can only change slow
-, target(  20.5f, 0,  18.0f, 25.0f)               // does not expire, and no spike detection needed
-, setpoint(20.0f, 5,  10.0f, 55.0f)               // no spike detection needed
-, inlet(   20.0f, 5,  10.0f, 55.0f, 1.0f, 3.0f)   // during defrosts the inlet can change fast
-, outlet(  20.0f, 5,  10.0f, 55.0f, 1.0f, 3.0f)   // during defrosts the outlet can change fast
+, inside(20.0f), target(20.5f), setpoint(20.0f)  // see the policies in SmartControl.h
+, inlet(20.0f), outlet(20.0f), outside(10.0f), board(20.0f)
+, solar(latitude, longitude)
 {
   _controller = this;
 
-  memset(_T_board, 0, sizeof(_T_board));
-  memset(_T_extern, 0, sizeof(_T_extern));
-
   communication_errors = 0;
-  _sunrise.queryTime = 0;
+  frames = 0;
+  _restored = false;
   operating_flags.enable_CH      = false;    // disable heating per default
   operating_flags.enable_DHW     = false;    // disable DHW heating
   operating_flags.enable_Cooling = false;    // disable cooling per default
@@ -64,10 +73,28 @@ SmartControl::SmartControl()
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 // Global functions / interupt handlers
+#define OT_EDGE_WINDOW  2000    // us, longer between two edges is not within a frame
+
+extern uint32_t request_sent;
+
 void IRAM_ATTR mHandleInterrupt() {
     if (_controller == 0)
       return;
+#ifdef PROFILE
+    static uint32_t last_edge = 0;
+    uint32_t start = Profiler::cycles();
+    if (start - last_edge < OT_EDGE_WINDOW * ESP.getCpuFreqMHz())
+      PROFILE_RECORD(OT_EDGE, start - last_edge);
+    last_edge = start;
+    OpenThermStatus before = _controller->status;
+#endif
     _controller->handleInterrupt();
+#ifdef PROFILE
+    OpenThermStatus after = _controller->status;    // the edge that completed the response
+    if (after != before && (after == OpenThermStatus::RESPONSE_READY || after == OpenThermStatus::RESPONSE_INVALID))
+      PROFILE_RECORD(OT_FRAME, start - request_sent);
+#endif
+    PROFILE_RECORD(OT_ISR, Profiler::cycles() - start);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -80,6 +107,21 @@ void handleResponse(unsigned long response, OpenThermResponseStatus state)
     _controller->_handleResponse(response, state);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////
+// Resolution of the room sensor: the full 12 bits close to a decision of set_operating_mode,
+// 10 bits (0.25°C) while steady and 11 bits while changing
+////////////////////////////////////////////////////////////////////////////////////////////
+static uint8_t room_resolution(float t)
+{
+  SmartControl *c = _controller;
+  if (std::abs(t - COOLING_THRESHOLD) < RESOLUTION_MARGIN)
+    return 12;
+  // heating starts when 2*trend > error
+  if (c->target.valid() && std::abs(t - c->target.get() - 2 * c->setpoint.trend()) < RESOLUTION_MARGIN)
+    return 12;
+  return std::abs(c->inside.rate()) < RESOLUTION_STEADY ? 10 : 11;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -87,48 +129,23 @@ bool SmartControl::begin()
 {
   OpenTherm::begin(mHandleInterrupt, handleResponse); // for handling the response messages
   
-  _dallas.begin();
-  if (_dallas.getDeviceCount() < 1) 
-    return false;
-
-  if (!_dallas.getAddress(_T_extern, DS_SENSOR_EXTERNAL))    // get address of the first (and only) DS sensor on this shield
-  {
+  SensorBus *bus = SensorBus::instance();   // the DS18B20s by label
+  if (bus == NULL) {
     ERROR("Unable to find a DS sensor");
     return false;
   }
-  if (!_dallas.getAddress(_T_board, DS_SENSOR_BOARD))
-  {
-    ERROR("Unable to find a second DS sensor");
-  }
-  else
-  {
-    INFO("2 sensors found: %02.2X%02.2X%02.2X%02.2X%02.2X%02.2X%02.2X%02.2X and %02.2X%02.2X%02.2X%02.2X%02.2X%02.2X%02.2X%02.2X",
-    _T_extern[0], _T_extern[1], _T_extern[2], _T_extern[3], _T_extern[4], _T_extern[5], _T_extern[6], _T_extern[7], 
-    _T_board[0], _T_board[1], _T_board[2], _T_board[3], _T_board[4], _T_board[5], _T_board[6], _T_board[7]
-    );
-//    delay(1000);
-  }
+  bus->bind("room",  [](float t) { _controller->inside.set(t); }, room_resolution);
+  bus->bind("board", [](float t) { _controller->board.set(t); });
   _timer_switch_onoff.set(ANTIPENDEL_TIMEFRAME);
   return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
-// Measure the inside temp and return the value
+// The inside temp, as last measured by the sensor bus
 ////////////////////////////////////////////////////////////////////////////////////////////
 float SmartControl::RoomCur() 
 {
-  float t = 0.0f;
-
-  if (!_dallas.validAddress(_T_extern) || !_dallas.isConnected(_T_extern))
-    _dallas.getAddress(_T_extern, DS_SENSOR_EXTERNAL); 
-
-  if (_dallas.requestTemperaturesByAddress(_T_extern))   // send command to sensors to measure
-  {
-    t = _dallas.getTempC(_T_extern);
-    t += CALIBRATE_TROOM;
-    inside.set(t);
-  }
-  // if measurement wasnt successfull, and the existing value got expired, we should skip
+  // the sensor bus measures in the background, if the value got expired we should skip
   // sending the OT message
   return inside.get();
 }
@@ -161,7 +178,7 @@ float SmartControl::RoomSet() {
 ////////////////////////////////////////////////////////////////////////////////////////////
 float SmartControl::SetPoint()
 {
-  setpoint.set(heating_curve.calculate(&inside, &target, &outside));
+  setpoint.set(heating_curve.calculate(&inside, &target, &outside, solar.offset(rtc.now().unixtime())));
 
   if (operating_flags.enable_CH || operating_flags.enable_Cooling)
     return setpoint.get();
@@ -200,7 +217,7 @@ void setStatus(unsigned long data) {
   bool CH2_mode = data & 0x20;
   bool diag     = data & 0x40;
 
-  DEBUG("Flags F:%d CH:%d DHW:%d Flame:%d Cool:%d CH2:%d Diag:%d", 
+  BLOG_DEBUG(OT_FLAGS,
     c->status_flags.fault?1:0,
     c->status_flags.CH_mode?1:0,
     c->status_flags.DHW_mode?1:0,
@@ -254,7 +271,7 @@ typedef struct {
   OpenThermMessageType msgType;
   uint16_t (* getdata)();
   void (* setdata)(unsigned long);
- 
+  OTCounters counters;
 } FUNCTION_MAP;
 
 FUNCTION_MAP script[] = {
@@ -273,10 +290,22 @@ FUNCTION_MAP script[] = {
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
 ////////////////////////////////////////////////////////////////////////////////////////////
+#define SCRIPT_SIZE   (sizeof(script) / sizeof(script[0]))
+
+static FUNCTION_MAP *script_entry(OpenThermMessageID id)
+{
+  FUNCTION_MAP *c = script;
+  while (c->msgId != id && c->msgId != OpenThermMessageID::SlaveVersion)
+    c++;
+  return c;
+}
+
 FUNCTION_MAP *cmd = script;
 Timer send_tm;
+Timer response_tm;            // the library times out the request
 unsigned long last_request;
 unsigned long last_response;
+uint32_t      request_sent;   // cycle count of the last request, for the frame time in the ISR
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
@@ -286,13 +315,16 @@ void SmartControl::_handleResponse(unsigned long response, OpenThermResponseStat
   last_response = response;
   LOG_MESSAGE(last_request, last_response);
 
-  FUNCTION_MAP *c = script; 
-  while (c->msgId != OpenTherm::getDataID(response) && c->msgId != OpenThermMessageID::SlaveVersion)
-    c++;
+  FUNCTION_MAP *c = script_entry(OpenTherm::getDataID(response));
+  OTCounters &counters = script_entry(OpenTherm::getDataID(last_request))->counters;   // also on a timeout
 
   if (!OpenTherm::isValidResponse(response))
   {
     ERROR("Invalid response message received: %s", OpenTherm::statusToString(state));
+    if (state == OpenThermResponseStatus::TIMEOUT)
+      counters.timeouts++;
+    else
+      counters.invalid++;
     switch (c->msgId) 
     {
     case OpenThermMessageID::Status:
@@ -311,8 +343,14 @@ void SmartControl::_handleResponse(unsigned long response, OpenThermResponseStat
   }
   else
   {
+    frames++;
+    counters.responses++;
     if (c->setdata)
       c->setdata(response);
+    Energy *energy = Energy::instance();  // constant time, with the values just received
+    if (energy)
+      energy->frame(status_flags.Flame || status_flags.Cooling, ModLvl, outlet.get(), inlet.get(),
+                    outlet.valid() && inlet.valid());
   }
 }
 
@@ -334,22 +372,22 @@ void SmartControl::_handleResponse(unsigned long response, OpenThermResponseStat
                               ON		ON	  ON	  ON  ON	  ON	ON	  ON	  ON	  ON    ON
     ==> ON = (2*trend > error)
 */
-////////////////////////////////////////////////////////////////////////////////////////////
-// use 1 decimal precision
-float round1(float value) {
-  return round(10.0f * value) / 10.0f;  // rounding to 1 decimal
-}
-
 ////////////////////////////////////////////////////////////////////////////////////////////
 bool SmartControl::set_operating_mode()
 {
   if (!_analyse_time)
     return false; // no change in heating or cooling
 
+  NtpSync *ntp = NtpSync::instance();   // a new day of sun, once the clock is right
+  if (ntp && ntp->synced()) {
+    uint32_t utc = (uint32_t) (ntp->utc() / 1000);   // the rtc holds local time
+    solar.update(rtc.now().unixtime(), (int32_t) (NtpSync::local(utc) - utc));
+  }
+
   // TODO: add logic to handle invalid temps, like invalid outside, inlet or other boiler temp
 
   // log some analysis
-  DEBUG("T/trend >>> TRoom= %0.1f/%0.1f, TOutside= %0.1f/%0.1f, TSet= %0.1f/%0.1f, Ta= %0.1f/%0.1f, Tret= %0.1f/%0.1f", 
+  BLOG_DEBUG(OT_ANALYSIS,
     inside.get(),   inside.trend(), 
     outside.get(),  outside.trend(), 
     setpoint.get(), setpoint.trend(), 
@@ -357,59 +395,35 @@ bool SmartControl::set_operating_mode()
     inlet.get(),    inlet.trend()
   );
 
+  return _switch_mode();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The decision itself, once the anti pendel time has passed
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SmartControl::_switch_mode()
+{
   if (!_timer_switch_onoff.passed())       // last switching must been awhile back 
     return false; // no change in heating or cooling
 
-  // detetmine if COOLING should be turned ON
-  if (operating_flags.enable_Cooling == false     // when cooling is off
-    && inside.valid()  && inside.get()  > 25.0f   // and inside is above 25 degrees
-    && outside.valid() && outside.get() > 25.0f   // and outside is above 25 degrees
-  ) {
-    INFO("Switch ON Cooling, as Tinside %0.2f and Toutside %0.2f are above 25 degrees", inside.get(), outside.get());
-    operating_flags.enable_Cooling = true;  // enable cooling
-    _timer_switch_onoff.set(ANTIPENDEL_TIMEFRAME);
-    return true;
-  }
-  // detetmine if COOLING should be turned OFF
-  if (operating_flags.enable_Cooling == true        // when cooling enabled
-      && inside.valid() && inside.get() < 25.0f     // and inside is below 25 degrees
-  ) {
-    INFO("Switch OFF Cooling, as Tinside %0.2f reached below 25 degrees", inside.get());
-    operating_flags.enable_Cooling = false;  // disable cooling
-    _timer_switch_onoff.set(ANTIPENDEL_TIMEFRAME);
-    return true;
-  }
-  // detetmine if HEATING should be turned ON
-  if (operating_flags.enable_CH == false          // when heating is off
-      && inside.valid() && inside.get() < 25.0f   // and inside is below 25 degrees
-      && target.valid() && setpoint.valid()
-  ) {
-    // error: positive when inside above target
-    float error = round1(inside.get() - target.get()); 
-    // trend: positive when setpoint is rising, which is when either inside or outside are declining (degrees/30 minutes)
-    float trend  = round1(setpoint.trend());
-    // meaning: when trend is high-incline we start heating early, even when error is still large positive
-    if (2*trend > error)
-    {  
-      INFO("Switch ON Heating, Tinside error (%0.1f) < 2x trend-TSet (%0.1f)", error, trend);
-      operating_flags.enable_CH = true;  // enable heating
-      _timer_switch_onoff.set(ANTIPENDEL_TIMEFRAME);
-      return true;
-    }
-    INFO("No need for heating: inside error (%0.1f) is above 2x trend-TSet (%0.1f)", error, trend);
-  }
-  // detetmine if HEATING should be turned OFF
-  if (operating_flags.enable_CH == true       // heating enabled
-    && setpoint.valid() && inlet.valid()
-    && round1(inlet.get() - setpoint.get()) > 0.1f  // when Tr = 0.2 above Tset
-  ) 
+  ModeInput in = {
+    inside.get(),  outside.get(),  target.get(),  setpoint.get(),  setpoint.trend(), inlet.get(), 0.0f,
+    inside.valid(), outside.valid(), target.valid(), setpoint.valid(), inlet.valid(), false
+  };
+  if (Zones::instance())
+    in.zone_valid = Zones::instance()->error(in.zone_error);
+  ModeDecision d = operating_mode(in, operating_flags);
+  switch (d.change)
   {
-    INFO("Switching off Heatpump, as Tset %0.2f reached below Tr %0.2f", setpoint.get(), inlet.get());
-    operating_flags.enable_CH = false;  // disable heating
-    _timer_switch_onoff.set(ANTIPENDEL_TIMEFRAME);
-    return true;
+  case ModeCoolingOn:   BLOG_INFO(COOLING_ON, in.inside, in.outside);        break;
+  case ModeCoolingOff:  BLOG_INFO(COOLING_OFF, in.inside);                   break;
+  case ModeHeatingOn:   BLOG_INFO(HEATING_ON, d.error, d.trend);             break;
+  case ModeHeatingOff:  BLOG_INFO(HEATING_OFF, setpoint.get(), inlet.get()); break;
+  case ModeHeatingNot:  BLOG_INFO(HEATING_NOT, d.error, d.trend);            return false;
+  default:                                                                    return false;
   }
-  return false; // no change in heating or cooling
+  _timer_switch_onoff.set(ANTIPENDEL_TIMEFRAME);
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -428,8 +442,11 @@ bool SmartControl::loop()
     {
       last_request = OpenTherm::buildRequest(cmd->msgType, cmd->msgId, (cmd->getdata) != NULL ? cmd->getdata() : 0x00);
 
+      request_sent = Profiler::cycles();
+      cmd->counters.requests++;
       if (!sendRequestAync(last_request))
         ERROR("OT Send error, status: %d", status);
+      response_tm.set(OT_RESPONSE_TIMEOUT);
 
       send_tm.set(2000);
     }
@@ -442,6 +459,48 @@ bool SmartControl::loop()
   return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////
+// process() only has work when a response is in, or the library times out the request. While
+// waiting for the boiler, and during the delay after a response, the periodic run suffices.
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SmartControl::due()
+{
+  switch (status)
+  {
+  case OpenThermStatus::RESPONSE_READY:
+  case OpenThermStatus::RESPONSE_INVALID:
+    return true;
+  case OpenThermStatus::REQUEST_SENDING:
+  case OpenThermStatus::RESPONSE_WAITING:
+  case OpenThermStatus::RESPONSE_START_BIT:
+  case OpenThermStatus::RESPONSE_RECEIVING:
+    return response_tm.passed();
+  case OpenThermStatus::READY:
+  case OpenThermStatus::DELAY:            // ends long before the next request
+    return send_tm.passed();
+  default:
+    return false;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// A request on the line or a response coming in. The library stays in DELAY after each
+// response until process() sees it, that counts as idle.
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SmartControl::in_flight()
+{
+  switch (status)
+  {
+  case OpenThermStatus::REQUEST_SENDING:
+  case OpenThermStatus::RESPONSE_WAITING:
+  case OpenThermStatus::RESPONSE_START_BIT:
+  case OpenThermStatus::RESPONSE_RECEIVING:
+    return true;
+  default:
+    return false;
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -454,6 +513,34 @@ bool SmartControl::reset()
   return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+uint8_t SmartControl::ot_ids() const
+{
+  return SCRIPT_SIZE;
+}
+
+const OTCounters *SmartControl::ot_counters(uint8_t idx, uint8_t &id) const
+{
+  if (idx >= SCRIPT_SIZE)
+    return NULL;
+  id = (uint8_t) script[idx].msgId;
+  return &script[idx].counters;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Cost of each policy, the six instances share five policies
+////////////////////////////////////////////////////////////////////////////////////////////
+void SmartControl::benchmark()
+{
+  TemperatureT<InsidePolicy>::benchmark("inside");
+  TemperatureT<OutsidePolicy>::benchmark("outside");
+  TemperatureT<TargetPolicy>::benchmark("target");
+  TemperatureT<SetpointPolicy>::benchmark("setpoint");
+  TemperatureT<WaterPolicy>::benchmark("inlet/outlet");
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -1,67 +1,32 @@
 #pragma once
 
-#include <SunRise.h>
 #include <OpenTherm.h>
-#include <DallasTemperature.h>
-#include <OneWire.h>
-#include <RunningAverage.h>
 #include <Timer.h>
 
-////////////////////////////////////////////////////////////////////////////////////////////
-//
-////////////////////////////////////////////////////////////////////////////////////////////
-class Temperature
-{
-private:
-  mutable char _to_string[8];  // buffer for toString
-  float     _cur_val;           // current  value
-  float     _min_val;           // minimum allowed value
-  float     _max_val;           // maximum allowed value
-  float     _max_diff_psec;     // max change per second (0.01 per sec = 6 degrees per min)
-  float     _k;                 // factor of stddev in which a new value may differ (spike detection)
-  uint16_t  _max_age;           // maximum age in minutes before N/A will be returned, and max time between entries in the statistics
-  Timer     _age;               // age of last reading
-  Periodic  _stat_interval;     // minimum interval between statistical entries
-  Periodic  _longterm_stat_tmr;     // interval to update long term stat entries
-  mutable RunningAverage _statistics;     // 10 valid values which are added each 30 seconds (5 minutes of data)
-  mutable RunningAverage _longterm_stat;  // 10 average values added each 5 minutes (5 minutes of data)
-public:
-  Temperature(float value=0.0f, uint16_t max_age=0, float min=0.0f, float max=0.0f, float max_diff_psec=0.0f, float k=0.0f); // 0 value to disable
-  bool set(float value, bool validate=true);
-  float get() const;
-  bool valid() const;
-  float average() const;
-  const char *toString(uint8_t precision, bool celcius=true) const; // celcius=true for adding C
-  float trend() const; // negative for decline , 0 for stable, positive for incline
-};
+#include "Temperature.h"
+#include "HeatingCurve.h"
+#include "Solar.h"
+#include "OperatingMode.h"
 
-////////////////////////////////////////////////////////////////////////////////////////////
-//
-////////////////////////////////////////////////////////////////////////////////////////////
-class HeatingCurve
-{
-private:
-  float _factorA, _factorB, _factorC, _factor;
-public:
-  HeatingCurve();
-  inline float current_factor() const { return _factor; }; 
-  //returns current value, or if a valid (0<-->1.5) newval is given it will change the value and return the previous one
-  float factorA(float newval=-1.0f);  // value used to keep the house warm, based on Ttarget - Toutside
-  float factorB(float newval=-1.0f);  // value used to heat/cool the house, based on Ttarget - Tcurrent
-  float factorC(float newval=-1.0f);  // the factor used for the curve, the leniar factor will be set to 1-curve by which the 20 and 0 degrees are aligned
-
-  float calculate(Temperature *current, Temperature *target, Temperature *outside); // returns setpoint
-};
+#define ANTIPENDEL_TIMEFRAME (30*60*1000)   // no turning on/off within a 30 minutes timeframe
+
+// validation of the temperatures    min     max    °C/sec  spike  stats  longterm  max_age  noise   drift
+TEMPERATURE_POLICY(InsidePolicy,    10.0f,  40.0f,  0.02f,  3.0f,  10,    10,       5,       0.05f,  4e-5f)  // inside can only change slow
+TEMPERATURE_POLICY(OutsidePolicy,  -15.0f,  40.0f,  0.02f,  3.0f,  10,    10,       5,       0.1f,   4e-5f)  // outside can only change slow
+TEMPERATURE_POLICY(TargetPolicy,    18.0f,  25.0f,  0.0f,   0.0f,  10,    0,        0,       0.0f,   0.0f)   // does not expire, the average smooths a change
+TEMPERATURE_POLICY(SetpointPolicy,  10.0f,  55.0f,  0.0f,   0.0f,  10,    10,       5,       0.0f,   0.0f)   // no spike detection needed
+TEMPERATURE_POLICY(BoardPolicy,   -20.0f,  85.0f,  0.0f,   0.0f,  0,     0,        5,       0.0f,   0.0f)   // the DS18B20 on the shield, informative
+TEMPERATURE_POLICY(WaterPolicy,     10.0f,  55.0f,  1.0f,   3.0f,  10,    10,       5,       0.0f,   0.0f)   // during defrosts the inlet and outlet can change fast
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
 ////////////////////////////////////////////////////////////////////////////////////////////
-struct OperatingFlags 
+struct OTCounters
 {
-  bool enable_CH;         // CH enabled
-  bool enable_DHW;        // DHW enabled
-  bool enable_Cooling;    // Cooling enabled
-  bool enable_OTC;        // Outside Temperature Control enabled
+  uint32_t requests;
+  uint32_t responses;     // valid
+  uint32_t invalid;
+  uint32_t timeouts;
 };
 
 struct StatusFlags 
@@ -76,10 +41,20 @@ struct StatusFlags
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
 ////////////////////////////////////////////////////////////////////////////////////////////
+// Persistent settings (Config.cpp). Only append fields, older records are then still loaded
+// with the defaults for the new fields.
 struct ConfigData {
-  uint32_t magicNumber; // Magic number to validate data
-  HeatingCurve    _curve;  // curve settings
-  OperatingFlags  _flags;  // operating flags
+  float           factorA, factorB, factorC;  // curve settings
+  float           target;                     // target room temperature
+  OperatingFlags  flags;                      // operating flags
+  float           flow;                       // l/min for the energy accounting
+  float           solar_gain;                 // °C per kW/m² of the solar feed forward
+};
+
+// Warm start: the statistics of the measured temperatures (Config.cpp)
+struct TemperatureSnapshot {
+  uint32_t              time;       // unixtime of the snapshot
+  Temperature::Snapshot inside, outside, setpoint, inlet, outlet;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -89,39 +64,52 @@ class SmartControl : public OpenTherm
 {
 friend void handleResponse(unsigned long response, OpenThermResponseStatus state);
 private:
-  byte               _T_board[8];   // address of the DS18
-  byte               _T_extern[8];   // address of the DS18
-  OneWire            _wire;
-  DallasTemperature  _dallas;
-  SunRise            _sunrise;   // get sunrise and sunset times
   Periodic           _auto_resetter;
   Timer              _timer_switch_onoff;
   Periodic           _analyse_time;
 
   void _handleResponse(unsigned long response, OpenThermResponseStatus state);
+  bool _switch_mode();
+  void _config_get(ConfigData &data);
+  void _config_set(const ConfigData &data);
+  bool              _restored;      // the snapshot has been restored (or was too old)
+
 public:
   SmartControl();
   static SmartControl *instance();
   int communication_errors;
+  uint32_t frames;          // valid responses received from the boiler
   OperatingFlags  operating_flags;
   StatusFlags     status_flags;
   HeatingCurve    heating_curve;
+  SolarGain       solar;          // expected sunshine, lowers the setpoint ahead of it
 
   bool begin();
   bool loop();
+  bool due();         // a response needs handling or the next request may be sent
+  bool in_flight();   // a frame is on the line, the cpu must not stall now
   bool set_operating_mode();
   bool reset();
+  bool config_begin();  // load the persistent settings
+  bool config_loop();   // store changed settings, delayed to merge bursts
+  bool config_flush();  // store changed settings now, before a reboot
+  bool snapshot();      // checkpoint the temperature statistics now
+  bool restore();       // warm start once the clock is synchronized
+  void benchmark();     // of the temperature policies
+  uint8_t ot_ids() const;   // DataIds in the script
+  const OTCounters *ot_counters(uint8_t idx, uint8_t &id) const;
   float RoomCur();    // huidige kamer temperatuur
   float RoomSet();    // doel kamer temperatuur
   float SetPoint();   // aanvraag watertemperatuur
 
-  Temperature inside;    // Troom    Current room temperature
-  Temperature target;  // Ttarget  Target room temperature
-  Temperature setpoint;// Tset     Calculated Water temperature
+  TemperatureT<InsidePolicy>    inside;    // Troom    Current room temperature
+  TemperatureT<TargetPolicy>    target;  // Ttarget  Target room temperature
+  TemperatureT<SetpointPolicy>  setpoint;// Tset     Calculated Water temperature
 
-  Temperature inlet;   // Tr   boiler invoer / huis uitvoer
-  Temperature outlet;  // Ta   boiler uitvoer / huis invoer
-  Temperature outside; // Tout buiten temperatuur
+  TemperatureT<WaterPolicy>     inlet;   // Tr   boiler invoer / huis uitvoer
+  TemperatureT<WaterPolicy>     outlet;  // Ta   boiler uitvoer / huis invoer
+  TemperatureT<OutsidePolicy>   outside; // Tout buiten temperatuur
+  TemperatureT<BoardPolicy>     board;   // on the shield
 
   float ModLvl;       // Modulation level
   float Pressure;     // CH water pressure
@@ -3,7 +3,6 @@
 #include <HADevice.h>
 #include <Clock.h>
 #include <Timer.h>
-#include <ArduinoOTA.h>
 #include <DatedVersion.h>
 DATED_VERSION(0, 2)
 #define LOG_LEVEL 2
@@ -13,6 +12,20 @@ DATED_VERSION(0, 2)
 #include "HAOTMonitor.h"
 #include "SmartControl.h"
 #include "Display.h"
+#include "BinLog.h"
+#include "Format.h"
+#include "Scheduler.h"
+#include "WifiLink.h"
+#include "NtpSync.h"
+#include "Profiler.h"
+#include "Diagnostics.h"
+#include "History.h"
+#include "SensorBus.h"
+#include "Zones.h"
+#include "Energy.h"
+#include "OtaUpdate.h"
+#include "MetricsServer.h"
+#include "Benchmark.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 // Configuration
@@ -32,6 +45,19 @@ SmartControl        controller;
 HAMqtt              mqtt(socket, ha_monitor, SENSOR_COUNT);      // Home Assistant MTTQ
 Clock               rtc;                        // A real (software) time clock
 Display             display;
+BinLog              binlog;                     // Structured logging send in batches
+Diagnostics         diagnostics;                // heap and stack telemetry
+Scheduler           scheduler;                  // runs the tasks of the main loop
+WifiLink            wifi;                       // keeps the STA connection up
+NtpSync             ntp;                        // keeps the clock in sync
+Profiler            profiler;                   // latency histograms of the main sections
+History             history;                    // temperatures per minute, quarter and hour
+SensorBus           sensors(D4);                // the DS18B20s on the one-wire bus (D7 on older shields)
+Zones               zones;                      // rooms aggregated into one inside error
+Energy              energy;                     // heat, electricity and compressor cycles
+OtaUpdate           ota;                        // firmware updates, the OT schedule keeps running
+MetricsServer       metrics;                    // Prometheus text on the LAN, also without MQTT
+Benchmark           benchmark;                  // cycles of the hot paths, on request
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 // Callback functions
@@ -48,42 +74,86 @@ void LOG_CALLBACK(const char *msg) {
 // MQTT Connect
 void mqtt_connect() {
   INFO("Opentherm Gateway v%s saying hello\n", VERSION);
+  ha_monitor.subscribe(&mqtt);
+  profiler.subscribe(&mqtt);
+  history.subscribe(&mqtt);
+  sensors.subscribe(&mqtt);
+  zones.subscribe(&mqtt);
+  energy.subscribe(&mqtt);
+  benchmark.subscribe(&mqtt);
+  ha_monitor.connected();
+  binlog.flush();     // what was logged while offline
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
-// Connect to the STA network
-bool wifi_connect() 
-{ 
-  if (((WiFi.getMode() & WIFI_STA) == WIFI_STA) && WiFi.isConnected())
-    return true;
-
-  INFO("Wifi connecting to %s.", sta_ssid);
-  WiFi.begin(sta_ssid, sta_pswd);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-  }
-  INFO("WiFi connected with IP: %s\n", WiFi.localIP().toString().c_str());
-  return true;
+// MQTT messages on our own (non Home Assistant) topics
+void mqtt_message(const char* topic, const uint8_t* payload, uint16_t length) {
+  if (!ha_monitor.onMessage(topic, payload, length) &&
+      !profiler.onMessage(topic, payload, length) &&
+      !history.onMessage(topic, payload, length) &&
+      !sensors.onMessage(topic, payload, length) &&
+      !zones.onMessage(topic, payload, length) &&
+      !energy.onMessage(topic, payload, length))
+    benchmark.onMessage(topic, payload, length);
 }
 
-///////////////////////////////////////////////////////////////////////////////////////
-//
-///////////////////////////////////////////////////////////////////////////////////////
-Timer _sync_clock;  //
-
-void sync_clock() 
+////////////////////////////////////////////////////////////////////////////////////////////
+// (Re)connected to the STA network
+void wifi_connected()
 {
-  if (!_sync_clock.passed())
-    return;
-
-  INFO("Synchonizing clock");
-  if (!rtc.ntp_sync())
-    return;
-  
-  _sync_clock.set(4*60*60*1000);  // resync in 4hrs
-  INFO("Clock synchronized to %s\n", rtc.now().timestamp().c_str());
+  char ip[16];
+  INFO("WiFi connected with IP: %s\n", fmt_ip(ip, sizeof(ip), WiFi.localIP()));
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////
+// Tasks of the scheduler
+////////////////////////////////////////////////////////////////////////////////////////////
+bool ot_due()         { return controller.due(); }
+void ot_task()        { PROFILE_SCOPE(OT_LOOP); controller.loop(); }
+void ota_task()       { ota.loop(); }
+void mqtt_task()      { if (wifi.connected()) { PROFILE_SCOPE(MQTT_LOOP); mqtt.loop(); } }
+void ha_task()        { PROFILE_SCOPE(HA_UPDATE); ha_monitor.update(); }
+void binlog_task()    { binlog.loop(); }
+void profile_task()   { profiler.loop(); }
+void diag_task()      { diagnostics.loop(); }
+void config_task()    { controller.config_loop(); }
+void history_task()   { history.loop(); }
+void sensors_task()   { sensors.loop(); }
+void zones_task()     { zones.loop(); }
+void energy_task()    { energy.loop(); }
+void metrics_task()   { metrics.loop(); }
+void benchmark_task() { benchmark.loop(); }
+void wifi_task()      { wifi.loop(); }
+void clock_task()     { ntp.loop(); }
+void display_task()   { PROFILE_SCOPE(DISPLAY); display.update(WiFi.isConnected(), mqtt.isConnected(), controller.communication_errors); }
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The tasks of the scheduler, <name>_task() runs each period
+////////////////////////////////////////////////////////////////////////////////////////////
+//      name       period   prio  budget (us)                 due
+#define SCHED_TASKS(X) \
+  X(ot,        100,     0,    2000,                       ot_due) \
+  X(ota,       0,       1,    1000,                       NULL)   \
+  X(mqtt,      0,       2,    5000,                       NULL)   \
+  X(ha,        100,     3,    5000,                       NULL)   \
+  X(binlog,    100,     4,    5000,                       NULL)   \
+  X(wifi,      250,     5,    1000,                       NULL)   \
+  X(display,   100,     6,    20000,                      NULL)   \
+  X(clock,     100,     7,    2000,                       NULL)   \
+  X(diag,      1000,    8,    500,                        NULL)   \
+  X(profile,   1000,    9,    5000,                       NULL)   \
+  X(config,    1000,    10,   50000,                      NULL)   \
+  X(history,   1000,    11,   50000,                      NULL)   \
+  X(sensors,   100,     12,   30000,                      NULL)   \
+  X(zones,     100,     13,   5000,                       NULL)   \
+  X(energy,    1000,    14,   5000,                       NULL)   \
+  X(metrics,   50,      15,   METRICS_BUDGET_US + 1000,   NULL)   \
+  X(benchmark, 1000,    16,   0,                          NULL)
+
+#define SCHED_COUNT(name, period, prio, budget, due)  +1
+#define SCHED_ADD(name, period, prio, budget, due)    scheduler.add(#name, name##_task, period, prio, budget, due);
+static_assert(0 SCHED_TASKS(SCHED_COUNT) <= SCHED_MAX_TASKS, "raise SCHED_MAX_TASKS");
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -91,74 +161,51 @@ void setup()
 {
   // Begin display drivers
   display.begin();
+  diagnostics.begin();
 
 //  Serial.begin(115200);
   INFO("\nOpenTherm Controller Version %s", VERSION);
-  wifi_connect();
-
-  sync_clock(); 
+  wifi.onConnected(wifi_connected);
+  wifi.begin(sta_ssid, sta_pswd);   // the scheduler completes the connection
+  ntp.begin();                      // and synchronizes the clock once connected
 
-  // start MQTT to enable remote logging asap
+  // start MQTT to enable remote logging asap, it connects once the WiFi is up
   INFO("Connecting to MQTT server %s", mqtt_server);
   uint8_t mac[6];
   WiFi.macAddress(mac);
+  controller.config_begin();                // the stored settings are the initial HA states
   ha_monitor.begin(mac, &mqtt);
   mqtt.onConnected(mqtt_connect);           // register function called when newly connected
+  mqtt.onMessage(mqtt_message);             // register function called for each message
   mqtt.begin(mqtt_server, mqtt_port, mqtt_user, mqtt_passwd);  // 
+  binlog.begin(&mqtt);
+  profiler.begin(&mqtt);
+  history.begin(&mqtt);
+  energy.begin(&mqtt);
+  benchmark.begin(&mqtt);
 
   // Begin opentherm libraries for master and slave
   INFO("Initialize Opentherm Shields");
+  sensors.begin();
+  sensors.listen([](const char *label, float t) { zones.local(label, t); });
+  zones.begin(&mqtt);
   controller.begin();
+  metrics.begin();
 
   INFO("Initialize OTA\n");
-  ArduinoOTA.setPort(8266);
-  ArduinoOTA.setHostname("OpenTherm-SmartControl");
-  ArduinoOTA.setPassword(OTA_PASS);
-
-  ArduinoOTA.onStart([]() {
-    INFO("[%s] - Starting remote software update",
-          rtc.now().timestamp(DateTime::TIMESTAMP_TIME).c_str());
-  });
-  ArduinoOTA.onEnd([]() {
-    INFO("[%s] - Remote software update finished",
-          rtc.now().timestamp(DateTime::TIMESTAMP_TIME).c_str());
-  });
-  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-  });
-  ArduinoOTA.onError([](ota_error_t error) {
-    ERROR("Error remote software update");
-  });
-  ArduinoOTA.begin();
+  ota.begin("OpenTherm-SmartControl", OTA_PASS);
+
+  SCHED_TASKS(SCHED_ADD)
   INFO("Setup complete");
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
 ////////////////////////////////////////////////////////////////////////////////////////////
-Periodic refresh(1000);
-
 void loop() 
 {
-  // ensure we are still connected
-  wifi_connect();
-  // handle any OTA requests
-  ArduinoOTA.handle();
-  // once in awhile sync the clock
-  sync_clock(); 
-  // handle OT thermometer
-  controller.loop();
-  // handle any OTA requests
-  ArduinoOTA.handle();
-  // update display
-  display.update(WiFi.isConnected(), mqtt.isConnected(), controller.communication_errors);
-  // handle any OTA requests
-  ArduinoOTA.handle();
-  // update Home Assistant
-  ha_monitor.update(); 
-  // handle MQTT
-  mqtt.loop();
+  scheduler.loop();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////
-
@@ -0,0 +1,107 @@
+#include "Solar.h"
+#include <Clock.h>
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+#include "Format.h"
+
+#define SECONDS_PER_DAY   86400UL
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+SolarGain::SolarGain(float latitude, float longitude)
+: _latitude(latitude), _longitude(longitude)
+{
+  _sun.queryTime = 0;
+  _day = 0;
+  memset(_irradiance, 0, sizeof(_irradiance));
+  gain = SOLAR_GAIN;
+  sunrise = sunset = 0;
+  peak = 0;
+  updates = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Declination and equation of time by the day of the year, the Haurwitz clear sky model on
+// the zenith angle. Within some 10% of the measured clear sky, plenty for a feed forward.
+////////////////////////////////////////////////////////////////////////////////////////////
+float SolarGain::clear_sky(float latitude, float longitude, uint32_t utc)
+{
+  DateTime t(utc);
+  float day = (utc - DateTime(t.year(), 1, 1).unixtime()) / (float) SECONDS_PER_DAY;
+  float declination = radians(23.44f) * sinf(TWO_PI * (284.0f + day) / 365.0f);
+  float b = TWO_PI * (day - 81.0f) / 364.0f;
+  float eot = 9.87f * sinf(2*b) - 7.53f * cosf(b) - 1.5f * sinf(b);   // minutes
+  float solar_time = (utc % SECONDS_PER_DAY) / 3600.0f + longitude / 15.0f + eot / 60.0f;
+  float hour_angle = radians(15.0f * (solar_time - 12.0f));
+  float lat = radians(latitude);
+  float cos_z = sinf(lat) * sinf(declination) + cosf(lat) * cosf(declination) * cosf(hour_angle);
+  if (cos_z <= 0.0f)
+    return 0.0f;
+  return 1098.0f * cos_z * expf(-0.057f / cos_z);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Once per local day, the rest of the calls are a compare
+////////////////////////////////////////////////////////////////////////////////////////////
+bool SolarGain::update(uint32_t local, int32_t utc_offset)
+{
+  uint32_t midnight = local - local % SECONDS_PER_DAY;
+  if (midnight == _day)
+    return false;
+
+  _day = midnight;
+  _sun.calculate(_latitude, _longitude, midnight - utc_offset);
+  sunrise = _sun.hasRise ? _sun.riseTime + utc_offset : 0;
+  sunset  = _sun.hasSet  ? _sun.setTime  + utc_offset : 0;
+
+  peak = 0;
+  uint8_t top = 0;
+  for (uint8_t s=0; s<SOLAR_SLOTS; s++)
+  {
+    uint32_t t = midnight + s * SOLAR_SLOT;
+    _irradiance[s] = (uint16_t) clear_sky(_latitude, _longitude, t - utc_offset);
+    if (_irradiance[s] > peak) {
+      peak = _irradiance[s];
+      top = s;
+    }
+  }
+  updates++;
+
+  char rise[10], set[10];
+  INFO("Solar: sunrise %s, sunset %s, clear sky peak %u W/m2 at %02d:%02d",
+    sunrise ? fmt_time(rise, sizeof(rise), DateTime(sunrise), false) : "-",
+    sunset  ? fmt_time(set,  sizeof(set),  DateTime(sunset), false)  : "-",
+    peak, top / 4, (top % 4) * 15);
+  return true;
+}
+
+bool SolarGain::cached(uint32_t local) const
+{
+  return _day != 0 && local >= _day && local < _day + SECONDS_PER_DAY;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Linear between two slots, the day after the cached one is dark at its start anyway
+////////////////////////////////////////////////////////////////////////////////////////////
+float SolarGain::irradiance(uint32_t local) const
+{
+  if (!cached(local))
+    return 0.0f;
+  uint32_t t = local - _day;
+  uint8_t s = t / SOLAR_SLOT;
+  float a = _irradiance[s];
+  float b = s + 1 < SOLAR_SLOTS ? _irradiance[s + 1] : 0.0f;
+  return a + (b - a) * (t % SOLAR_SLOT) / (float) SOLAR_SLOT;
+}
+
+float SolarGain::offset(uint32_t local) const
+{
+  float ahead = irradiance(local + SOLAR_LEAD);
+  float o = gain * ahead / 1000.0f;
+  return o > SOLAR_MAX_OFFSET ? SOLAR_MAX_OFFSET : o;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
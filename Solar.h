@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SunRise.h>
+
+#define SOLAR_SLOTS       96              // quarter hours of the cached day
+#define SOLAR_SLOT        (15*60)         // seconds per slot
+#define SOLAR_LEAD        (2*60*60)       // s, the floor heating answers a lower setpoint hours later
+#define SOLAR_GAIN        1.5f            // °C of setpoint per kW/m² expected, 0 disables
+#define SOLAR_MAX_OFFSET  5.0f            // °C, the most the setpoint is lowered
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Feed forward of the solar gain. Once per day the sunrise, sunset and the clear sky
+// irradiance of each quarter hour (Haurwitz) are calculated and cached, the control tick
+// then only interpolates the cache SOLAR_LEAD ahead and scales it by the gain.
+// There is no weather forecast on the device, so this is the clear sky. The gain (per house,
+// per window) is tuned with tools/solar_replay.py on recorded weather.
+// All times are local unix times (the Clock), the caller passes them so a replay can too.
+////////////////////////////////////////////////////////////////////////////////////////////
+class SolarGain
+{
+private:
+  SunRise   _sun;
+  float     _latitude, _longitude;
+  uint32_t  _day;                         // local midnight of the cached day, 0 for none
+  uint16_t  _irradiance[SOLAR_SLOTS];     // W/m² clear sky, at the start of each slot
+public:
+  SolarGain(float latitude, float longitude);
+  static float clear_sky(float latitude, float longitude, uint32_t utc);   // W/m² horizontal
+
+  float     gain;                         // °C per kW/m²
+  uint32_t  sunrise, sunset;              // local time of the cached day, 0 for none
+  uint16_t  peak;                         // W/m² highest of the cached day
+  uint32_t  updates;
+
+  bool update(uint32_t local, int32_t utc_offset);   // true when the day was (re)calculated
+  bool cached(uint32_t local) const;
+  float irradiance(uint32_t local) const;  // W/m², 0 outside the cached day
+  float offset(uint32_t local) const;      // °C to lower the setpoint now
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
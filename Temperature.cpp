@@ -1,69 +1,67 @@
-#include "SmartControl.h"
+#include "Temperature.h"
 #define LOG_REMOTE
 #define LOG_LEVEL 3
 #include <Logging.h>
 #include <Timer.h>
-
-#define STATISTICS_BUFFER_SIZE   10          // number of values to store
-#define STATISTICS_BUFFER_TIMER  (30*1000)   // minimum time between entries
+#include "BinLog.h"
+#include "Format.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 // °C
 ////////////////////////////////////////////////////////////////////////////////////////////
-Temperature::Temperature(float val, uint16_t max_age, float min, float max, float max_diff_psec, float k)
-: _statistics(STATISTICS_BUFFER_SIZE)
-, _longterm_stat(STATISTICS_BUFFER_SIZE)
-, _stat_interval(STATISTICS_BUFFER_TIMER)
-, _longterm_stat_tmr(STATISTICS_BUFFER_TIMER * STATISTICS_BUFFER_SIZE)
-, _cur_val(val), _max_age(max_age)      // maximum age of a value
-, _min_val(min), _max_val(max)          // min and max absolute boundaries
-, _max_diff_psec(max_diff_psec), _k(k)  // max delta with previous measurements
+Temperature::Temperature(float val, uint16_t max_age)
+: _cur_val(val), _max_age(max_age)      // maximum age of a value
+, _statistics(NULL), _longterm_stat(NULL), _estimator(NULL)
 {
   _age.set(0);  // ensure the _age has passed to indicate invalid value
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
-//
+// The checks of set() which are enabled by the policy
 ////////////////////////////////////////////////////////////////////////////////////////////
-bool Temperature::set(float value, bool validate) 
+bool Temperature::_rate(float value, float max_diff_psec) const
 {
-  bool spike = false;
-  if (validate)
-  {
-    if (!valid())    // if last value has become invalid, then also the _statistics
-      _statistics.clear();
-    // do nothing if exceeding min, max boundaries
-    if (_max_val !=0.0f && value > _max_val)
-      return false;
-    if (_min_val !=0.0f && value < _min_val)
-      return false;
-    
-    // do nothing if exceeding threshold
-    if (_max_diff_psec !=0.0f && valid() && _age.elapsed() > 0) // if previous value is valid (&& prevent div_by_zero)
-    {
-      float change_per_sec = std::abs(value-_cur_val) * 1000.0f / _age.elapsed();
-      if (change_per_sec > _max_diff_psec) {
-        INFO("Temp exceeding threshold of %.3f C/s (change is %.3f C/s)", _max_diff_psec, change_per_sec);
-        return false;
-      }
-    }
-    // spikes
-    if (_k !=0.0f && _statistics.bufferIsFull()) {
-      if (spike = (std::abs(value - _statistics.getFastAverage()) > (_k * _statistics.getStandardDeviation())))
-        DEBUG("SPIKE detected!!! value %.2f", value);
-    }
+  if (!valid() || _age.elapsed() == 0)  // if previous value is valid (&& prevent div_by_zero)
+    return true;
+  float change_per_sec = std::abs(value-_cur_val) * 1000.0f / _age.elapsed();
+  if (change_per_sec > max_diff_psec) {
+    BLOG_INFO(TEMP_THRESHOLD, max_diff_psec, change_per_sec);
+    return false;
   }
-  if (_stat_interval)           // Note: we do add spikes to update stddev !
-    _statistics.add(value);
+  return true;
+}
+
+bool Temperature::_spike(float value, float k) const
+{
+  if (!_statistics->bufferIsFull())
+    return false;
+  bool spike = std::abs(value - _statistics->getFastAverage()) > (k * _statistics->getStandardDeviation());
+  if (spike)
+    BLOG_DEBUG(TEMP_SPIKE, value);
+  return spike;
+}
 
-  if (_longterm_stat_tmr)
-    _longterm_stat.add(_statistics.getFastAverage());
+bool Temperature::_estimate(float value, float noise, float drift, float gate)
+{
+  if (!valid())         // start over after a gap
+    _estimator->restart();
+  if (_estimator->update(value, millis(), noise, drift, gate))
+    return true;
+  BLOG_DEBUG(TEMP_SPIKE, value);
+  return false;
+}
 
+void Temperature::_accept(float value, bool spike)
+{
   if (!spike) {
     _cur_val = value;
     _age.set(_max_age * 60000); // flag as valid for max_age minutes
   }
-  return true;  // value set
+}
+
+void Temperature::_benchmark(const char *name, uint32_t cycles, size_t size, uint32_t heap)
+{
+  INFO("Temperature %s: %u cycles per sample, %u bytes (object %u, statistics %u)", name, cycles, heap, size, heap > size ? heap - size : 0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -80,8 +78,8 @@ bool Temperature::valid() const {
 float Temperature::average() const 
 {
   // instead of the average we may use the mean to filter out spikes / errors
-  if (_statistics.getCount() > 0)
-    return _statistics.getFastAverage();
+  if (_statistics && _statistics->getCount() > 0)
+    return _statistics->getFastAverage();
   return _cur_val;    // is most likely the initial/default value
 }
 
@@ -90,19 +88,17 @@ const char *Temperature::toString(uint8_t precision, bool celcius) const
 {
   if (!valid())
     return "n/a";   // or --
-  snprintf(_to_string, sizeof(_to_string), "%.*f%c", precision, _cur_val, celcius?'C':'\0'); // °C
-
-  return _to_string;
+  return fmt_fixed(_to_string, sizeof(_to_string), _cur_val, precision, celcius ? "C" : ""); // °C
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 float Temperature::trend() const 
 {
-  if (_statistics.getCount() == 0 || _longterm_stat.getCount() == 0)
+  if (!_longterm_stat || _statistics->getCount() == 0 || _longterm_stat->getCount() == 0)
     return 0; // not enough data available (takes 30 minutes to get at least one longterm stat)
 
-  float avg_long = _longterm_stat.getFastAverage();
-  float avg_last = _statistics.getFastAverage();
+  float avg_long = _longterm_stat->getFastAverage();
+  float avg_last = _statistics->getFastAverage();
 
   if (abs(avg_last - avg_long) < 0.1f)  // filter noise
     return 0;                 // 0 for steady
@@ -110,5 +106,143 @@ float Temperature::trend() const
   return avg_last - avg_long; // <0.1 for falling, >0.1 for raising
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////
+float Temperature::estimate() const
+{
+  if (_estimator && _estimator->started())
+    return _estimator->value();
+  return average();
+}
+
+float Temperature::rate() const {
+  return (_estimator && _estimator->started()) ? _estimator->rate() * 3600.0f : 0.0f;
+}
+
+float Temperature::deviation() const {
+  return (_estimator && _estimator->started()) ? sqrtf(_estimator->variance()) : 0.0f;
+}
+
+uint32_t Temperature::age() const {
+  return _age.elapsed();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+TemperatureEstimator::TemperatureEstimator()
+{
+  _reset(0.0f, 0.0f, 0);
+  _started = false;
+  outliers = 0;
+}
+
+void TemperatureEstimator::_reset(float value, float noise, uint32_t now)
+{
+  _x = value;
+  _v = 0.0f;
+  _p00 = _p11 = noise * noise;    // the rate is unknown, allow noise °C per second
+  _p01 = 0.0f;
+  _last = now;
+  _rejected = 0;
+  _started = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Predict over dt with white noise on the rate, then correct with the innovation
+////////////////////////////////////////////////////////////////////////////////////////////
+bool TemperatureEstimator::update(float z, uint32_t now, float noise, float drift, float gate)
+{
+  if (!_started) {
+    _reset(z, noise, now);
+    return true;
+  }
+  float dt = (now - _last) / 1000.0f;
+  _last = now;
+  if (dt > 0.0f)
+  {
+    float q = drift * drift;
+    _x += _v * dt;
+    _p00 += dt * (2.0f * _p01 + dt * _p11) + q * dt * dt * dt / 3.0f;
+    _p01 += dt * _p11 + q * dt * dt / 2.0f;
+    _p11 += q * dt;
+  }
+
+  float y = z - _x;                   // innovation
+  float s = _p00 + noise * noise;     // and its expected variance
+  if (gate > 0.0f && y * y > gate * gate * s)
+  {
+    if (++_rejected < ESTIMATOR_STEP) {
+      outliers++;
+      return false;
+    }
+    _reset(z, noise, now);            // it persists, a real step
+    return true;
+  }
+  _rejected = 0;
+
+  float k0 = _p00 / s, k1 = _p01 / s;
+  _x += k0 * y;
+  _v += k1 * y;
+  _p11 -= k1 * _p01;                  // P = (I - KH) P, in this order
+  _p01 -= k0 * _p01;
+  _p00 -= k0 * _p00;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+static int16_t centi(float value) {
+  return (int16_t) lroundf(value * 100.0f);
+}
+
+void Temperature::snapshot(Snapshot &s) const
+{
+  memset(&s, 0, sizeof(s));
+  s.value = centi(_cur_val);
+  s.count = valid() ? 0x80 : 0;
+  if (_statistics) {
+    s.count |= _statistics->getCount();
+    for (uint8_t i=0; i<_statistics->getCount() && i<STATISTICS_BUFFER_SIZE; i++)
+      s.statistics[i] = centi(_statistics->oldest(i));
+  }
+  if (_longterm_stat) {
+    s.longterm_count = _longterm_stat->getCount();
+    for (uint8_t i=0; i<_longterm_stat->getCount() && i<STATISTICS_BUFFER_SIZE; i++)
+      s.longterm[i] = centi(_longterm_stat->oldest(i));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The snapshot goes in front of what has been measured since the boot, both oldest first
+////////////////////////////////////////////////////////////////////////////////////////////
+static void prepend(TemperatureStats *stat, const int16_t *values, uint8_t count)
+{
+  if (stat == NULL)
+    return;
+  float recent[STATISTICS_BUFFER_SIZE];
+  uint8_t n = stat->getCount();
+  for (uint8_t i=0; i<n && i<STATISTICS_BUFFER_SIZE; i++)
+    recent[i] = stat->oldest(i);
+  stat->clear();
+  for (uint8_t i=0; i<count && i<STATISTICS_BUFFER_SIZE; i++)
+    stat->add(values[i] / 100.0f);
+  for (uint8_t i=0; i<n && i<STATISTICS_BUFFER_SIZE; i++)
+    stat->add(recent[i]);
+}
+
+void Temperature::restore(const Snapshot &s, uint32_t age)
+{
+  bool measured = _statistics && _statistics->getCount() > 0;
+  prepend(_statistics, s.statistics, s.count & 0x7F);
+  prepend(_longterm_stat, s.longterm, s.longterm_count);
+
+  if (measured)
+    return;   // the current value is newer
+  _cur_val = s.value / 100.0f;
+  if ((s.count & 0x80) && _max_age != 0 && age < _max_age * 60000UL)
+    _age.set(_max_age * 60000UL - age);   // valid for what remains of max_age
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////
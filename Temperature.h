@@ -0,0 +1,232 @@
+#pragma once
+
+#include <Arduino.h>
+#include <RunningAverage.h>
+#include <Timer.h>
+
+#define STATISTICS_BUFFER_SIZE   10          // number of values to store
+#define STATISTICS_BUFFER_TIMER  (30*1000)   // minimum time between entries
+#define ESTIMATOR_STEP           3           // successive outliers taken as a real step
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The validation of a temperature is fixed at compile time by a policy, a check which is
+// disabled (0) compiles away and so do the statistics of depth 0 and the estimator:
+//
+//   struct InsidePolicy {
+//     static constexpr float    min = 10.0f, max = 40.0f;  // absolute boundaries
+//     static constexpr float    rate = 0.02f;              // max change per second
+//     static constexpr float    spike = 3.0f;              // factor of the stddev
+//     static constexpr float    noise = 0.05f;             // sensor stddev, 0 for no estimator
+//     static constexpr float    drift = 4e-5f;             // change of the rate, °C/s per √s
+//     static constexpr uint8_t  stats = 10, longterm = 10; // depth of the statistics
+//     static constexpr uint16_t max_age = 5;               // minutes until n/a
+//   };
+////////////////////////////////////////////////////////////////////////////////////////////
+// With an estimator the spike factor gates the innovation instead of the statistics.
+#define TEMPERATURE_POLICY(policy, lo, hi, rate_psec, k, depth, longterm_depth, age, r, q) \
+  struct policy {                                                                     \
+    static constexpr float    min = lo, max = hi, rate = rate_psec, spike = k;        \
+    static constexpr float    noise = r, drift = q;                                   \
+    static constexpr uint8_t  stats = depth, longterm = longterm_depth;               \
+    static constexpr uint16_t max_age = age;                                          \
+  };
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// RunningAverage which also gives its values in the order they were added, getElement() is
+// the raw ring where the oldest value is at the write index once the buffer is full
+////////////////////////////////////////////////////////////////////////////////////////////
+class TemperatureStats : public RunningAverage
+{
+public:
+  TemperatureStats(uint16_t size) : RunningAverage(size) {}
+  float oldest(uint16_t i) const    // 0 for the oldest value
+  {
+    uint16_t pos = (bufferIsFull() ? _index : 0) + i;
+    return getElement(pos < getSize() ? pos : pos - getSize());
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Kalman filter on value and rate (constant rate model), a fixed handful of float operations
+// per sample. A sample outside gate sigma of the expected spread is rejected, unless it
+// persists, then it is a real step and the filter restarts on it.
+////////////////////////////////////////////////////////////////////////////////////////////
+class TemperatureEstimator
+{
+private:
+  float     _x, _v;             // estimate, rate per second
+  float     _p00, _p01, _p11;   // covariance of the estimate
+  uint32_t  _last;              // millis of the last sample
+  uint8_t   _rejected;          // successive outliers
+  bool      _started;
+
+  void _reset(float value, float noise, uint32_t now);
+public:
+  TemperatureEstimator();
+  uint32_t  outliers;
+
+  void restart()                { _started = false; }
+  bool update(float value, uint32_t now, float noise, float drift, float gate);  // false for an outlier
+  bool started() const          { return _started; }
+  float value() const           { return _x; }
+  float rate() const            { return _v; }
+  float variance() const        { return _p00; }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// What the users of a temperature see, whatever its policy
+////////////////////////////////////////////////////////////////////////////////////////////
+class Temperature
+{
+public:
+  struct Snapshot {             // statistics in centi degrees, 44 bytes
+    int16_t  value;
+    uint8_t  count;             // bit 7 set when the value was valid
+    uint8_t  longterm_count;
+    int16_t  statistics[STATISTICS_BUFFER_SIZE];
+    int16_t  longterm[STATISTICS_BUFFER_SIZE];
+  };
+protected:
+  mutable char _to_string[8];  // buffer for toString
+  float     _cur_val;           // current  value
+  uint16_t  _max_age;           // maximum age in minutes before N/A will be returned, 0 for never
+  Timer     _age;               // age of last reading
+  TemperatureStats *_statistics;  // 10 valid values which are added each 30 seconds, NULL for none
+  TemperatureStats *_longterm_stat; // 10 average values added each 5 minutes, NULL for none
+  TemperatureEstimator *_estimator; // NULL for none
+
+  Temperature(float value, uint16_t max_age);   // the policy sets the pointers to its members
+  bool _estimate(float value, float noise, float drift, float gate);  // false for an outlier
+  bool _rate(float value, float max_diff_psec) const;   // false when changing too fast
+  bool _spike(float value, float k) const;              // true when outside k stddev
+  void _accept(float value, bool spike);
+  static void _benchmark(const char *name, uint32_t cycles, size_t size, uint32_t heap);
+public:
+  float get() const;
+  bool valid() const;
+  float average() const;
+  const char *toString(uint8_t precision, bool celcius=true) const; // celcius=true for adding C
+  float trend() const; // negative for decline , 0 for stable, positive for incline
+  float estimate() const;   // low lag smoothed value, the average without an estimator
+  float rate() const;       // °C per hour, 0 without an estimator
+  float deviation() const;  // stddev of the estimate, 0 without an estimator
+  uint32_t age() const;     // ms since the last accepted value
+  void snapshot(Snapshot &s) const;
+  void restore(const Snapshot &s, uint32_t age);  // age of the snapshot in ms
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// A statistics buffer with its own interval, nothing at all for depth 0
+////////////////////////////////////////////////////////////////////////////////////////////
+template<uint8_t N>
+struct TemperatureBuffer
+{
+  Periodic       interval;
+  TemperatureStats values;
+
+  TemperatureBuffer(uint32_t ms) : interval(ms), values(N) {}
+  TemperatureStats *get() { return &values; }
+};
+
+template<>
+struct TemperatureBuffer<0>
+{
+  TemperatureBuffer(uint32_t) {}
+  TemperatureStats *get() { return NULL; }
+};
+
+template<bool enabled>
+struct TemperatureFilter
+{
+  TemperatureEstimator    estimator;
+  TemperatureEstimator *get()   { return &estimator; }
+};
+
+template<>
+struct TemperatureFilter<false>
+{
+  TemperatureEstimator *get()   { return NULL; }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+template<class P>
+class TemperatureT : public Temperature
+{
+  static_assert(P::stats <= STATISTICS_BUFFER_SIZE && P::longterm <= STATISTICS_BUFFER_SIZE, "a snapshot holds STATISTICS_BUFFER_SIZE values");
+  static_assert(P::longterm == 0 || P::stats > 0, "the long term statistics average the short term ones");
+  static_assert(P::spike == 0.0f || P::stats > 0 || P::noise != 0.0f, "spike detection needs statistics or an estimator");
+private:
+  TemperatureBuffer<P::stats>     _short;
+  TemperatureBuffer<P::longterm>  _long;
+  TemperatureFilter<(P::noise != 0.0f)> _filter;
+  void _add(TemperatureBuffer<0> &, float) {}
+  template<uint8_t N> void _add(TemperatureBuffer<N> &b, float value) {
+    if (b.interval)
+      b.values.add(value);
+  }
+public:
+  TemperatureT(float value=0.0f)
+  : Temperature(value, P::max_age)
+  , _short(STATISTICS_BUFFER_TIMER)
+  , _long(STATISTICS_BUFFER_TIMER * STATISTICS_BUFFER_SIZE)
+  {
+    _statistics = _short.get();     // constructed by now
+    _longterm_stat = _long.get();
+    _estimator = _filter.get();
+  }
+
+  bool set(float value, bool validate=true)
+  {
+    bool spike = false;
+    if (validate)
+    {
+      if (P::stats > 0 && !valid())   // if last value has become invalid, then also the statistics
+        _statistics->clear();
+      // do nothing if exceeding min, max boundaries
+      if (P::max != 0.0f && value > P::max)
+        return false;
+      if (P::min != 0.0f && value < P::min)
+        return false;
+      // do nothing if exceeding threshold
+      if (P::rate != 0.0f && !_rate(value, P::rate))
+        return false;
+      if (P::noise != 0.0f)
+        spike = !_estimate(value, P::noise, P::drift, P::spike);
+      else if (P::spike != 0.0f)
+        spike = _spike(value, P::spike);
+    }
+    else if (P::noise != 0.0f)
+      _estimate(value, P::noise, P::drift, 0.0f);
+    if (P::noise == 0.0f || !spike) // Note: without estimator we do add spikes to update stddev !
+      _add(_short, value);
+    if (P::longterm > 0)
+      _add(_long, _statistics->getFastAverage());
+    _accept(value, spike);
+    return true;  // value set
+  }
+
+  // cycles per set() and bytes per instance (object and statistics), on a scratch instance.
+  // The samples are 1 ms apart and rise 0.01 C/s, so they pass the rate check, not skip it.
+  static void benchmark(const char *name, uint16_t samples=1000)
+  {
+    uint32_t heap = ESP.getFreeHeap();
+    TemperatureT<P> *t = new TemperatureT<P>(P::max > 0.0f ? (P::min + P::max) / 2 : 20.0f);
+    heap -= ESP.getFreeHeap();
+    float value = t->get();
+    uint32_t cycles = 0;
+    for (uint16_t i=0; i<samples; i++) {
+      delay(1);
+      uint32_t start = ESP.getCycleCount();
+      t->set(value + i * 0.00001f);
+      cycles += ESP.getCycleCount() - start;
+    }
+    cycles /= samples;
+    delete t;
+    _benchmark(name, cycles, sizeof(TemperatureT<P>), heap);
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
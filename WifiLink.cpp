@@ -0,0 +1,114 @@
+#include "WifiLink.h"
+#include <ESP8266WiFi.h>
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+WifiLink *_wifilink = 0;
+WifiLink *WifiLink::instance() { return _wifilink; }
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+WifiLink::WifiLink()
+{
+  _wifilink = this;
+  _ssid = _pswd = NULL;
+  _state = Idle;
+  _backoff = WIFI_BACKOFF_MIN;
+  _attempt = _lost = 0;
+  _on_connected = NULL;
+  attempts = outages = last_outage = longest_outage = reconnect_time = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// we do the reconnecting ourselves, and do not write the credentials to flash each time
+////////////////////////////////////////////////////////////////////////////////////////////
+bool WifiLink::begin(const char *ssid, const char *pswd)
+{
+  _ssid = ssid;
+  _pswd = pswd;
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(false);
+  _lost = millis();
+  _connect();
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+void WifiLink::_connect()
+{
+  INFO("WiFi connecting to %s (attempt %u)", _ssid, attempts +1);
+  WiFi.disconnect();
+  WiFi.begin(_ssid, _pswd);
+  attempts++;
+  _attempt = millis();
+  _timer.set(WIFI_CONNECT_TIMEOUT);
+  _state = Connecting;
+}
+
+void WifiLink::_failed()
+{
+  INFO("WiFi attempt failed (status %d), retry in %u sec", WiFi.status(), _backoff / 1000);
+  _timer.set(_backoff);
+  _backoff = min((uint32_t) WIFI_BACKOFF_MAX, _backoff * 2);
+  _state = Backoff;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Only polls, never waits
+////////////////////////////////////////////////////////////////////////////////////////////
+bool WifiLink::loop()
+{
+  wl_status_t status = WiFi.status();
+
+  switch (_state)
+  {
+  case Idle:
+    break;
+
+  case Connecting:
+    if (status == WL_CONNECTED)
+    {
+      uint32_t now = millis();
+      reconnect_time = now - _attempt;
+      last_outage = now - _lost;
+      if (last_outage > longest_outage)
+        longest_outage = last_outage;
+      _backoff = WIFI_BACKOFF_MIN;
+      _state = Connected;
+      INFO("WiFi connected in %u ms, after %u sec offline (%u outages, longest %u sec)",
+        reconnect_time, last_outage / 1000, outages, longest_outage / 1000);
+      if (_on_connected)
+        _on_connected();
+    }
+    else if (status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED || status == WL_WRONG_PASSWORD || _timer.passed())
+      _failed();
+    break;
+
+  case Connected:
+    if (status != WL_CONNECTED)
+    {
+      outages++;
+      _lost = millis();
+      ERROR("WiFi connection lost (status %d)", status);
+      _timer.set(WIFI_BACKOFF_MIN);   // first retry after a second
+      _state = Backoff;
+    }
+    break;
+
+  case Backoff:
+    if (_timer.passed())
+      _connect();
+    break;
+  }
+  return _state == Connected;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Timer.h>
+
+#define WIFI_CONNECT_TIMEOUT  (15*1000)   // give up an attempt after 15 seconds
+#define WIFI_BACKOFF_MIN      (1000)      // first retry after a second
+#define WIFI_BACKOFF_MAX      (60*1000)   // and doubled until once a minute
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Keeps the STA connection up without ever blocking the loop. An attempt is started and
+// polled, a failed attempt is retried with an exponential backoff. The control continues
+// offline, the telemetry is buffered until the link (and MQTT) returns.
+////////////////////////////////////////////////////////////////////////////////////////////
+class WifiLink
+{
+public:
+  enum State : uint8_t { Idle, Connecting, Connected, Backoff };
+
+private:
+  const char *_ssid;
+  const char *_pswd;
+  State     _state;
+  Timer     _timer;           // attempt timeout or backoff
+  uint32_t  _backoff;
+  uint32_t  _attempt;         // millis of the start of the attempt
+  uint32_t  _lost;            // millis of the loss of the link
+  void    (*_on_connected)();
+
+  void _connect();
+  void _failed();
+public:
+  WifiLink();
+  static WifiLink *instance();
+
+  uint32_t attempts;          // connection attempts
+  uint32_t outages;           // number of times the link was lost
+  uint32_t last_outage;       // ms without link, of the last outage
+  uint32_t longest_outage;    // ms
+  uint32_t reconnect_time;    // ms from the start of the last attempt until connected
+
+  bool begin(const char *ssid, const char *pswd);
+  void onConnected(void (*callback)())  { _on_connected = callback; }
+  bool loop();                            // returns true when connected
+  bool connected() const                  { return _state == Connected; }
+  State state() const                     { return _state; }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
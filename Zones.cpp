@@ -0,0 +1,360 @@
+#include "Zones.h"
+#include "ConfigStore.h"
+#include <HAMqtt.h>
+#define LOG_REMOTE
+#define LOG_LEVEL 2
+#include <Logging.h>
+
+#define ZONES_VERSION   1
+#define ZONE_NONE       1e9f          // leaf of an inactive zone in the min tree
+
+uint32_t    zone_data[(sizeof(ZoneTable) + 3) / 4];
+EspFlash    zone_flash(FLASH_ZONES);
+ConfigStore zone_store(zone_flash, ZONES_VERSION, sizeof(ZoneTable), zone_data);
+
+static const char *_strategies[] = { "weighted", "worst", "demand" };
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// singleton object
+Zones *_zones = 0;
+Zones *Zones::instance() { return _zones; }
+
+const char *Zones::strategy_name(uint8_t strategy) {
+  return strategy <= Demand ? _strategies[strategy] : "unknown";
+}
+
+uint16_t Zones::_hash(const char *name)     // never 0, which is no source
+{
+  uint16_t h = 5381;
+  while (*name)
+    h = (h << 5) + h + *name++;
+  return h ? h : 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Linear probing from the slot of the hash up to an empty slot, there always is one. The
+// index is rebuilt when the table changes, so nothing is ever removed from it.
+////////////////////////////////////////////////////////////////////////////////////////////
+static_assert((ZONE_SLOTS & (ZONE_SLOTS - 1)) == 0 && ZONE_SLOTS > ZONES_MAX, "ZONE_SLOTS is a power of 2 above ZONES_MAX");
+#define ZONE_SLOT(h)    ((h) & (ZONE_SLOTS - 1))
+
+static void zone_insert(int8_t *slots, uint16_t hash, uint8_t zone)
+{
+  uint8_t s = ZONE_SLOT(hash);
+  while (slots[s] >= 0)
+    s = ZONE_SLOT(s + 1);
+  slots[s] = zone;
+}
+
+void Zones::_index()
+{
+  memset(_by_name, -1, sizeof(_by_name));
+  memset(_by_source, -1, sizeof(_by_source));
+  for (uint8_t i=0; i<ZONES_MAX; i++) {
+    if (_state[i].hash)
+      zone_insert(_by_name, _state[i].hash, i);
+    if (_state[i].source)
+      zone_insert(_by_source, _state[i].source, i);
+  }
+}
+
+int8_t Zones::_find(const char *name)
+{
+  uint16_t h = _hash(name);
+  for (uint8_t s = ZONE_SLOT(h); _by_name[s] >= 0; s = ZONE_SLOT(s + 1)) {
+    int8_t i = _by_name[s];
+    if (_state[i].hash == h && strcmp(_table.zones[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+Zones::Zones()
+: _report(ZONE_REPORT)
+{
+  _zones = this;
+  memset(&_table, 0, sizeof(_table));
+  memset(_state, 0, sizeof(_state));
+  _index();
+  _resum();
+  _sweep = 0;
+  _mqtt = 0;
+  samples = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Add (sign 1) or remove (sign -1) an active zone from the running sums
+////////////////////////////////////////////////////////////////////////////////////////////
+void Zones::_contribute(uint8_t i, float sign)
+{
+  float w = _table.zones[i].weight, e = _state[i].error;
+  _sum_w  += sign * w;
+  _sum_we += sign * w * e;
+  if (e < 0.0f) {
+    _demand_w  += sign * w;
+    _demand_we += sign * w * e;
+    _demanding += sign > 0 ? 1 : -1;
+  }
+  _active += sign > 0 ? 1 : -1;
+}
+
+void Zones::_leaf(uint8_t i)
+{
+  uint8_t n = ZONES_MAX + i;
+  _tree[n] = _state[i].active ? _state[i].error : ZONE_NONE;
+  for (n /= 2; n > 0; n /= 2)
+    _tree[n] = min(_tree[2*n], _tree[2*n + 1]);
+}
+
+void Zones::_update(uint8_t i, bool active, float value)
+{
+  Zone &z = _state[i];
+  if (z.active)
+    _contribute(i, -1.0f);
+  z.active = active;
+  z.value = value;
+  z.error = value - _table.zones[i].target;
+  if (z.active)
+    _contribute(i, 1.0f);
+  _leaf(i);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// From scratch, after a change of the table and after each sweep against rounding drift
+////////////////////////////////////////////////////////////////////////////////////////////
+void Zones::_resum()
+{
+  _sum_w = _sum_we = _demand_w = _demand_we = 0.0f;
+  _active = _demanding = 0;
+  for (uint8_t i=0; i<ZONES_MAX; i++) {
+    if (_state[i].active)
+      _contribute(i, 1.0f);
+    _tree[ZONES_MAX + i] = _state[i].active ? _state[i].error : ZONE_NONE;
+  }
+  for (uint8_t n=ZONES_MAX -1; n > 0; n--)
+    _tree[n] = min(_tree[2*n], _tree[2*n + 1]);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Zones::error(float &error) const
+{
+  if (_active == 0 || _sum_w <= 0.0f)
+    return false;
+  switch (_table.strategy)
+  {
+  case Worst:
+    error = _tree[1];
+    return true;
+  case Demand:
+    if (_demanding > 0 && _demand_w > 0.0f) {
+      error = _demand_we / _demand_w;
+      return true;
+    }
+    // fall through, nobody asks for heat
+  default:
+    error = _sum_we / _sum_w;
+    return true;
+  }
+}
+
+bool Zones::sample(const char *name, float value)
+{
+  int8_t i = _find(name);
+  if (i < 0)
+    return false;
+  _state[i].time = millis();
+  _update(i, true, value);
+  samples++;
+  return true;
+}
+
+void Zones::local(const char *label, float value)
+{
+  uint16_t h = _hash(label);
+  for (uint8_t s = ZONE_SLOT(h); _by_source[s] >= 0; s = ZONE_SLOT(s + 1)) {
+    int8_t i = _by_source[s];
+    if (_state[i].source == h && strcmp(_table.zones[i].source, label) == 0) {
+      _state[i].time = millis();
+      _update(i, true, value);
+      samples++;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Zones::begin(HAMqtt *mqtt)
+{
+  _mqtt = mqtt;
+  if (zone_store.load(&_table) != ConfigStore::Ok)
+    memset(&_table, 0, sizeof(_table));
+
+  uint8_t count = 0;
+  for (uint8_t i=0; i<ZONES_MAX; i++)
+  {
+    const ZoneConfig &c = _table.zones[i];
+    _state[i].hash = c.name[0] ? _hash(c.name) : 0;
+    _state[i].source = c.source[0] ? _hash(c.source) : 0;
+    if (c.name[0])
+      count++;
+  }
+  _index();
+  _resum();
+  INFO("Zones: %d zones, strategy %s", count, strategy_name(_table.strategy));
+  return true;
+}
+
+bool Zones::_store()
+{
+  zone_store.set(&_table, millis());
+  return true;    // committed from the loop, after the changes settled
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// One zone per call is checked for expiry, never the whole table at once
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Zones::loop()
+{
+  if (zone_store.due(millis()) && zone_store.commit() != ConfigStore::Ok)
+    ERROR("Zones: could not write to flash");
+  if (_report)
+    _log();
+  if (!_next_sweep.passed())
+    return false;
+  _next_sweep.set(ZONE_SWEEP);
+
+  Zone &z = _state[_sweep];
+  if (z.active && millis() - z.time > ZONE_MAX_AGE) {
+    INFO("Zones: no recent temperature of %s", _table.zones[_sweep].name);
+    _update(_sweep, false, z.value);
+  }
+  if (++_sweep >= ZONES_MAX) {
+    _sweep = 0;
+    _resum();
+  }
+  return true;
+}
+
+void Zones::_log()
+{
+  for (uint8_t i=0; i<ZONES_MAX; i++)
+  {
+    const ZoneConfig &c = _table.zones[i];
+    if (c.name[0])
+      INFO("Zones: %s %0.2f, target %0.1f, weight %0.1f, %s", c.name, _state[i].value, c.target, c.weight,
+        _state[i].active ? "active" : "inactive");
+  }
+  float e;
+  if (error(e))
+    INFO("Zones: %d of %d active (%d demanding), %s error %0.2f", _active, ZONES_MAX, _demanding, strategy_name(_table.strategy), e);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Zones::subscribe(HAMqtt *mqtt)
+{
+  return mqtt->subscribe(ZONE_TOPIC "/+/temperature") &&
+         mqtt->subscribe(ZONE_TOPIC "/+/target") &&
+         mqtt->subscribe(ZONE_TOPIC "/set") &&
+         mqtt->subscribe(ZONE_TOPIC "/strategy");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// "<name> <source|mqtt> <weight> <target>", weight 0 removes the zone
+////////////////////////////////////////////////////////////////////////////////////////////
+bool Zones::_configure(const char *payload)
+{
+  char name[ZONE_NAME], source[ZONE_NAME];
+  float weight, target;
+  if (sscanf(payload, "%11s %11s %f %f", name, source, &weight, &target) < 4 || weight < 0.0f) {
+    ERROR("Zones: expected '<name> <source|mqtt> <weight> <target>'");
+    return false;
+  }
+  int8_t i = _find(name);
+  for (uint8_t n=0; i < 0 && n<ZONES_MAX; n++)
+    if (_table.zones[n].name[0] == '\0')
+      i = n;
+  if (i < 0) {
+    ERROR("Zones: no room for %s", name);
+    return false;
+  }
+
+  ZoneConfig &c = _table.zones[i];
+  Zone &z = _state[i];
+  memset(&c, 0, sizeof(c));
+  memset(&z, 0, sizeof(z));
+  if (weight > 0.0f) {
+    strcpy(c.name, name);
+    if (strcmp(source, "mqtt") != 0)
+      strcpy(c.source, source);
+    c.weight = weight;
+    c.target = target;
+    z.hash = _hash(c.name);
+    z.source = c.source[0] ? _hash(c.source) : 0;
+    INFO("Zones: %s from %s, weight %0.1f, target %0.1f", name, source, weight, target);
+  }
+  else
+    INFO("Zones: %s removed", name);
+  _index();
+  _resum();
+  return _store();
+}
+
+bool Zones::onMessage(const char *topic, const uint8_t *payload, uint16_t length)
+{
+  static const size_t prefix = strlen(ZONE_TOPIC "/");
+  if (strncmp(topic, ZONE_TOPIC "/", prefix) != 0)
+    return false;
+
+  char buf[64];
+  if (length >= sizeof(buf))
+    length = sizeof(buf) -1;
+  memcpy(buf, payload, length);
+  buf[length] = '\0';
+
+  const char *sub = topic + prefix;
+  if (strcmp(sub, "set") == 0) {
+    _configure(buf);
+    return true;
+  }
+  if (strcmp(sub, "strategy") == 0) {
+    for (uint8_t s=Weighted; s<=Demand; s++)
+      if (strcmp(buf, _strategies[s]) == 0) {
+        _table.strategy = s;
+        INFO("Zones: strategy %s", _strategies[s]);
+        _store();
+      }
+    return true;
+  }
+
+  // <name>/temperature or <name>/target
+  const char *slash = strchr(sub, '/');
+  char name[ZONE_NAME];
+  if (slash == NULL || slash - sub >= ZONE_NAME)
+    return true;
+  memcpy(name, sub, slash - sub);
+  name[slash - sub] = '\0';
+  float value = strtod(buf, NULL);
+
+  int8_t i = _find(name);
+  if (i < 0)
+    return true;
+  if (strcmp(slash, "/temperature") == 0)
+    sample(name, value);
+  else if (strcmp(slash, "/target") == 0 && value > 5.0f && value < 30.0f) {
+    _table.zones[i].target = value;
+    _update(i, _state[i].active, _state[i].value);
+    _store();
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
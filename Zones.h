@@ -0,0 +1,103 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Timer.h>
+
+class HAMqtt;
+
+#define ZONES_MAX         24              // zones in the house
+#define ZONE_SLOTS        32              // of the hash index, a power of 2 above ZONES_MAX
+#define ZONE_NAME         12              // characters of a name or source, terminator included
+#define ZONE_MAX_AGE      (15*60*1000)    // a zone without a sample for 15 minutes drops out
+#define ZONE_SWEEP        1000            // ms between the expiry check of two zones
+#define ZONE_REPORT       (10*60*1000)    // log the zones each 10 minutes
+#define ZONE_TOPIC        "SmartTherm/zone"   // <name>/temperature, <name>/target, set, strategy
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// What is stored per zone, in flash (FLASH_ZONES)
+////////////////////////////////////////////////////////////////////////////////////////////
+struct ZoneConfig
+{
+  char     name[ZONE_NAME];               // "" for an unused entry
+  char     source[ZONE_NAME];             // label on the sensor bus, "" for MQTT
+  float    weight;
+  float    target;
+};
+
+struct ZoneTable
+{
+  uint8_t    strategy;
+  uint8_t    spare[3];
+  ZoneConfig zones[ZONES_MAX];
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Rooms with their own thermometer and target, aggregated into one inside error for the
+// heating curve (the temperature minus the target, negative when heat is needed):
+//  Weighted  weighted mean of the errors
+//  Worst     the coldest zone relative to its target
+//  Demand    weighted mean of the zones below their target, Weighted when none is
+// Each sample updates running sums (and a min tree for Worst), so reading the error costs
+// nothing and a sample costs the same for 2 or 24 zones. The OT frame path only reads. The
+// zone of a topic or of a sensor label is found through a hash index, not a scan.
+//
+// A zone measures on the sensor bus (by label) or listens to ZONE_TOPIC/<name>/temperature.
+// "<name> <source|mqtt> <weight> <target>" on ZONE_TOPIC/set adds or changes a zone, a weight
+// of 0 removes it. ZONE_TOPIC/<name>/target and ZONE_TOPIC/strategy change those.
+////////////////////////////////////////////////////////////////////////////////////////////
+class Zones
+{
+public:
+  enum Strategy : uint8_t { Weighted, Worst, Demand };
+
+private:
+  struct Zone {
+    bool      active;                     // has a recent sample
+    float     value;
+    float     error;                      // value - target, while active
+    uint32_t  time;                       // millis of the last sample
+    uint16_t  hash;                       // of the name, to find the zone of a topic
+    uint16_t  source;                     // hash of the source, 0 for MQTT
+  };
+  ZoneTable _table;
+  Zone      _state[ZONES_MAX];
+  float     _tree[2 * ZONES_MAX];         // min of the active errors, leaves at ZONES_MAX
+  int8_t    _by_name[ZONE_SLOTS];         // zone at the slot of its name hash (open addressing), -1 for none
+  int8_t    _by_source[ZONE_SLOTS];       // zones at the slot of their source hash, one slot each
+  float     _sum_w, _sum_we;              // over the active zones
+  float     _demand_w, _demand_we;        // over the active zones below their target
+  uint8_t   _active, _demanding;
+  uint8_t   _sweep;                       // next zone to check for expiry
+  Timer     _next_sweep;
+  Periodic  _report;
+  HAMqtt   *_mqtt;
+
+  static uint16_t _hash(const char *name);
+  int8_t _find(const char *name);
+  void _index();
+  void _contribute(uint8_t i, float sign);
+  void _leaf(uint8_t i);
+  void _update(uint8_t i, bool active, float value);
+  void _resum();
+  bool _store();
+  void _log();
+  bool _configure(const char *payload);
+public:
+  Zones();
+  static Zones *instance();
+  static const char *strategy_name(uint8_t strategy);
+
+  uint32_t samples;
+
+  bool begin(HAMqtt *mqtt);
+  bool loop();
+  bool error(float &error) const;         // false when no zone is active
+  uint8_t active() const                  { return _active; }
+  bool sample(const char *name, float value);
+  void local(const char *label, float value);   // a reading of the sensor bus
+  bool subscribe(HAMqtt *mqtt);
+  bool onMessage(const char *topic, const uint8_t *payload, uint16_t length);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+"""Compare two benchmark results of SmartTherm, as published on SmartTherm/benchmark.
+
+Build with BENCHMARK defined (Benchmark.h), publish anything on SmartTherm/benchmark/run
+and save the retained result, before and after a change:
+
+  mosquitto_sub -h 192.168.2.170 -t SmartTherm/benchmark -C 1 > before.json
+
+or run all the cases on the host, with the allocations counted:
+
+  bench_host.py --save before.json
+
+  bench_compare.py before.json after.json           ns per op and the change
+  bench_compare.py before.json after.json --fail 10 exit 1 when a case is 10% slower
+"""
+import argparse
+import json
+import sys
+
+
+def load(name):
+    with open(name, encoding='utf-8') as f:
+        return json.load(f)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('before')
+    parser.add_argument('after')
+    parser.add_argument('--fail', type=float, metavar='PERCENT', help='slowdown that fails the comparison')
+    args = parser.parse_args()
+    before, after = load(args.before), load(args.after)
+    if before.get('mhz') != after.get('mhz'):
+        print('warning: cpu at %s MHz before and %s MHz after' % (before.get('mhz'), after.get('mhz')))
+
+    print('%-26s %10s %10s %8s %6s %6s' % ('case', 'before ns', 'after ns', 'change', 'heap', 'allocs'))
+    failed = []
+    for name in sorted(set(before['cases']) | set(after['cases'])):
+        a, b = before['cases'].get(name), after['cases'].get(name)
+        if a is None or b is None:
+            print('%-26s %10s %10s' % (name, a['ns'] if a else '-', b['ns'] if b else '-'))
+            continue
+        change = 100.0 * (b['ns'] - a['ns']) / a['ns'] if a['ns'] else 0.0
+        allocs = b.get('allocs', -1)
+        print('%-26s %10d %10d %+7.1f%% %6d %6s' % (name, a['ns'], b['ns'], change, b['heap'],
+                                                   allocs if allocs >= 0 else '-'))
+        if args.fail is not None and change > args.fail:
+            failed.append(name)
+    if failed:
+        sys.exit('slower: ' + ', '.join(failed))
+
+
+if __name__ == '__main__':
+    main()
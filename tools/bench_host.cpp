@@ -0,0 +1,99 @@
+////////////////////////////////////////////////////////////////////////////////////////////
+// The benchmark of the firmware (Benchmark.cpp) as a host executable, built and run by
+// tools/bench_host.py. The cases run on the objects of the sketch, with the fake GFX and MQTT
+// of tools/host. malloc is replaced here, new goes through it, so each case reports its
+// allocations. Prints the json document the device publishes on BENCHMARK_TOPIC.
+////////////////////////////////////////////////////////////////////////////////////////////
+#include "Benchmark.h"
+#include "SmartControl.h"
+#include "HAOTMonitor.h"
+#include "Display.h"
+#include "Diagnostics.h"
+#include "Energy.h"
+#include "NtpSync.h"
+#include "Zones.h"
+#include "SensorBus.h"
+#include "BinLog.h"
+#include <HAMqtt.h>
+#include <Clock.h>
+#include <malloc.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Counted allocations, the heap in use is what ESP.getFreeHeap() takes off HOST_HEAP
+////////////////////////////////////////////////////////////////////////////////////////////
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void  __libc_free(void *p);
+
+static void *counted(void *p)
+{
+  if (p) {
+    host_allocs++;
+    host_heap_used += malloc_usable_size(p);
+  }
+  return p;
+}
+
+void *malloc(size_t size)           { return counted(__libc_malloc(size)); }
+void *calloc(size_t n, size_t size) { return counted(__libc_calloc(n, size)); }
+
+void free(void *p)
+{
+  if (p)
+    host_heap_used -= malloc_usable_size(p);
+  __libc_free(p);
+}
+
+void *realloc(void *p, size_t size)
+{
+  if (p)
+    host_heap_used -= malloc_usable_size(p);
+  return counted(__libc_realloc(p, size));
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The objects of the sketch the cases need, the rest is not built
+////////////////////////////////////////////////////////////////////////////////////////////
+Client        socket;
+HAOTMonitor   ha_monitor;
+SmartControl  controller;
+HAMqtt        mqtt(socket, ha_monitor, SENSOR_COUNT);
+Clock         rtc;
+Display       display;
+Diagnostics   diagnostics;
+Energy        energy;
+Benchmark     benchmark;
+
+NtpSync *NtpSync::instance()              { return NULL; }
+uint32_t NtpSync::local(uint32_t utc)     { return utc; }
+uint64_t NtpSync::utc() const             { return 0; }
+SensorBus *SensorBus::instance()          { return NULL; }
+bool SensorBus::bind(const char *, void (*)(float), uint8_t (*)(float)) { return false; }
+Zones *Zones::instance()                  { return NULL; }
+bool Zones::error(float &) const          { return false; }
+BinLog *BinLog::instance()                { return NULL; }
+void BinLog::_append(uint8_t, uint8_t, const uint32_t *, uint8_t) {}
+
+int main()
+{
+  const byte mac[6] = { 0x5C, 0xCF, 0x7F, 0x00, 0x00, 0x01 };
+  host_local = 1705320000;                // 2024-01-15 12:00, a winter day
+  display.begin();
+  diagnostics.begin();
+  controller.config_begin();
+  ha_monitor.begin(mac, &mqtt);
+  energy.begin(&mqtt);
+  benchmark.begin(&mqtt);
+  controller.begin();
+
+  mqtt.watch = BENCHMARK_TOPIC;
+  if (!benchmark.run()) {
+    fprintf(stderr, "the benchmark did not publish its results\n");
+    return 1;
+  }
+  puts(mqtt.last.c_str());
+  return 0;
+}
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+"""Run the benchmark of SmartTherm on the host, in ns and allocations per operation.
+
+The cases of Benchmark.cpp are built with g++ against the fakes in tools/host (see
+tools/host_build.py). Besides the cases of the device, the operating mode, the OT dispatch,
+the display and the HA update run here, on objects of their own with a fake GFX and MQTT.
+The result is the json document the device publishes, tools/bench_compare.py compares two
+of them:
+
+  bench_host.py                                     ns, allocations and heap per case
+  bench_host.py --save before.json                  keep the result of the current code
+  bench_host.py --save after.json && bench_compare.py before.json after.json --fail 10
+
+The times are those of the host cpu, compare runs on the same machine.
+"""
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+import host_build
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--libraries', help='Arduino libraries folder, see tools/host_build.py')
+    parser.add_argument('--save', metavar='JSON', help='write the result, to compare with later')
+    parser.add_argument('--runs', type=int, default=5, help='of the executable, the fastest of each case counts')
+    parser.add_argument('--log', action='store_true', help='show the logging of the firmware')
+    args = parser.parse_args()
+
+    out = os.path.join(tempfile.mkdtemp(prefix='bench'), 'bench')
+    host_build.benchmark(host_build.libraries_dir(args.libraries), out, [('HOST_LOG', 1)] if args.log else [])
+    result = None
+    for _ in range(max(args.runs, 1)):
+        try:
+            doc = json.loads(subprocess.run([out], check=True, stdout=subprocess.PIPE, text=True).stdout)
+        except (OSError, subprocess.CalledProcessError, ValueError) as e:
+            sys.exit('the benchmark failed: %s' % e)
+        if result is None:
+            result = doc
+        for name, case in doc['cases'].items():
+            if case['ns'] < result['cases'][name]['ns']:
+                result['cases'][name] = case
+
+    print('%-26s %10s %8s %8s' % ('case', 'ns', 'allocs', 'heap'))
+    for name, case in result['cases'].items():
+        print('%-26s %10d %8d %8d' % (name, case['ns'], case['allocs'], case['heap']))
+    if args.save:
+        with open(args.save, 'w', encoding='utf-8') as f:
+            json.dump(result, f, indent=1)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
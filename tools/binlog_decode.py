@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""Decode the structured (binary) log batches of SmartTherm back into text.
+
+The formats are read from BinLog.h, the position in BINLOG_FORMATS is the id.
+
+  binlog_decode.py batch1.bin batch2.bin ...      decode saved MQTT payloads
+  binlog_decode.py --mqtt 192.168.2.170 -u user   follow SmartTherm/binlog live (needs paho-mqtt)
+"""
+import argparse
+import datetime
+import os
+import re
+import struct
+import sys
+
+HEADER = struct.Struct('<2sBBII')       # 'BL', version, reserved, unixtime, millis
+RECORD = struct.Struct('<BBI')          # id, level<<4|argc, millis
+LEVELS = {1: 'ERROR', 2: 'INFO', 3: 'DEBUG'}
+SPEC = re.compile(r'%[-+ #0]*\d*(?:\.\d+)?([diouxXeEfFgGc%])')
+# OpenThermMessageType, as messageTypeToString() of the library
+MESSAGE_TYPES = ['READ_DATA', 'WRITE_DATA', 'INVALID_DATA', 'RESERVED', 'READ_ACK', 'WRITE_ACK', 'DATA_INVALID',
+                 'UNKNOWN_DATA_ID']
+# the arguments which are shown by name: format -> {argument: names}
+NAMES = {'OT_MESSAGE': {1: MESSAGE_TYPES, 3: MESSAGE_TYPES}}
+
+
+def load_formats(header):
+    with open(header, encoding='utf-8') as f:
+        text = f.read()
+    table = text[text.index('#define BINLOG_FORMATS'):]
+    table = table[:table.index('\n\n')]
+    return [(fmt, NAMES.get(name, {})) for name, fmt in re.findall(r'X\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', table)]
+
+
+def convert(fmt, names, raw):
+    args = iter(enumerate(raw))
+
+    def arg(m):
+        spec = m.group(1)
+        if spec == '%':
+            return '%'
+        i, value = next(args, (None, None))
+        if i is None:
+            return m.group(0)
+        if i in names and value < len(names[i]):
+            return names[i][value]
+        if spec in 'eEfFgG':
+            value = struct.unpack('<f', struct.pack('<I', value))[0]
+        elif spec in 'di':
+            value = struct.unpack('<i', struct.pack('<I', value))[0]
+        return (m.group(0)[:-1] + 'd' if spec == 'u' else m.group(0)) % value
+    return SPEC.sub(arg, fmt)
+
+
+def decode(payload, formats, out=sys.stdout):
+    magic, version, _, unixtime, base = HEADER.unpack_from(payload)
+    if magic != b'BL' or version != 1:
+        raise ValueError('not a binlog batch (version %d)' % version)
+    pos = HEADER.size
+    while pos + RECORD.size <= len(payload):
+        ident, info, millis = RECORD.unpack_from(payload, pos)
+        argc = info & 0x0F
+        pos += RECORD.size
+        raw = list(struct.unpack_from('<%dI' % argc, payload, pos))
+        pos += 4 * argc
+        delta = ((millis - base + 0x80000000) & 0xFFFFFFFF) - 0x80000000
+        stamp = datetime.datetime.fromtimestamp(unixtime + delta / 1000.0)
+        text = convert(*formats[ident], raw) if ident < len(formats) else 'unknown id %d %r' % (ident, raw)
+        out.write('%s %-5s %s\n' % (stamp.strftime('%H:%M:%S.%f')[:-3], LEVELS.get(info >> 4, '?'), text))
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('files', nargs='*')
+    parser.add_argument('--header', default=os.path.join(here, '..', 'BinLog.h'))
+    parser.add_argument('--mqtt', metavar='HOST')
+    parser.add_argument('--port', type=int, default=1883)
+    parser.add_argument('-u', '--user')
+    parser.add_argument('-p', '--password')
+    parser.add_argument('--topic', default='SmartTherm/binlog')
+    args = parser.parse_args()
+    formats = load_formats(args.header)
+
+    for name in args.files:
+        with open(name, 'rb') as f:
+            decode(f.read(), formats)
+    if not args.mqtt:
+        return
+
+    import paho.mqtt.client as mqtt
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    client.on_connect = lambda c, u, f, rc: c.subscribe(args.topic)
+    client.on_message = lambda c, u, msg: decode(msg.payload, formats)
+    client.connect(args.mqtt, args.port)
+    client.loop_forever()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,189 @@
+////////////////////////////////////////////////////////////////////////////////////////////
+// Host test of the ConfigStore journal on the RamFlash backend: the wear over the sectors,
+// torn writes by a power loss, upgrades of the record and a missing flash area.
+//
+//   g++ -std=gnu++17 -I. -o /tmp/config_store_test tools/config_store_test.cpp ConfigStore.cpp ConfigFlash.cpp
+//   /tmp/config_store_test
+////////////////////////////////////////////////////////////////////////////////////////////
+#include "ConfigStore.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failed = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); failed++; } } while (0)
+
+struct V1 { uint32_t a, b; };
+struct V2 { uint32_t a, b, c; };
+
+#define WORDS(type)   ((sizeof(type) + 3) / 4)
+#define SECTOR_HEADER 16      // CONFIG_SECTOR_HEADER, written when a commit starts a sector
+#define RECORD_BYTES  ((sizeof(ConfigStore::Record) + sizeof(V1) + 3) & ~3)
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+static void test_empty_and_roundtrip()
+{
+  RamFlash flash(4);
+  uint32_t buf[WORDS(V1)];
+  V1 v = { 1, 2 };
+  {
+    ConfigStore store(flash, 1, sizeof(V1), buf);
+    CHECK(store.load(&v) == ConfigStore::Empty);
+    CHECK(store.commit() == ConfigStore::Unchanged);
+    v.a = 7;
+    CHECK(store.set(&v, 0));
+    CHECK(!store.set(&v, 10));              // no change
+    CHECK(store.commit() == ConfigStore::Ok);
+  }
+  ConfigStore store(flash, 1, sizeof(V1), buf);
+  V1 w = { 0, 0 };
+  CHECK(store.load(&w) == ConfigStore::Ok);
+  CHECK(w.a == 7 && w.b == 2);
+  CHECK(store.sequence() == 1);
+}
+
+static void test_coalesce()
+{
+  RamFlash flash(4);
+  uint32_t buf[WORDS(V1)];
+  V1 v = { 1, 2 };
+  ConfigStore store(flash, 1, sizeof(V1), buf);
+  store.load(&v);
+  for (uint32_t t=0; t<10; t++) {
+    v.a = t + 10;
+    store.set(&v, t * 1000);
+  }
+  CHECK(store.coalesced == 9);
+  CHECK(!store.due(9000 + CONFIG_COMMIT_DELAY - 1));
+  CHECK(store.due(9000 + CONFIG_COMMIT_DELAY));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The sectors are erased in turn, none more than one above the others
+////////////////////////////////////////////////////////////////////////////////////////////
+static void test_wear()
+{
+  RamFlash flash(4, 512);
+  uint32_t buf[WORDS(V1)];
+  V1 v = { 0, 0 };
+  ConfigStore store(flash, 1, sizeof(V1), buf);
+  store.load(&v);
+  for (uint32_t i=1; i<=1000; i++) {
+    v.a = i;
+    store.set(&v, 0);
+    CHECK(store.commit() == ConfigStore::Ok);
+  }
+  uint32_t lo = flash.erases[0], hi = flash.erases[0];
+  for (uint16_t s=1; s<flash.sectors(); s++) {
+    lo = flash.erases[s] < lo ? flash.erases[s] : lo;
+    hi = flash.erases[s] > hi ? flash.erases[s] : hi;
+  }
+  CHECK(lo > 0 && hi - lo <= 1);
+
+  V1 back;
+  CHECK(store.read(0, &back) && back.a == 1000);
+  CHECK(store.read(store.capacity() - 1 - store.slot(), &back));   // the older sector
+  CHECK(!store.read(store.capacity(), &back));
+
+  ConfigStore again(flash, 1, sizeof(V1), buf);
+  V1 w;
+  CHECK(again.load(&w) == ConfigStore::Ok && w.a == 1000);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// A power loss at each word of a commit which starts a new sector, the last complete record
+// is loaded
+////////////////////////////////////////////////////////////////////////////////////////////
+static void test_power_loss()
+{
+  for (int32_t cut=0; cut<=(int32_t) (SECTOR_HEADER + RECORD_BYTES); cut+=4)
+  {
+    RamFlash flash(2, 256);
+    uint32_t buf[WORDS(V1)];
+    V1 v = { 0, 0 };
+    {
+      ConfigStore store(flash, 1, sizeof(V1), buf);
+      store.load(&v);
+      for (uint32_t i=1; i<=12; i++) {      // fills the first sector, the next starts a new one
+        v.a = i;
+        store.set(&v, 0);
+        store.commit();
+      }
+      v.a = 100;
+      store.set(&v, 0);
+      flash.power_cut(cut);
+      store.commit();
+      flash.power_cut(-1);
+    }
+    ConfigStore store(flash, 1, sizeof(V1), buf);
+    V1 w;
+    CHECK(store.load(&w) == ConfigStore::Ok);
+    bool complete = cut >= (int32_t) (SECTOR_HEADER + RECORD_BYTES);
+    CHECK(w.a == (complete ? 100u : 12u));
+    w.a = 200;                               // and the journal goes on after it
+    store.set(&w, 0);
+    CHECK(store.commit() == ConfigStore::Ok);
+    ConfigStore again(flash, 1, sizeof(V1), buf);
+    CHECK(again.load(&w) == ConfigStore::Ok && w.a == 200);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// An older and shorter record keeps the defaults of the new fields, and is rewritten
+////////////////////////////////////////////////////////////////////////////////////////////
+static void test_upgrade()
+{
+  RamFlash flash(4);
+  {
+    uint32_t buf[WORDS(V1)];
+    V1 v = { 0, 0 };
+    ConfigStore store(flash, 1, sizeof(V1), buf);
+    store.load(&v);
+    v.a = 5; v.b = 6;
+    store.set(&v, 0);
+    CHECK(store.commit() == ConfigStore::Ok);
+  }
+  uint32_t buf[WORDS(V2)];
+  V2 v = { 0, 0, 42 };
+  {
+    ConfigStore store(flash, 2, sizeof(V2), buf);
+    CHECK(store.load(&v) == ConfigStore::Upgraded);
+    CHECK(v.a == 5 && v.b == 6 && v.c == 42);
+    CHECK(!store.set(&v, 0));                // the same data is no change ...
+    CHECK(store.set(&v, 0, true));           // ... unless forced, as Config.cpp does
+    CHECK(store.commit() == ConfigStore::Ok);
+  }
+  ConfigStore store(flash, 2, sizeof(V2), buf);
+  V2 w = { 0, 0, 0 };
+  CHECK(store.load(&w) == ConfigStore::Ok);
+  CHECK(w.a == 5 && w.b == 6 && w.c == 42);
+}
+
+static void test_no_flash()
+{
+  RamFlash flash(0);
+  uint32_t buf[WORDS(V1)];
+  V1 v = { 1, 2 };
+  ConfigStore store(flash, 1, sizeof(V1), buf);
+  CHECK(store.load(&v) == ConfigStore::FlashError);
+  store.set(&v, 0, true);
+  CHECK(store.commit() == ConfigStore::FlashError);
+  CHECK(!store.read(0, &v));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+int main()
+{
+  test_empty_and_roundtrip();
+  test_coalesce();
+  test_wear();
+  test_power_loss();
+  test_upgrade();
+  test_no_flash();
+  printf(failed ? "%d checks failed\n" : "all checks passed\n", failed);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,43 @@
+////////////////////////////////////////////////////////////////////////////////////////////
+// The fake display library, see Adafruit_GFX.h
+////////////////////////////////////////////////////////////////////////////////////////////
+#include <Adafruit_GFX.h>
+
+size_t Adafruit_GFX::write(uint8_t c)
+{
+  chars++;
+  if (c == '\n') {
+    _x = 0;
+    _y += _char_height();
+  }
+  else
+    _x += _char_width();
+  return 1;
+}
+
+void Adafruit_GFX::setRotation(uint8_t r)
+{
+  if ((r & 1) != (_width > _height))
+    std::swap(_width, _height);
+}
+
+void Adafruit_GFX::getTextBounds(const char *s, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h)
+{
+  *x1 = x;
+  *y1 = _font ? y - _char_height() : y;
+  *w = strlen(s) * _char_width();
+  *h = _char_height();
+}
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+  int16_t x0 = max<int16_t>(x, 0), y0 = max<int16_t>(y, 0);
+  int16_t x1 = min<int16_t>(x + w, _width), y1 = min<int16_t>(y + h, _height);
+  if (x1 > x0 && y1 > y0)
+    pixels += (uint32_t) (x1 - x0) * (y1 - y0);
+}
+
+void Adafruit_GFX::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color)
+{
+  pixels += max(abs(x1 - x0), abs(y1 - y0)) + 1;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// A fake of the Adafruit GFX library for the host benchmark: nothing is drawn, the pixels
+// filled and the characters printed are counted. The text bounds are those of a fixed width
+// font of the height of the font, enough for the layout code of the firmware.
+////////////////////////////////////////////////////////////////////////////////////////////
+#include <Arduino.h>
+
+struct GFXfont
+{
+  uint8_t yAdvance;           // line height
+};
+
+class Adafruit_GFX : public Print
+{
+private:
+  int16_t         _width, _height;
+  int16_t         _x, _y;
+  const GFXfont  *_font;
+  uint16_t        _color;
+  bool            _wrap;
+
+  int16_t _char_width() const                 { return _font ? _font->yAdvance / 2 : 6; }
+  int16_t _char_height() const                { return _font ? _font->yAdvance : 8; }
+public:
+  Adafruit_GFX(int16_t w, int16_t h)
+  : _width(w), _height(h), _x(0), _y(0), _font(NULL), _color(0), _wrap(true) {}
+
+  uint32_t pixels = 0;        // filled
+  uint32_t chars = 0;         // printed
+
+  size_t write(uint8_t c) override;
+  void setFont(const GFXfont *font)           { _font = font; }
+  void setTextColor(uint16_t color)           { _color = color; }
+  void setTextWrap(bool wrap)                 { _wrap = wrap; }
+  void setCursor(int16_t x, int16_t y)        { _x = x; _y = y; }
+  void setRotation(uint8_t r);
+  int16_t width() const                       { return _width; }
+  int16_t height() const                      { return _height; }
+  void getTextBounds(const char *s, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h);
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+  void fillScreen(uint16_t color)             { fillRect(0, 0, _width, _height, color); }
+  void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+};
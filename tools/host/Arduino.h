@@ -0,0 +1,131 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The part of the Arduino core for the ESP8266 which the firmware sources use, to build them
+// on a linux host for the tools. The clock is virtual: millis() only moves when the tool sets
+// host_millis or calls delay(), so a replay runs months in seconds and a case of the
+// benchmark sees time pass without waiting for it.
+////////////////////////////////////////////////////////////////////////////////////////////
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <cmath>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define PGM_P               const char *
+#define PSTR(s)             (s)
+#define F(s)                ((const __FlashStringHelper *) (s))
+#define FPSTR(p)            ((const __FlashStringHelper *) (p))
+class __FlashStringHelper;
+
+#define strlen_P            strlen
+#define strcpy_P            strcpy
+#define strncpy_P           strncpy
+#define strcmp_P            strcmp
+#define memcpy_P            memcpy
+#define snprintf_P          snprintf
+#define pgm_read_byte(p)    (*(const uint8_t *) (p))
+#define pgm_read_word(p)    (*(const uint16_t *) (p))
+#define pgm_read_dword(p)   (*(const uint32_t *) (p))
+#define pgm_read_ptr(p)     (*(void * const *) (p))
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+#define PI                  3.1415926535897932384626433832795
+#define TWO_PI              6.283185307179586476925286766559
+#define radians(deg)        ((deg) * 0.017453292519943295769236907684886)
+#define degrees(rad)        ((rad) * 57.295779513082320876798154814105)
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define HIGH                1
+#define LOW                 0
+#define INPUT               0
+#define OUTPUT              1
+#define INPUT_PULLUP        2
+#define CHANGE              1
+#define DEC                 10
+#define HEX                 16
+#define D1                  5
+#define D2                  4
+#define D4                  2
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Time, pins and interrupts
+////////////////////////////////////////////////////////////////////////////////////////////
+extern uint32_t host_millis;          // the virtual clock, ms since the start of the tool
+
+inline unsigned long millis()                 { return host_millis; }
+inline unsigned long micros()                 { return host_millis * 1000UL; }
+inline void delay(unsigned long ms)           { host_millis += ms; }
+inline void delayMicroseconds(unsigned int)   {}
+inline void yield()                           {}
+
+inline void pinMode(uint8_t, uint8_t)         {}
+inline void digitalWrite(uint8_t, uint8_t)    {}
+inline int digitalRead(uint8_t)               { return HIGH; }
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+inline void attachInterrupt(uint8_t, void (*)(), int) {}
+inline void detachInterrupt(uint8_t)          {}
+inline void noInterrupts()                    {}
+inline void interrupts()                      {}
+
+#define panic()   host_panic(__FILE__, __LINE__, __func__)
+[[noreturn]] void host_panic(const char *file, int line, const char *func);
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The cycle counter is the monotonic clock of the host at HOST_MHZ, the most a uint8_t of
+// getCpuFreqMHz() holds. The heap is what the tool counts through host_heap_used, the flash
+// is the filesystem area of flash_hal.h in ram, erased at the start.
+////////////////////////////////////////////////////////////////////////////////////////////
+#define HOST_MHZ            250
+#define HOST_HEAP           (80*1024)
+
+extern uint32_t host_heap_used;       // bytes, kept up to date by a tool which counts allocations
+extern uint32_t host_allocs;          // allocations so far, counted by that tool
+
+class EspClass
+{
+public:
+  uint32_t getCycleCount();
+  uint8_t  getCpuFreqMHz()                    { return HOST_MHZ; }
+  uint32_t getFreeHeap()                      { return HOST_HEAP - host_heap_used; }
+  uint32_t getMaxFreeBlockSize()              { return getFreeHeap(); }
+  uint8_t  getHeapFragmentation()             { return 0; }
+  uint32_t getFreeContStack()                 { return 4096; }
+  uint32_t getSketchSize()                    { return 0; }
+  uint32_t getFreeSketchSpace()               { return 0; }
+  void     restart()                          { exit(0); }
+  bool     flashRead(uint32_t address, uint32_t *data, size_t size);
+  bool     flashWrite(uint32_t address, const uint32_t *data, size_t size);
+  bool     flashEraseSector(uint32_t sector);
+};
+
+extern EspClass ESP;
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Print, the base of the display driver
+////////////////////////////////////////////////////////////////////////////////////////////
+class Print
+{
+public:
+  virtual ~Print()                            {}
+  virtual size_t write(uint8_t c) = 0;
+  size_t write(const char *s)                 { size_t n = 0; while (*s) n += write((uint8_t) *s++); return n; }
+  size_t print(const char *s)                 { return write(s); }
+  size_t print(char c)                        { return write((uint8_t) c); }
+  size_t print(long v, int base=DEC)          { char b[24]; snprintf(b, sizeof(b), base == HEX ? "%lx" : "%ld", v); return write(b); }
+  size_t print(int v, int base=DEC)           { return print((long) v, base); }
+  size_t print(double v, int digits=2)        { char b[32]; snprintf(b, sizeof(b), "%.*f", digits, v); return write(b); }
+  size_t println(const char *s="")            { return print(s) + write((uint8_t) '\n'); }
+};
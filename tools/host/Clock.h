@@ -0,0 +1,50 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// DateTime and the Clock of the firmware on the host. The Clock holds local time as on the
+// device, host_local is set by the tool (0 until then, like a clock without NTP).
+////////////////////////////////////////////////////////////////////////////////////////////
+#include <Arduino.h>
+
+extern uint32_t host_local;           // local unix time of the Clock
+
+class DateTime
+{
+private:
+  uint32_t _t;
+  int32_t _days() const                 { return _t / 86400; }
+  void _civil(int32_t &y, uint8_t &m, uint8_t &d) const   // of the days since 1970
+  {
+    int32_t z = _days() + 719468, era = z / 146097;
+    uint32_t doe = z - era * 146097, yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    uint32_t doy = doe - (365*yoe + yoe/4 - yoe/100), mp = (5*doy + 2) / 153;
+    d = doy - (153*mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = yoe + era * 400 + (m <= 2);
+  }
+public:
+  DateTime(uint32_t t=0) : _t(t) {}
+  DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour=0, uint8_t minute=0, uint8_t second=0)
+  {
+    int32_t y = year - (month <= 2);
+    int32_t era = y / 400;
+    uint32_t yoe = y - era * 400, doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    uint32_t doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+    _t = (uint32_t) (era * 146097 + doe - 719468) * 86400 + hour * 3600 + minute * 60 + second;
+  }
+  uint16_t year() const                 { int32_t y; uint8_t m, d; _civil(y, m, d); return y; }
+  uint8_t month() const                 { int32_t y; uint8_t m, d; _civil(y, m, d); return m; }
+  uint8_t day() const                   { int32_t y; uint8_t m, d; _civil(y, m, d); return d; }
+  uint8_t hour() const                  { return _t / 3600 % 24; }
+  uint8_t minute() const                { return _t / 60 % 60; }
+  uint8_t second() const                { return _t % 60; }
+  uint8_t dayOfTheWeek() const          { return (_days() + 4) % 7; }   // 1970-01-01 was a thursday
+  uint32_t unixtime() const             { return _t; }
+};
+
+class Clock
+{
+public:
+  DateTime now()                        { return DateTime(host_local); }
+  void adjust(const DateTime &dt)       { host_local = dt.unixtime(); }
+};
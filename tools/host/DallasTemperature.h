@@ -0,0 +1,33 @@
+#pragma once
+#include <OneWire.h>
+
+// Declarations only, see OneWire.h
+typedef uint8_t DeviceAddress[8];
+#define DEVICE_DISCONNECTED_C   -127
+
+class DallasTemperature
+{
+public:
+  struct request_t {
+    bool          result;
+    unsigned long timestamp;
+    operator bool()                           { return result; }
+  };
+
+  DallasTemperature(OneWire *wire);
+  void begin();
+  uint8_t getDeviceCount();
+  bool getAddress(uint8_t *address, uint8_t index);
+  bool validAddress(const uint8_t *address);
+  bool isConnected(const uint8_t *address);
+  bool requestTemperaturesByAddress(const uint8_t *address);
+  request_t requestTemperatures();
+  float getTempC(const uint8_t *address);
+  bool setResolution(const uint8_t *address, uint8_t bits, bool skip_global=false);
+  uint8_t getResolution(const uint8_t *address);
+  void setWaitForConversion(bool wait);
+  bool isConversionComplete();
+  int16_t millisToWaitForConversion(uint8_t bits);
+  int16_t getTemp(const uint8_t *address);
+  bool readScratchPad(const uint8_t *address, uint8_t *scratch);
+};
@@ -0,0 +1,4 @@
+#pragma once
+
+// The version of a host build
+#define DATED_VERSION(major, minor)   static const char *VERSION = #major "." #minor " host";
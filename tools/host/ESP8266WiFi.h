@@ -0,0 +1,10 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Declarations only: the network is not built on the host, the headers of the firmware
+// which hold these classes as members still compile.
+////////////////////////////////////////////////////////////////////////////////////////////
+#include <Arduino.h>
+#include <IPAddress.h>
+
+class WiFiClient {};
@@ -0,0 +1,4 @@
+#pragma once
+#include <Adafruit_GFX.h>
+
+const GFXfont FreeSansBold18pt7b = { 42 };
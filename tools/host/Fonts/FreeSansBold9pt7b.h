@@ -0,0 +1,4 @@
+#pragma once
+#include <Adafruit_GFX.h>
+
+const GFXfont FreeSansBold9pt7b = { 22 };
@@ -0,0 +1,4 @@
+#pragma once
+#include <Adafruit_GFX.h>
+
+const GFXfont Org_01 = { 6 };
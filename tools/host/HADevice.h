@@ -0,0 +1,64 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// A fake of the Home Assistant library (dawidchyrzynski/arduino-home-assistant) for the host
+// benchmark: the API the firmware uses, the entities publish through the fake HAMqtt, which
+// only counts. The real library formats the same json, so the cost is in the firmware.
+////////////////////////////////////////////////////////////////////////////////////////////
+#include <Arduino.h>
+
+class HAMqtt;
+
+class HADevice
+{
+private:
+  char        _id[13];
+public:
+  HADevice()                                      { _id[0] = 0; }
+  void setUniqueId(const byte *id, uint16_t length);
+  const char *getUniqueId() const                 { return _id; }
+  void setManufacturer(const char *)              {}
+  void setName(const char *)                      {}
+  void setSoftwareVersion(const char *)           {}
+  void setModel(const char *)                     {}
+};
+
+class HANumeric
+{
+private:
+  float       _value;
+public:
+  HANumeric(float value=0.0f) : _value(value)     {}
+  bool isFloat() const                            { return true; }
+  float toFloat() const                           { return _value; }
+};
+
+class HABaseDeviceType
+{
+public:
+  enum NumberPrecision { PrecisionP0 = 0, PrecisionP1, PrecisionP2, PrecisionP3 };
+
+private:
+  const char *_component;
+  const char *_unique_id;
+  const char *_name;
+  bool        _available;
+public:
+  HABaseDeviceType(const __FlashStringHelper *component, const char *unique_id)
+  : _component((const char *) component), _unique_id(unique_id), _name(NULL), _available(true) {}
+  virtual ~HABaseDeviceType()                     {}
+  const char *uniqueId() const                    { return _unique_id; }
+  virtual void setAvailability(bool online)       { _available = online; }
+  bool isOnline() const;
+  void setName(const char *name)                  { _name = name; }
+protected:
+  static HAMqtt *mqtt();
+  static void subscribeTopic(const char *, const __FlashStringHelper *) {}
+  virtual void buildSerializer()                  {}
+  virtual void onMqttConnected() = 0;
+  virtual void onMqttMessage(const char *, const uint8_t *, const uint16_t) {}
+  virtual void publishConfig()                    {}
+  virtual void publishAvailability()              {}
+  bool publishOnDataTopic(const __FlashStringHelper *topic, const char *value, bool retained=false);
+  friend class HAMqtt;
+};
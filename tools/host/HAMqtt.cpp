@@ -0,0 +1,123 @@
+////////////////////////////////////////////////////////////////////////////////////////////
+// The fake Home Assistant library, see HADevice.h and HAMqtt.h
+////////////////////////////////////////////////////////////////////////////////////////////
+#include <HAMqtt.h>
+#include <device-types/HABinarySensor.h>
+#include <device-types/HASwitch.h>
+#include <device-types/HASensorNumber.h>
+#include <device-types/HANumber.h>
+
+static HAMqtt *_mqtt = NULL;
+HAMqtt *HAMqtt::instance() { return _mqtt; }
+
+HAMqtt::HAMqtt(Client &client, HADevice &device, uint8_t max_types)
+: _device(device), _max(max_types), _count(0), _retained(false)
+{
+  _mqtt = this;
+  _types = new HABaseDeviceType *[max_types];
+}
+
+void HAMqtt::addDeviceType(HABaseDeviceType *type)
+{
+  if (_count < _max)
+    _types[_count++] = type;
+}
+
+void HAMqtt::_message(const std::string &topic, const std::string &payload)
+{
+  messages++;
+  bytes += payload.size();
+  if (watch && topic == watch)
+    last = payload;
+}
+
+bool HAMqtt::publish(const char *topic, const char *payload, bool retained)
+{
+  if (!connected)
+    return false;
+  _message(topic, payload);
+  return true;
+}
+
+bool HAMqtt::beginPublish(const char *topic, uint16_t length, bool retained)
+{
+  _topic = topic;
+  _payload.clear();
+  _payload.reserve(length);
+  _retained = retained;
+  return connected;
+}
+
+void HAMqtt::writePayload(const char *data, const uint16_t length)     { _payload.append(data, length); }
+void HAMqtt::writePayload(const uint8_t *data, const uint16_t length)  { _payload.append((const char *) data, length); }
+void HAMqtt::writePayload(const __FlashStringHelper *data)              { _payload.append((const char *) data); }
+
+bool HAMqtt::endPublish()
+{
+  if (!connected)
+    return false;
+  _message(_topic, _payload);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The entities publish their state on a change, as the library does
+////////////////////////////////////////////////////////////////////////////////////////////
+void HADevice::setUniqueId(const byte *id, uint16_t length)
+{
+  for (uint16_t i=0; i<length && i<6; i++)
+    sprintf(_id + 2*i, "%02x", id[i]);
+}
+
+HAMqtt *HABaseDeviceType::mqtt()          { return HAMqtt::instance(); }
+bool HABaseDeviceType::isOnline() const   { return _mqtt && _mqtt->isConnected(); }
+
+bool HABaseDeviceType::publishOnDataTopic(const __FlashStringHelper *topic, const char *value, bool retained)
+{
+  char path[96];
+  if (!_mqtt)
+    return false;
+  snprintf(path, sizeof(path), "%s/%s/%s/%s", _mqtt->getDataPrefix(), _mqtt->getDevice()->getUniqueId(), _unique_id,
+           (const char *) topic);
+  return _mqtt->publish(path, value, retained);
+}
+
+static const char *number(char *buf, size_t size, float value, int precision)
+{
+  snprintf(buf, size, "%.*f", precision, value);
+  return buf;
+}
+
+bool HABinarySensor::setState(bool state, bool force)
+{
+  if (state == _state && !force)
+    return true;
+  _state = state;
+  return publishOnDataTopic(F("stat_t"), state ? "ON" : "OFF", true);
+}
+
+bool HASwitch::setState(bool state, bool force)
+{
+  if (state == _state && !force)
+    return true;
+  _state = state;
+  return publishOnDataTopic(F("stat_t"), state ? "ON" : "OFF", true);
+}
+
+bool HASensorNumber::setValue(float value, bool force)
+{
+  char buf[16];
+  if (value == _value && !force)
+    return true;
+  _value = value;
+  return publishOnDataTopic(F("stat_t"), number(buf, sizeof(buf), value, _precision), true);
+}
+
+bool HANumber::setState(float state, bool force)
+{
+  char buf[16];
+  if (state == _state && !force)
+    return true;
+  _state = state;
+  return publishOnDataTopic(F("stat_t"), number(buf, sizeof(buf), state, _precision), true);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The fake MQTT client of the Home Assistant library, see HADevice.h. It is connected, counts
+// the messages and bytes and keeps the last payload published on one topic of interest.
+////////////////////////////////////////////////////////////////////////////////////////////
+#include <HADevice.h>
+#include <string>
+
+class Client {};
+
+class HAMqtt
+{
+private:
+  HADevice           &_device;
+  HABaseDeviceType  **_types;
+  uint8_t             _max, _count;
+  std::string         _topic, _payload;   // of the publish in progress
+  bool                _retained;
+
+  void _message(const std::string &topic, const std::string &payload);
+public:
+  HAMqtt(Client &client, HADevice &device, uint8_t max_types=6);
+  static HAMqtt *instance();
+
+  bool        connected = true;
+  uint32_t    messages = 0;         // published
+  uint32_t    bytes = 0;            // payload bytes published
+  const char *watch = NULL;         // topic of which the last payload is kept
+  std::string last;
+
+  bool begin(const char *, uint16_t, const char *, const char *) { return true; }
+  void loop()                                     {}
+  bool isConnected() const                        { return connected; }
+  void disconnect()                               { connected = false; }
+  void addDeviceType(HABaseDeviceType *type);
+  bool publish(const char *topic, const char *payload, bool retained=false);
+  bool beginPublish(const char *topic, uint16_t length, bool retained=false);
+  void writePayload(const char *data, const uint16_t length);
+  void writePayload(const uint8_t *data, const uint16_t length);
+  void writePayload(const __FlashStringHelper *data);
+  bool endPublish();
+  bool subscribe(const char *)                    { return connected; }
+  void onMessage(void (*)(const char *, const uint8_t *, uint16_t)) {}
+  void onConnected(void (*)())                    {}
+  void onDisconnected(void (*)())                 {}
+  const char *getDiscoveryPrefix() const          { return "homeassistant"; }
+  const char *getDataPrefix() const               { return "aha"; }
+  const HADevice *getDevice() const               { return &_device; }
+};
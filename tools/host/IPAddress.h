@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+class IPAddress
+{
+private:
+  uint8_t _bytes[4];
+public:
+  IPAddress()                                           { _bytes[0] = _bytes[1] = _bytes[2] = _bytes[3] = 0; }
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { _bytes[0] = a; _bytes[1] = b; _bytes[2] = c; _bytes[3] = d; }
+  uint8_t operator[](int i) const                       { return _bytes[i]; }
+  operator uint32_t() const                             { return _bytes[0] | _bytes[1] << 8 | _bytes[2] << 16 | (uint32_t) _bytes[3] << 24; }
+};
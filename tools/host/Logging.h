@@ -0,0 +1,21 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The logging of the firmware on the host: nothing, unless HOST_LOG is defined, then to
+// stderr. The arguments are not evaluated either way when it is off.
+////////////////////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 2
+#endif
+
+#ifdef HOST_LOG
+#define HOST_LOG_AT(level, ...)   do { if (LOG_LEVEL >= level) { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); } } while (0)
+#else
+#define HOST_LOG_AT(level, ...)   do {} while (0)
+#endif
+
+#define ERROR(...)    HOST_LOG_AT(1, __VA_ARGS__)
+#define INFO(...)     HOST_LOG_AT(2, __VA_ARGS__)
+#define DEBUG(...)    HOST_LOG_AT(3, __VA_ARGS__)
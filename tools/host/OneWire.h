@@ -0,0 +1,19 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// Declarations only: the sensor bus drives the pins directly and is not built on the host,
+// SensorBus.h still compiles.
+////////////////////////////////////////////////////////////////////////////////////////////
+#include <Arduino.h>
+
+class OneWire
+{
+public:
+  OneWire(uint8_t pin);
+  uint8_t reset();
+  void select(const uint8_t *rom);
+  void write(uint8_t v, uint8_t power=0);
+  void reset_search();
+  bool search(uint8_t *rom);
+  static uint8_t crc8(const uint8_t *data, uint8_t len);
+};
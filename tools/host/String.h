@@ -0,0 +1,2 @@
+#pragma once
+// the String class of the Arduino core, which the firmware does not use
@@ -0,0 +1,18 @@
+#pragma once
+#include <ESP8266WiFi.h>
+
+// Declarations only, see ESP8266WiFi.h
+class WiFiUDP
+{
+public:
+  uint8_t begin(uint16_t port);
+  void stop();
+  int beginPacket(IPAddress ip, uint16_t port);
+  int beginPacket(const char *host, uint16_t port);
+  int endPacket();
+  size_t write(const uint8_t *data, size_t size);
+  int parsePacket();
+  int read(uint8_t *data, size_t size);
+  IPAddress remoteIP();
+  void flush();
+};
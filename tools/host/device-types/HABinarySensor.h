@@ -0,0 +1,16 @@
+#pragma once
+#include <HADevice.h>
+
+class HABinarySensor : public HABaseDeviceType
+{
+private:
+  bool _state = false;
+public:
+  HABinarySensor(const char *unique_id) : HABaseDeviceType(F("binary_sensor"), unique_id) {}
+  bool setState(bool state, bool force=false);
+  void setCurrentState(bool state)                { _state = state; }
+  void setDeviceClass(const char *)               {}
+  void setIcon(const char *)                      {}
+protected:
+  void onMqttConnected() override                 {}
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <HADevice.h>
+
+class HANumber : public HABaseDeviceType
+{
+public:
+  enum Mode { ModeAuto, ModeBox, ModeSlider };
+
+private:
+  float _state = 0.0f;
+  NumberPrecision _precision;
+  void (*_command)(HANumeric number, HANumber *sender) = NULL;
+public:
+  HANumber(const char *unique_id, NumberPrecision precision=PrecisionP0)
+  : HABaseDeviceType(F("number"), unique_id), _precision(precision) {}
+  bool setState(float state, bool force=false);
+  void setCurrentState(float state)               { _state = state; }
+  void setIcon(const char *)                      {}
+  void setUnitOfMeasurement(const char *)         {}
+  void setMin(float)                              {}
+  void setMax(float)                              {}
+  void setStep(float)                             {}
+  void setMode(Mode)                              {}
+  void onCommand(void (*command)(HANumeric number, HANumber *sender)) { _command = command; }
+protected:
+  void onMqttConnected() override                 {}
+};
@@ -0,0 +1,20 @@
+#pragma once
+#include <HADevice.h>
+
+class HASensorNumber : public HABaseDeviceType
+{
+private:
+  float _value = 0.0f;
+  NumberPrecision _precision;
+public:
+  HASensorNumber(const char *unique_id, NumberPrecision precision=PrecisionP0)
+  : HABaseDeviceType(F("sensor"), unique_id), _precision(precision) {}
+  bool setValue(float value, bool force=false);
+  void setCurrentValue(float value)               { _value = value; }
+  void setDeviceClass(const char *)               {}
+  void setStateClass(const char *)                {}
+  void setIcon(const char *)                      {}
+  void setUnitOfMeasurement(const char *)         {}
+protected:
+  void onMqttConnected() override                 {}
+};
@@ -0,0 +1,17 @@
+#pragma once
+#include <HADevice.h>
+
+class HASwitch : public HABaseDeviceType
+{
+private:
+  bool _state = false;
+  void (*_command)(bool state, HASwitch *sender) = NULL;
+public:
+  HASwitch(const char *unique_id) : HABaseDeviceType(F("switch"), unique_id) {}
+  bool setState(bool state, bool force=false);
+  void setCurrentState(bool state)                { _state = state; }
+  void setIcon(const char *)                      {}
+  void onCommand(void (*command)(bool state, HASwitch *sender)) { _command = command; }
+protected:
+  void onMqttConnected() override                 {}
+};
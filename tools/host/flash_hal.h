@@ -0,0 +1,6 @@
+#pragma once
+
+// The filesystem area of a 4MB board with a 1MB filesystem, in ram on the host (host.cpp)
+#define FLASH_SECTOR_SIZE   4096
+#define FS_PHYS_ADDR        0x300000
+#define FS_PHYS_SIZE        0xFA000
@@ -0,0 +1,77 @@
+////////////////////////////////////////////////////////////////////////////////////////////
+// The state behind the host headers, linked into each host build of the tools
+////////////////////////////////////////////////////////////////////////////////////////////
+#include <Arduino.h>
+#include <Clock.h>
+#include <flash_hal.h>
+#include <time.h>
+
+uint32_t host_millis = 0;
+uint32_t host_local = 0;
+uint32_t host_heap_used = 0;
+uint32_t host_allocs = 0;
+EspClass ESP;
+
+uint32_t EspClass::getCycleCount()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t) ((uint64_t) ts.tv_sec * HOST_MHZ * 1000000ULL + (uint64_t) ts.tv_nsec * HOST_MHZ / 1000);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The filesystem area, NOR semantics: a write only clears bits, an erase sets a sector
+////////////////////////////////////////////////////////////////////////////////////////////
+static uint8_t *flash()
+{
+  static uint8_t image[FS_PHYS_SIZE];     // not on the heap the tools count
+  static bool erased = false;
+  if (!erased) {
+    memset(image, 0xFF, sizeof(image));
+    erased = true;
+  }
+  return image;
+}
+
+static bool in_flash(uint32_t address, size_t size)
+{
+  return address >= FS_PHYS_ADDR && address + size <= FS_PHYS_ADDR + FS_PHYS_SIZE;
+}
+
+bool EspClass::flashRead(uint32_t address, uint32_t *data, size_t size)
+{
+  if (!in_flash(address, size))
+    return false;
+  memcpy(data, flash() + address - FS_PHYS_ADDR, size);
+  return true;
+}
+
+bool EspClass::flashWrite(uint32_t address, const uint32_t *data, size_t size)
+{
+  if (!in_flash(address, size))
+    return false;
+  uint8_t *to = flash() + address - FS_PHYS_ADDR;
+  for (size_t i=0; i<size; i++)
+    to[i] &= ((const uint8_t *) data)[i];
+  return true;
+}
+
+bool EspClass::flashEraseSector(uint32_t sector)
+{
+  if (!in_flash(sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE))
+    return false;
+  memset(flash() + sector * FLASH_SECTOR_SIZE - FS_PHYS_ADDR, 0xFF, FLASH_SECTOR_SIZE);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////////////////
+void host_panic(const char *file, int line, const char *func)
+{
+  fprintf(stderr, "panic at %s:%d in %s\n", file, line, func);
+  abort();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
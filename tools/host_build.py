@@ -0,0 +1,76 @@
+"""Build firmware sources of SmartTherm on a linux host, for the tools.
+
+The headers of the Arduino core and of the libraries with hardware behind them (the display,
+Home Assistant over MQTT) are the stand-ins in tools/host, the plain libraries (RunningAverage,
+Timer, SunRise, OpenTherm) are compiled from the Arduino libraries folder: --libraries,
+$ARDUINO_LIBRARIES or ~/Arduino/libraries.
+"""
+import ctypes
+import os
+import subprocess
+import sys
+import tempfile
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+REPO = os.path.normpath(os.path.join(TOOLS, '..'))
+HOST = os.path.join(TOOLS, 'host')
+# the bounds of the ram sections from the esp8266 linker script (Diagnostics.cpp), empty here
+SECTIONS = ['_data_start', '_data_end', '_rodata_start', '_rodata_end', '_bss_start', '_bss_end']
+
+
+def libraries_dir(path=None):
+    return path or os.environ.get('ARDUINO_LIBRARIES') or os.path.expanduser('~/Arduino/libraries')
+
+
+def library(libraries, header):
+    """The folder of the library with the header and its sources"""
+    if os.path.isdir(libraries):
+        for name in sorted(os.listdir(libraries)):
+            for folder in (os.path.join(libraries, name, 'src'), os.path.join(libraries, name)):
+                if os.path.isfile(os.path.join(folder, header)):
+                    return folder, [os.path.join(folder, f) for f in sorted(os.listdir(folder)) if f.endswith('.cpp')]
+    sys.exit('%s not found in %s, install its library or pass --libraries' % (header, libraries))
+
+
+def build(out, sources, libraries, headers, defines=(), shared=False, fakes=()):
+    """g++ the firmware sources (relative to the repo) with the libraries of the headers and
+    the fakes of tools/host"""
+    includes, lib_sources = [HOST, REPO], []
+    for header in headers:
+        folder, files = library(libraries, header)
+        includes.append(folder)
+        lib_sources += files
+    cmd = ['g++', '-std=gnu++17', '-O2', '-w', '-DARDUINO=10819', '-DESP8266', '-o', out]
+    cmd += ['-shared', '-fPIC'] if shared else []
+    cmd += ['-I' + folder for folder in includes]
+    cmd += ['-D%s=%s' % (name, value) for name, value in defines]
+    cmd += [os.path.join(REPO, s) for s in sources] + [os.path.join(HOST, f) for f in ('host.cpp',) + tuple(fakes)]
+    cmd += lib_sources
+    cmd += ['-Wl,--defsym=%s=0' % name for name in SECTIONS]
+    try:
+        subprocess.run(cmd, check=True)
+    except (OSError, subprocess.CalledProcessError) as e:
+        sys.exit('building %s failed: %s' % (os.path.basename(out), e))
+    return out
+
+
+def engine(libraries, defines=()):
+    """tools/replay_engine.cpp with the firmware it runs, loaded as a library"""
+    out = os.path.join(tempfile.mkdtemp(prefix='replay'), 'engine.so')
+    build(out, ['tools/replay_engine.cpp', 'OperatingMode.cpp', 'Temperature.cpp', 'HeatingCurve.cpp', 'Solar.cpp',
+                'Format.cpp'], libraries, ['RunningAverage.h', 'Timer.h', 'SunRise.h', 'OpenTherm.h'], defines,
+          shared=True)
+    return ctypes.CDLL(out)
+
+
+def benchmark(libraries, out, defines=()):
+    """tools/bench_host.cpp, the cases of Benchmark.cpp on the objects of the sketch"""
+    return build(out, ['tools/bench_host.cpp', 'Benchmark.cpp', 'SmartControl.cpp', 'Config.cpp', 'Temperature.cpp',
+                       'HeatingCurve.cpp', 'OperatingMode.cpp', 'Solar.cpp', 'Format.cpp', 'Display.cpp',
+                       'HAOTMonitor.cpp', 'HAStateBatch.cpp', 'PublishPolicy.cpp', 'Diagnostics.cpp', 'Energy.cpp',
+                       'Profiler.cpp', 'ConfigStore.cpp', 'ConfigFlash.cpp'],
+                 libraries, ['RunningAverage.h', 'Timer.h', 'SunRise.h', 'OpenTherm.h'],
+                 [('BENCHMARK', 1), ('BENCHMARK_HOST', 1), ('BENCHMARK_ALLOCS', 'host_allocs'),
+                  ('BENCHMARK_OPS', 1000), ('BENCHMARK_ROUNDS', 20)]
+                 + list(defines),
+                 fakes=['HAMqtt.cpp', 'Adafruit_GFX.cpp'])
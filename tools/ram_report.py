@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""Report the static RAM of SmartTherm per module, symbol by symbol from the firmware .elf.
+
+On the esp8266 .data, .rodata (all non PROGMEM constants) and .bss live in the data RAM.
+Each symbol there is attributed to a module, the header that declares its class:
+  - a member, static or vtable of a class to that class (SolarGain::... to Solar);
+  - a global object of SmartTherm.ino to its class (history to History);
+  - a file static to the source that defines it (nm -l, else a scan of the sources);
+  - the rest to the libraries and the core.
+
+  ram_report.py SmartTherm.ino.elf                  modules, largest first
+  ram_report.py SmartTherm.ino.elf --symbols 5      with the five largest symbols of each
+  ram_report.py SmartTherm.ino.elf --check          exit 1 when a module exceeds its budget
+
+The .elf is in the build folder (arduino-cli compile --output-dir build ...), nm is the one of
+the esp8266 toolchain: xtensa-lx106-elf-nm on the PATH or --nm.
+"""
+import argparse
+import collections
+import glob
+import os
+import re
+import subprocess
+import sys
+
+REPO = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+DRAM = (0x3FFE8000, 0x40000000)
+KINDS = {'d': 'data', 'g': 'data', 'v': 'data', 'r': 'rodata', 'b': 'bss', 's': 'bss', 'c': 'bss'}
+SKETCH, LIBRARIES = 'SmartTherm', '(libraries)'
+
+# bytes of static ram per module, objects and file statics; a regression fails --check
+BUDGETS = {
+    'HAOTMonitor': 8192,    # entities, string pool, library objects
+    'History': 4608,        # HISTORY_RAM_BUDGET and the store of the hours
+    'SmartControl': 3072,   # script[], the temperatures, the curve and the solar slots
+    'Zones': 1792,          # the zones, the hash index and the buffer of its store
+    'BinLog': 1536,
+    'Profiler': 1280,
+    'Scheduler': 1280,
+    'HAStateBatch': 1024,
+    'SensorBus': 768,       # the sensor table and its store
+    'Display': 512,         # print caches
+    'MetricsServer': 512,
+    'Benchmark': 384,
+    'Energy': 256,          # the totals and their store
+    'NtpSync': 256,
+    'Config': 256,          # the settings and the snapshot, with their stores
+    SKETCH: 256,            # the credentials and the task table of the sketch
+    'Format': 128,
+    'Diagnostics': 128,
+    'WifiLink': 128,
+    'Temperature': 128,
+    'Solar': 128,
+    'PublishPolicy': 64,
+    'HeatingCurve': 64,
+    'OtaUpdate': 64,
+}
+
+CLASS = re.compile(r'^(?:class|struct)\s+(\w+)\b(?!.*;\s*$)', re.M)
+OBJECT = re.compile(r'^([A-Z]\w*)\s+(\w+)\s*[;(\[]', re.M)
+STATIC = re.compile(r'^(?!return\b|typedef\b|using\b|class\b|struct\b|enum\b)(?:(?:static|const|volatile)\s+)*'
+                    r'[A-Za-z_][\w:<>,]*[\s*&]+(\w+)\s*(?:\[[^\]]*\])*\s*(?:=|;|\([^;{)]*\)\s*;)', re.M)
+PREFIXES = ('vtable for ', 'typeinfo for ', 'typeinfo name for ', 'guard variable for ')
+
+
+def sources():
+    return sorted(glob.glob(os.path.join(REPO, '*.h')) + glob.glob(os.path.join(REPO, '*.cpp'))
+                  + glob.glob(os.path.join(REPO, '*.ino')))
+
+
+def stem(path):
+    name = os.path.splitext(os.path.basename(path))[0]
+    return SKETCH if name.startswith(SKETCH) else name
+
+
+def read(path):
+    with open(path, encoding='utf-8', errors='replace') as f:
+        return f.read()
+
+
+def tables():
+    """class -> module from the headers, object -> class from the sketch, name -> module of the file statics"""
+    classes, objects, statics = {}, {}, {}
+    for path in sources():
+        text = read(path)
+        if path.endswith('.h'):
+            for name in CLASS.findall(text):
+                classes.setdefault(name, stem(path))
+        elif path.endswith('.ino'):
+            for cls, name in OBJECT.findall(text):
+                objects[name] = cls
+        for name in STATIC.findall(text):
+            statics.setdefault(name, stem(path))
+    return classes, objects, statics
+
+
+def symbols(nm, elf):
+    """(address, size, kind, name, source file) of the symbols in the data ram"""
+    try:
+        out = subprocess.run([nm, '-S', '-C', '-l', '--size-sort', elf], check=True, capture_output=True,
+                             text=True).stdout
+    except (OSError, subprocess.CalledProcessError) as e:
+        sys.exit('%s failed: %s' % (nm, e))
+    for line in out.splitlines():
+        fields = line.split('\t')
+        parts = fields[0].split(None, 3)
+        if len(parts) < 4 or parts[2].lower() not in KINDS:
+            continue
+        address, size = int(parts[0], 16), int(parts[1], 16)
+        if DRAM[0] <= address < DRAM[1] and size:
+            source = fields[1].rsplit(':', 1)[0] if len(fields) > 1 else ''
+            yield address, size, KINDS[parts[2].lower()], parts[3], source
+
+
+def module(name, source, classes, objects, statics):
+    for prefix in PREFIXES:
+        if name.startswith(prefix):
+            name = name[len(prefix):]
+    name = name.replace('(anonymous namespace)::', '')
+    owner = re.match(r'([A-Za-z_]\w*)(?:<[^:]*>)?::', name)
+    if owner and owner.group(1) in classes:
+        return classes[owner.group(1)]
+    if name in classes:                                     # vtable, typeinfo
+        return classes[name]
+    if name in objects:
+        return classes.get(objects[name], SKETCH)
+    if source and os.path.dirname(os.path.abspath(source)) == REPO:
+        return stem(source)
+    return statics.get(name, LIBRARIES)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('elf', help='the linked firmware, SmartTherm.ino.elf')
+    parser.add_argument('--nm', default='xtensa-lx106-elf-nm', help='nm of the esp8266 toolchain')
+    parser.add_argument('--symbols', type=int, default=0, metavar='N', help='list the N largest symbols per module')
+    parser.add_argument('--check', action='store_true', help='fail when a budget is exceeded')
+    parser.add_argument('--all', action='store_true', help='include the libraries and the core')
+    args = parser.parse_args()
+
+    classes, objects, statics = tables()
+    usage = collections.defaultdict(collections.Counter)
+    members = collections.defaultdict(list)
+    for _, size, kind, name, source in symbols(args.nm, args.elf):
+        m = module(name, source, classes, objects, statics)
+        usage[m][kind] += size
+        members[m].append((size, name))
+
+    rows = sorted(usage.items(), key=lambda m: -sum(m[1].values()))
+    failed = []
+    print('%-24s %7s %7s %7s %7s %7s' % ('module', 'data', 'rodata', 'bss', 'total', 'budget'))
+    for name, sizes in rows:
+        total = sum(sizes.values())
+        budget = BUDGETS.get(name)
+        if budget is None and not args.all:
+            continue
+        mark = ''
+        if budget is not None and total > budget:
+            failed.append(name)
+            mark = ' !'
+        print('%-24s %7d %7d %7d %7d %7s%s' % (name, sizes['data'], sizes['rodata'], sizes['bss'], total,
+                                              budget if budget is not None else '-', mark))
+        for size, symbol in sorted(members[name], reverse=True)[:args.symbols]:
+            print('  %-46s %7d' % (symbol[:46], size))
+    print('%-24s %31d' % ('total', sum(sum(s.values()) for s in usage.values())))
+
+    if failed:
+        print('over budget: %s' % ', '.join(failed), file=sys.stderr)
+        return 1 if args.check else 0
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
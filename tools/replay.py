@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+"""Replay recorded temperatures through the operating mode decision of SmartControl.
+
+The control is the firmware itself built with g++ into a library (tools/replay_engine.cpp,
+tools/host_build.py): the temperatures with the validation of Temperature.cpp and the policies
+of SmartControl.h, the setpoint of HeatingCurve with the solar gain and operating_mode() of
+OperatingMode.cpp behind the anti pendel timer, run on a virtual clock of ANALYSE_TIME steps.
+The replay is open loop: the recorded inlet does not follow the decisions, so the numbers compare
+two versions of the rules on the same traces rather than predict the house.
+
+The csv holds one row per sample with a header, the times in local time (or with an offset),
+an empty field when that sensor had no new value; target is optional:
+  time,outside,inside,inlet,outlet,target
+  2024-01-12T10:00:00,4.2,20.1,27.5,31.0,20.5
+
+  replay.py jan.csv feb.csv                         switches, comfort and the invariants
+  replay.py *.csv --save before.json                keep the result of the current rules
+  replay.py *.csv --trend-factor 3 --compare before.json
+                                                    a changed rule against the saved result
+The rule options rebuild the engine with the define changed, the defaults are those of
+OperatingMode.h. It exits with 1 when an invariant is violated: a switch within the anti
+pendel time, heating and cooling at once, or more switches per day than --max-switches; or when
+a trace is colder or warmer than --max-cold or --max-warm:
+
+  replay.py *.csv --max-cold 5 --max-warm 5         fail a rule that costs comfort
+"""
+import argparse
+import csv
+import ctypes
+import datetime
+import json
+import os
+import sys
+
+import host_build
+from solar_replay import TZ, Solar, load_defines, load_engine, load_location
+
+SENSORS = {'inside': 0, 'outside': 1, 'target': 2, 'inlet': 3, 'outlet': 4}   # ReplaySensor
+# ModeChange of OperatingMode.h, ModeHeatingNot is no switch
+CHANGES = [None, 'cooling_on', 'cooling_off', 'heating_on', None, 'heating_off']
+HEATING, COOLING = 1, 2                                                          # replay_flags()
+
+
+def build_engine(rules):
+    """The control of the firmware as a host library, with the given rule defines"""
+    defines = [('COOLING_THRESHOLD', rules.cooling_threshold), ('MODE_TREND_FACTOR', rules.trend_factor),
+               ('MODE_OFF_MARGIN', rules.off_margin)]
+    lib = load_engine(host_build.libraries_dir(rules.libraries),
+                      [(name, '%rf' % value) for name, value in defines if value is not None])
+    lib.replay_new.restype = ctypes.c_void_p
+    lib.replay_new.argtypes = [ctypes.c_float]
+    lib.replay_delete.argtypes = [ctypes.c_void_p]
+    lib.replay_antipendel.restype = ctypes.c_uint32
+    lib.replay_sample.restype = ctypes.c_bool
+    lib.replay_sample.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_uint8, ctypes.c_float]
+    lib.replay_setpoint.restype = ctypes.c_float
+    lib.replay_setpoint.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_float]
+    lib.replay_tick.restype = ctypes.c_uint8
+    lib.replay_tick.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+    lib.replay_flags.restype = ctypes.c_uint8
+    lib.replay_flags.argtypes = [ctypes.c_void_p]
+    lib.replay_error.restype = ctypes.c_bool
+    lib.replay_error.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_float)]
+    return lib
+
+
+def read_trace(name):
+    rows = []
+    with open(name, newline='', encoding='utf-8') as f:
+        for row in csv.DictReader(f):
+            when = datetime.datetime.fromisoformat(row['time'])
+            when = when.replace(tzinfo=TZ) if when.tzinfo is None else when.astimezone(TZ)
+            values = {k: float(v) for k, v in row.items() if k in SENSORS and v not in (None, '')}
+            rows.append((when.timestamp(), values))
+    rows.sort(key=lambda r: r[0])
+    return rows
+
+
+def replay(rows, step, solar, rules, engine):
+    """The trace through the engine on its virtual clock, ms since the first sample (wrapping
+    as millis() does)"""
+    start = rows[0][0]
+    control = engine.replay_new(rules.target)
+    r = {'switches': {}, 'heating_hours': 0.0, 'cooling_hours': 0.0, 'cold': 0.0, 'warm': 0.0,
+         'rejected': 0, 'violations': []}
+    switched = []                             # ms of each switch
+    pendel = engine.replay_antipendel()
+    period = rules.setpoint_period * 1000
+    samples = [(int((when - start) * 1000), [(SENSORS[name], value) for name, value in values.items()])
+               for when, values in rows]
+    end, hours = samples[-1][0], step / 3.6e6
+    error = ctypes.c_float()
+    i, now, next_setpoint = 0, 0, 0
+    while now <= end:
+        while i < len(samples) and samples[i][0] <= now:
+            at, values = samples[i]
+            for sensor, value in values:
+                if not engine.replay_sample(control, at & 0xffffffff, sensor, value):
+                    r['rejected'] += 1
+            i += 1
+        if now >= next_setpoint:
+            next_setpoint = now + period
+            offset = solar.offset(datetime.datetime.fromtimestamp(start + now / 1000.0, TZ)) if solar else 0.0
+            engine.replay_setpoint(control, now & 0xffffffff, offset)
+        change = CHANGES[engine.replay_tick(control, now & 0xffffffff)]
+        if change:
+            r['switches'][change] = r['switches'].get(change, 0) + 1
+            switched.append(now)
+
+        flags = engine.replay_flags(control)
+        if flags & HEATING:
+            r['heating_hours'] += hours
+        if flags & COOLING:
+            r['cooling_hours'] += hours
+        if flags & HEATING and flags & COOLING:
+            r['violations'].append('heating and cooling at %s' % stamp(start, now))
+        if engine.replay_error(control, ctypes.byref(error)):
+            if error.value < -rules.band and not flags & HEATING:
+                r['cold'] += (-rules.band - error.value) * hours
+            if error.value > rules.band and flags & HEATING:
+                r['warm'] += (error.value - rules.band) * hours
+        now += step
+    engine.replay_delete(control)
+
+    for a, b in zip(switched, switched[1:]):
+        if b - a < pendel:
+            r['violations'].append('switched %d minutes apart at %s' % ((b - a) // 60000, stamp(start, b)))
+    days = {}
+    for at in switched:
+        day = stamp(start, at)[:10]
+        days[day] = days.get(day, 0) + 1
+    for day, n in sorted(days.items()):
+        if n > rules.max_switches:
+            r['violations'].append('%d switches on %s' % (n, day))
+    r['days'] = end / 8.64e7
+    r['max_per_day'] = max(days.values()) if days else 0
+    return r
+
+
+def stamp(start, now):
+    return datetime.datetime.fromtimestamp(start + now / 1000.0, TZ).strftime('%Y-%m-%d %H:%M')
+
+
+METRICS = [('heating_on', 'starts'), ('max_per_day', 'max/day'), ('heating_hours', 'heat h'),
+           ('cooling_hours', 'cool h'), ('cold', 'cold °C·h'), ('warm', 'warm °C·h'), ('rejected', 'rejected')]
+
+
+def metrics(r):
+    m = {key: r.get(key, r['switches'].get(key, 0)) for key, _ in METRICS}
+    m['violations'] = len(r['violations'])
+    return m
+
+
+def main():
+    here = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('traces', nargs='+')
+    parser.add_argument('--target', type=float, default=20.5, help='when the trace has none')
+    parser.add_argument('--band', type=float, default=0.3, help='°C from the target before it counts as cold or warm')
+    parser.add_argument('--setpoint-period', type=float, default=20.0, help='seconds between the TSet frames')
+    parser.add_argument('--no-solar', action='store_true', help='without the solar feed forward')
+    parser.add_argument('--max-switches', type=int, default=24, help='per day')
+    parser.add_argument('--max-cold', type=float, help='°C·h per trace below the band while not heating')
+    parser.add_argument('--max-warm', type=float, help='°C·h per trace above the band while heating')
+    parser.add_argument('--trend-factor', type=float, help='heating on when factor*trend > error')
+    parser.add_argument('--off-margin', type=float, help='heating off when inlet - setpoint > margin')
+    parser.add_argument('--cooling-threshold', type=float, help='cooling above it, inside and outside')
+    parser.add_argument('--save', metavar='JSON', help='write the results, to compare with later')
+    parser.add_argument('--compare', metavar='JSON', help='show the change against saved results')
+    parser.add_argument('--libraries', help='Arduino libraries folder, see tools/host_build.py')
+    args = parser.parse_args()
+
+    step = load_defines(os.path.join(here, 'SmartControl.cpp'), ['ANALYSE_TIME'])['ANALYSE_TIME']
+    engine = build_engine(args)
+    lat, lon = load_location(os.path.join(here, 'SmartControl.cpp'))
+
+    before = {}
+    if args.compare:
+        with open(args.compare, encoding='utf-8') as f:
+            before = json.load(f)
+    results, failed = {}, False
+    print('%-20s %6s' % ('trace', 'days') + ''.join('%12s' % label for _, label in METRICS))
+    for name in args.traces:
+        rows = read_trace(name)
+        if len(rows) < 2:
+            sys.exit('%s: not enough samples' % name)
+        solar = None if args.no_solar else Solar(engine, lat, lon, engine.solar_default_gain())
+        began = datetime.datetime.now()
+        r = replay(rows, step, solar, args, engine)
+        spent = (datetime.datetime.now() - began).total_seconds()
+        if args.max_cold is not None and r['cold'] > args.max_cold:
+            r['violations'].append('%.1f °C·h cold, more than %.1f' % (r['cold'], args.max_cold))
+        if args.max_warm is not None and r['warm'] > args.max_warm:
+            r['violations'].append('%.1f °C·h warm, more than %.1f' % (r['warm'], args.max_warm))
+        key = os.path.basename(name)
+        m = results[key] = metrics(r)
+        print('%-20s %6.1f' % (key[:20], r['days']) + ''.join('%12.1f' % m[k] for k, _ in METRICS)
+              + '   (%.0f days/s)' % (r['days'] / spent if spent else 0))
+        if key in before:
+            print('%-20s %6s' % ('  change', '') + ''.join('%+12.1f' % (m[k] - before[key].get(k, 0)) for k, _ in METRICS))
+        for v in r['violations'][:10]:
+            print('  violation: ' + v)
+        failed |= bool(r['violations'])
+    if args.save:
+        with open(args.save, 'w', encoding='utf-8') as f:
+            json.dump(results, f, indent=1, sort_keys=True)
+    if failed:
+        sys.exit('invariants violated or comfort exceeded')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,161 @@
+////////////////////////////////////////////////////////////////////////////////////////////
+// The control of the firmware as a host library with a C interface, for tools/replay.py and
+// tools/solar_replay.py: the temperatures with the policies of SmartControl.h (Temperature.cpp),
+// the operating mode decision (OperatingMode.cpp) behind the anti pendel timer, the heating
+// curve (HeatingCurve.cpp) and the solar gain (Solar.cpp). Built by host_build.engine() against
+// the headers in tools/host, with -DMODE_TREND_FACTOR=3.0f etc. for a changed rule. The replay
+// runs on the virtual clock, host_millis.
+////////////////////////////////////////////////////////////////////////////////////////////
+#include "SmartControl.h"
+#include "Zones.h"
+#include "BinLog.h"
+
+// The rooms and the binary log are not built on the host: no zones, records go nowhere
+Zones *Zones::instance()                  { return NULL; }
+bool Zones::error(float &) const          { return false; }
+BinLog *BinLog::instance()                { return NULL; }
+void BinLog::_append(uint8_t, uint8_t, const uint32_t *, uint8_t) {}
+
+// a plain value for the curve, which is always valid
+TEMPERATURE_POLICY(PlainPolicy, 0.0f, 0.0f, 0.0f, 0.0f, 0, 0, 0, 0.0f, 0.0f)
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// The control part of SmartControl: its temperatures, the curve and the anti pendel timer,
+// _switch_mode() without the logging
+////////////////////////////////////////////////////////////////////////////////////////////
+enum ReplaySensor : uint8_t { SensorInside, SensorOutside, SensorTarget, SensorInlet, SensorOutlet };
+
+struct Replay
+{
+  TemperatureT<InsidePolicy>    inside;
+  TemperatureT<TargetPolicy>    target;
+  TemperatureT<SetpointPolicy>  setpoint;
+  TemperatureT<WaterPolicy>     inlet;
+  TemperatureT<WaterPolicy>     outlet;
+  TemperatureT<OutsidePolicy>   outside;
+  HeatingCurve                  curve;
+  OperatingFlags                flags;
+  Timer                         timer_switch_onoff;
+
+  Replay(float t)
+  : inside(20.0f), target(t), setpoint(20.0f), inlet(20.0f), outlet(20.0f), outside(10.0f)
+  , flags{false, false, false, false}
+  {
+    target.set(t, false);
+    timer_switch_onoff.set(ANTIPENDEL_TIMEFRAME);  // as in SmartControl::begin()
+  }
+
+  uint8_t switch_mode()
+  {
+    if (!timer_switch_onoff.passed())
+      return ModeKeep;
+    ModeInput in = {
+      inside.get(),  outside.get(),  target.get(),  setpoint.get(),  setpoint.trend(), inlet.get(), 0.0f,
+      inside.valid(), outside.valid(), target.valid(), setpoint.valid(), inlet.valid(), false
+    };
+    ModeDecision d = operating_mode(in, flags);
+    if (d.change == ModeKeep || d.change == ModeHeatingNot)
+      return ModeKeep;
+    timer_switch_onoff.set(ANTIPENDEL_TIMEFRAME);
+    return d.change;
+  }
+};
+
+extern "C" {
+
+// a new replay at ms 0 of the virtual clock
+Replay *replay_new(float target)
+{
+  host_millis = 0;
+  return new Replay(target);
+}
+
+void replay_delete(Replay *r)
+{
+  delete r;
+}
+
+uint32_t replay_antipendel()
+{
+  return ANTIPENDEL_TIMEFRAME;
+}
+
+// a sample of a sensor at ms, false when the policy rejects it; the target is not validated
+bool replay_sample(Replay *r, uint32_t ms, uint8_t sensor, float value)
+{
+  host_millis = ms;
+  switch (sensor)
+  {
+  case SensorInside:  return r->inside.set(value);
+  case SensorOutside: return r->outside.set(value);
+  case SensorTarget:  return r->target.set(value, false);
+  case SensorInlet:   return r->inlet.set(value);
+  case SensorOutlet:  return r->outlet.set(value);
+  }
+  return false;
+}
+
+// the TSet frame: the curve on the temperatures, lowered by the solar offset
+float replay_setpoint(Replay *r, uint32_t ms, float solar)
+{
+  host_millis = ms;
+  r->setpoint.set(r->curve.calculate(&r->inside, &r->target, &r->outside, solar));
+  return r->setpoint.get();
+}
+
+// the analysis at ms, the ModeChange when the mode switched
+uint8_t replay_tick(Replay *r, uint32_t ms)
+{
+  host_millis = ms;
+  return r->switch_mode();
+}
+
+// bit 0 heating, bit 1 cooling
+uint8_t replay_flags(const Replay *r)
+{
+  return (r->flags.enable_CH ? 1 : 0) | (r->flags.enable_Cooling ? 2 : 0);
+}
+
+// the inside error against the target, false while the inside is not valid
+bool replay_error(const Replay *r, float *error)
+{
+  *error = r->inside.get() - r->target.get();
+  return r->inside.valid();
+}
+
+// HeatingCurve::calculate() with the default factors
+float curve_setpoint(float current, float target, float outside, float solar)
+{
+  static HeatingCurve curve;
+  TemperatureT<PlainPolicy> c(current), t(target), o(outside);
+  return curve.calculate(&c, &t, &o, solar);
+}
+
+// SolarGain of the firmware, times are local unix times as on the device
+SolarGain *solar_new(float latitude, float longitude, float gain)
+{
+  SolarGain *s = new SolarGain(latitude, longitude);
+  s->gain = gain;
+  return s;
+}
+
+void solar_delete(SolarGain *s)
+{
+  delete s;
+}
+
+float solar_default_gain()
+{
+  return SOLAR_GAIN;
+}
+
+float solar_offset(SolarGain *s, uint32_t local, int32_t utc_offset)
+{
+  s->update(local, utc_offset);
+  return s->offset(local);
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
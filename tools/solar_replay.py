@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Replay recorded weather through the heating curve, with and without the solar feed forward.
+
+The solar gain (Solar.cpp) and the heating curve (HeatingCurve.cpp) are those of the firmware,
+built on the host into tools/replay_engine.cpp (see tools/host_build.py). The house is a simple
+two node model (room and floor) with the sun shining through the windows, so the numbers
+compare the two runs rather than predict the house.
+
+The csv holds one row per sample with a header, the times in local time (or with an offset):
+  time,outside,irradiance
+  2024-03-12T10:00,6.2,310
+
+  solar_replay.py weather.csv                       over heating with the default gain
+  solar_replay.py weather.csv --gain 0 1 1.5 2 3    compare several gains
+"""
+import argparse
+import csv
+import ctypes
+import datetime
+import os
+import re
+import sys
+from zoneinfo import ZoneInfo
+
+import host_build
+
+TZ = ZoneInfo('Europe/Amsterdam')
+
+
+def load_defines(path, names):
+    with open(path, encoding='utf-8') as f:
+        text = f.read()
+    values = {}
+    for name in names:
+        m = re.search(r'#define\s+%s\s+([^/\n]+)' % name, text)
+        values[name] = eval(m.group(1).strip().replace('f', ''), {})
+    return values
+
+
+def load_location(path):
+    with open(path, encoding='utf-8') as f:
+        text = f.read()
+    lat = float(re.search(r'float latitude = ([-\d.]+);', text).group(1))
+    lon = float(re.search(r'float longitude = ([-\d.]+);', text).group(1))
+    return lat, lon
+
+
+def load_engine(libraries, defines=()):
+    """The curve and the solar gain of the firmware (tools/replay_engine.cpp)"""
+    engine = host_build.engine(libraries, defines)
+    engine.curve_setpoint.restype = ctypes.c_float
+    engine.curve_setpoint.argtypes = [ctypes.c_float] * 4
+    engine.solar_new.restype = ctypes.c_void_p
+    engine.solar_new.argtypes = [ctypes.c_float, ctypes.c_float, ctypes.c_float]
+    engine.solar_delete.argtypes = [ctypes.c_void_p]
+    engine.solar_default_gain.restype = ctypes.c_float
+    engine.solar_offset.restype = ctypes.c_float
+    engine.solar_offset.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_int32]
+    return engine
+
+
+class Solar:
+    """SolarGain of the firmware, on the local time of a datetime as the Clock holds it"""
+
+    def __init__(self, engine, lat, lon, gain):
+        self.engine, self.gain = engine, gain
+        self.solar = engine.solar_new(lat, lon, gain)
+
+    def __del__(self):
+        self.engine.solar_delete(self.solar)
+
+    def offset(self, when):
+        utc_offset = int(when.utcoffset().total_seconds())
+        return self.engine.solar_offset(self.solar, int(when.timestamp()) + utc_offset, utc_offset)
+
+
+def read_weather(name):
+    rows = []
+    with open(name, newline='', encoding='utf-8') as f:
+        for row in csv.DictReader(f):
+            when = datetime.datetime.fromisoformat(row['time'])
+            when = when.replace(tzinfo=TZ) if when.tzinfo is None else when.astimezone(TZ)
+            rows.append((when, float(row['outside']), float(row['irradiance'])))
+    rows.sort()
+    return rows
+
+
+def replay(weather, solar, engine, args):
+    """Room and floor nodes, one minute steps, the weather held between the samples"""
+    room, floor = args.target, args.target + 2.0
+    over = under = heat = 0.0
+    step = 60.0
+    i = 0
+    when, end = weather[0][0], weather[-1][0]
+    while when < end:
+        while i + 1 < len(weather) and weather[i + 1][0] <= when:
+            i += 1
+        _, outside, sun = weather[i]
+        water = engine.curve_setpoint(room, args.target, outside, solar.offset(when))
+        q_floor = args.emitter * max(water - floor, 0.0)          # W into the floor
+        q_room = args.floor * (floor - room)                      # W from the floor to the room
+        q_loss = args.loss * (room - outside)
+        floor += (q_floor - q_room) * step / args.floor_capacity
+        room += (q_room - q_loss + args.window * sun) * step / args.room_capacity
+        heat += q_floor * step / 3.6e6
+        if room > args.target + args.band:
+            over += (room - args.target - args.band) * step / 3600.0
+        if room < args.target - args.band:
+            under += (args.target - args.band - room) * step / 3600.0
+        when += datetime.timedelta(seconds=step)
+    return over, under, heat
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('weather')
+    parser.add_argument('--gain', type=float, nargs='*', help='°C per kW/m², default from Solar.h')
+    parser.add_argument('--libraries', help='Arduino libraries folder, see tools/host_build.py')
+    parser.add_argument('--target', type=float, default=20.5)
+    parser.add_argument('--band', type=float, default=0.5, help='°C around the target that is comfortable')
+    parser.add_argument('--loss', type=float, default=150.0, help='W/K of the house')
+    parser.add_argument('--window', type=float, default=4.0, help='m² effective south window')
+    parser.add_argument('--emitter', type=float, default=400.0, help='W/K from the water into the floor')
+    parser.add_argument('--floor', type=float, default=600.0, help='W/K from the floor into the room')
+    parser.add_argument('--floor-capacity', type=float, default=30e6, help='J/K')
+    parser.add_argument('--room-capacity', type=float, default=15e6, help='J/K')
+    args = parser.parse_args()
+
+    engine = load_engine(host_build.libraries_dir(args.libraries))
+    lat, lon = load_location(os.path.join(host_build.REPO, 'SmartControl.cpp'))
+    weather = read_weather(args.weather)
+    if len(weather) < 2:
+        sys.exit('not enough weather samples')
+
+    gains = args.gain if args.gain else [0.0, engine.solar_default_gain()]
+    base = None
+    print('%8s %14s %14s %10s' % ('gain', 'over (°C·h)', 'under (°C·h)', 'heat kWh'))
+    for gain in gains:
+        over, under, heat = replay(weather, Solar(engine, lat, lon, gain), engine, args)
+        base = over if base is None else base
+        avoided = ' (%.0f%% less over heating)' % (100.0 * (base - over) / base) if base > 0 and gain != gains[0] else ''
+        print('%8.2f %14.2f %14.2f %10.1f%s' % (gain, over, under, heat, avoided))
+
+
+if __name__ == '__main__':
+    main()